@@ -0,0 +1,135 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DIPSHP_ARENA_CHUNK_SIZE 16384
+#define DIPSHP_ARENA_ALIGN sizeof(void *)
+
+typedef struct dipshp_arena_chunk_tag
+{
+    struct dipshp_arena_chunk_tag *next;
+    int size;
+    int used;
+    void *data[];
+}
+dipshp_arena_chunk;
+
+struct dipsh_arena_tag
+{
+    /* the chunks past current are free, the ones before it are full */
+    dipshp_arena_chunk *first;
+    dipshp_arena_chunk *current;
+    long used;
+    long high_water;
+    long reserved;
+};
+
+dipsh_arena *
+dipsh_arena_init()
+{
+    return calloc(sizeof(dipsh_arena), 1);
+}
+
+void
+dipsh_arena_destroy(
+    dipsh_arena *arena
+)
+{
+    if (!arena)
+        return;
+    dipshp_arena_chunk *chunk = arena->first;
+    while (chunk) {
+        dipshp_arena_chunk *temp = chunk;
+        chunk = chunk->next;
+        free(temp);
+    }
+    free(arena);
+}
+
+static dipshp_arena_chunk *
+dipshp_add_chunk(
+    dipsh_arena *arena,
+    int size
+)
+{
+    if (size < DIPSHP_ARENA_CHUNK_SIZE)
+        size = DIPSHP_ARENA_CHUNK_SIZE;
+    dipshp_arena_chunk *chunk = malloc(sizeof(dipshp_arena_chunk) + size);
+    if (!chunk)
+        return NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    /* after the current one, so that the free chunks stay past it */
+    if (arena->current) {
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    } else {
+        chunk->next = arena->first;
+        arena->first = chunk;
+    }
+    arena->reserved += size;
+    return chunk;
+}
+
+/* moves on to a free chunk with size bytes in it */
+static dipshp_arena_chunk *
+dipshp_next_chunk(
+    dipsh_arena *arena,
+    int size
+)
+{
+    dipshp_arena_chunk *chunk = arena->current
+        ? arena->current->next
+        : arena->first;
+    if (chunk)
+        chunk->used = 0;
+    if (!chunk || chunk->size < size)
+        chunk = dipshp_add_chunk(arena, size);
+    if (chunk)
+        arena->current = chunk;
+    return chunk;
+}
+
+void *
+dipsh_arena_alloc(
+    dipsh_arena *arena,
+    int size
+)
+{
+    size = (size + DIPSHP_ARENA_ALIGN - 1) & ~(DIPSHP_ARENA_ALIGN - 1);
+    dipshp_arena_chunk *chunk = arena->current;
+    if (!chunk || chunk->used + size > chunk->size) {
+        chunk = dipshp_next_chunk(arena, size);
+        if (!chunk)
+            return NULL;
+    }
+    void *result = (char *)chunk->data + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+    if (arena->used > arena->high_water)
+        arena->high_water = arena->used;
+    memset(result, 0, size);
+    return result;
+}
+
+void
+dipsh_arena_reset(
+    dipsh_arena *arena
+)
+{
+    arena->current = arena->first;
+    if (arena->current)
+        arena->current->used = 0;
+    arena->used = 0;
+}
+
+void
+dipsh_arena_get_stats(
+    const dipsh_arena *arena,
+    dipsh_arena_stats *stats
+)
+{
+    stats->used = arena->used;
+    stats->high_water = arena->high_water;
+    stats->reserved = arena->reserved;
+}
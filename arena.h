@@ -0,0 +1,46 @@
+#ifndef _DIPSH_ARENA_H_
+#define _DIPSH_ARENA_H_
+
+/* bump allocator for things that die together, like the symbols of a parse
+ * tree: nothing is freed on its own, the whole arena is reset at once, and
+ * its chunks are kept to be filled again */
+
+typedef struct dipsh_arena_tag dipsh_arena;
+
+dipsh_arena *
+dipsh_arena_init();
+
+void
+dipsh_arena_destroy(
+    dipsh_arena *arena
+);
+
+/* returns size zeroed bytes aligned as pointers are, NULL if there is no
+ * memory */
+void *
+dipsh_arena_alloc(
+    dipsh_arena *arena,
+    int size
+);
+
+/* frees everything allocated so far, in O(1) */
+void
+dipsh_arena_reset(
+    dipsh_arena *arena
+);
+
+typedef struct dipsh_arena_stats_tag
+{
+    long used;          /* since the last reset */
+    long high_water;    /* the most ever used between two resets */
+    long reserved;      /* in the chunks kept */
+}
+dipsh_arena_stats;
+
+void
+dipsh_arena_get_stats(
+    const dipsh_arena *arena,
+    dipsh_arena_stats *stats
+);
+
+#endif /* _DIPSH_ARENA_H_ */
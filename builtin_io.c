@@ -0,0 +1,176 @@
+#include "builtin_io.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+static void
+dipshp_close_owned(
+    dipsh_builtin_io *io
+)
+{
+    for (int i = 0; i < DIPSH_BUILTIN_IO_FDS; ++i) {
+        if (io->owned[i])
+            close(io->fds[i]);
+        io->owned[i] = 0;
+    }
+}
+
+static int
+dipshp_set_fd(
+    dipsh_builtin_io *io,
+    const dipsh_redirect *redir
+)
+{
+    if (!redir->need_open_file) {
+        if (redir->fd < DIPSH_BUILTIN_IO_FDS)
+            io->fds[redir->fd] = redir->inherited_fd;
+        return 0;
+    }
+    int file_fd = dipsh_redirect_open_file(redir);
+    if (-1 == file_fd)
+        return -1;
+    /* the builtin can't use an fd this high, but the file is still made */
+    if (redir->fd >= DIPSH_BUILTIN_IO_FDS) {
+        close(file_fd);
+        return 0;
+    }
+    io->fds[redir->fd] = file_fd;
+    io->owned[redir->fd] = 1;
+    return 0;
+}
+
+int
+dipsh_builtin_io_init(
+    dipsh_builtin_io *io,
+    const dipsh_redirect_list *redirs
+)
+{
+    for (int i = 0; i < DIPSH_BUILTIN_IO_FDS; ++i) {
+        io->fds[i] = i;
+        io->owned[i] = 0;
+    }
+    io->write_failed = 0;
+    io->buf_len = 0;
+    io->buf_fd = -1;
+    io->buf_line_buffered = 0;
+    /* close entries are about the shell's own fds, which are not the
+     * builtin's to close */
+    for (; redirs; redirs = redirs->next) {
+        if (dipsh_redir_close == redirs->redir.type)
+            continue;
+        if (-1 == dipshp_set_fd(io, &redirs->redir)) {
+            int saved_errno = errno;
+            dipshp_close_owned(io);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+dipsh_builtin_io_destroy(
+    dipsh_builtin_io *io
+)
+{
+    dipsh_builtin_io_flush(io);
+    dipshp_close_owned(io);
+    return io->write_failed ? -1 : 0;
+}
+
+/* writes all of iov, whatever number of calls it takes */
+static int
+dipshp_writev_all(
+    int fd,
+    struct iovec *iov,
+    int iov_len
+)
+{
+    while (iov_len) {
+        ssize_t written = writev(fd, iov, iov_len);
+        if (-1 == written && EINTR == errno)
+            continue;
+        if (-1 == written)
+            return -1;
+        while (iov_len && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iov_len;
+        }
+        if (iov_len) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/* writes the buffer followed by buf, which may be empty */
+static int
+dipshp_write_through(
+    dipsh_builtin_io *io,
+    const char *buf,
+    int len
+)
+{
+    struct iovec iov[2];
+    int iov_len = 0;
+    if (io->buf_len) {
+        iov[iov_len].iov_base = io->buf;
+        iov[iov_len++].iov_len = io->buf_len;
+    }
+    if (len) {
+        iov[iov_len].iov_base = (char *)buf;
+        iov[iov_len++].iov_len = len;
+    }
+    int ret = 0;
+    if (iov_len) {
+        /* the shell's own messages must not come out after the builtin's */
+        fflush(stdout);
+        ret = dipshp_writev_all(io->buf_fd, iov, iov_len);
+    }
+    io->buf_len = 0;
+    if (-1 == ret)
+        io->write_failed = 1;
+    return ret;
+}
+
+int
+dipsh_builtin_io_flush(
+    dipsh_builtin_io *io
+)
+{
+    return dipshp_write_through(io, NULL, 0);
+}
+
+int
+dipsh_builtin_io_write(
+    dipsh_builtin_io *io,
+    int fd,
+    const char *buf,
+    int len
+)
+{
+    int real_fd = fd >= 0 && fd < DIPSH_BUILTIN_IO_FDS ? io->fds[fd] : -1;
+    if (-1 == real_fd) {
+        io->write_failed = 1;
+        errno = EBADF;
+        return -1;
+    }
+    if (real_fd != io->buf_fd) {
+        int ret = dipsh_builtin_io_flush(io);
+        if (-1 == ret)
+            return ret;
+        io->buf_fd = real_fd;
+        io->buf_line_buffered = isatty(real_fd);
+    }
+    if (len > DIPSH_BUILTIN_IO_BUF_SIZE - io->buf_len)
+        return dipshp_write_through(io, buf, len);
+    memcpy(io->buf + io->buf_len, buf, len);
+    io->buf_len += len;
+    if (io->buf_line_buffered && memchr(buf, '\n', len))
+        return dipsh_builtin_io_flush(io);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef _DIPSH_BUILTIN_IO_H_
+#define _DIPSH_BUILTIN_IO_H_
+
+#include "command.h"
+
+/* where a builtin run inside the shell reads and writes: the command's
+ * redirections are resolved once, when the builtin starts, into a map from
+ * command fds to the shell's fds. Output goes through a single buffer, so
+ * that whatever is written to stdout and stderr keeps its order; the buffer
+ * is flushed when the target fd changes, when it's full (then with writev,
+ * the new data not copied), on a newline if the target is a terminal, and
+ * at the end of the builtin */
+
+#define DIPSH_BUILTIN_IO_FDS 10
+#define DIPSH_BUILTIN_IO_BUF_SIZE 8192
+
+typedef struct dipsh_builtin_io_tag
+{
+    int fds[DIPSH_BUILTIN_IO_FDS];      /* -1 for a closed one */
+    int owned[DIPSH_BUILTIN_IO_FDS];    /* opened for the builtin */
+    int write_failed;
+
+    char buf[DIPSH_BUILTIN_IO_BUF_SIZE];
+    int buf_len;
+    int buf_fd;                         /* the shell's fd the data is for */
+    int buf_line_buffered;
+}
+dipsh_builtin_io;
+
+/* maps the fds through redirs (NULL for no redirections at all), opening
+ * the files; returns 0, or -1 with errno set if some file can't be opened,
+ * nothing is left open then */
+int
+dipsh_builtin_io_init(
+    dipsh_builtin_io *io,
+    const dipsh_redirect_list *redirs
+);
+
+/* flushes the output and closes the files opened by init; returns 0, or -1
+ * if any of the writes has failed */
+int
+dipsh_builtin_io_destroy(
+    dipsh_builtin_io *io
+);
+
+/* returns 0, or -1 with errno set; fd is the command's fd */
+int
+dipsh_builtin_io_write(
+    dipsh_builtin_io *io,
+    int fd,
+    const char *buf,
+    int len
+);
+
+int
+dipsh_builtin_io_flush(
+    dipsh_builtin_io *io
+);
+
+#endif /* _DIPSH_BUILTIN_IO_H_ */
@@ -0,0 +1,292 @@
+#include "bytecode.h"
+#include <stdlib.h>
+
+/* the code is compiled twice: first only to count what it needs, which is
+ * then allocated at once, and then for real */
+typedef struct dipshp_compiler_tag
+{
+    const dipsh_ast *ast;
+    dipsh_bytecode *code;   /* NULL while counting */
+    int code_len;
+    int commands_len;
+    int pipelines_len;
+}
+dipshp_compiler;
+
+/* returns the index of the instruction */
+static int
+dipshp_emit(
+    dipshp_compiler *compiler,
+    dipsh_opcode opcode,
+    int arg,
+    int is_tail
+)
+{
+    if (compiler->code) {
+        dipsh_instruction *instr = &compiler->code->code[compiler->code_len];
+        instr->opcode = opcode;
+        instr->is_tail = is_tail;
+        instr->arg = arg;
+    }
+    return compiler->code_len++;
+}
+
+/* the jumps to the same place are chained through their args, the last one
+ * first, till the place is known */
+static void
+dipshp_patch_jumps(
+    dipshp_compiler *compiler,
+    int last_jump
+)
+{
+    if (!compiler->code)
+        return;
+    while (-1 != last_jump) {
+        dipsh_instruction *instr = &compiler->code->code[last_jump];
+        last_jump = instr->arg;
+        instr->arg = compiler->code_len;
+    }
+}
+
+static int
+dipshp_add_command(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node
+)
+{
+    if (compiler->code) {
+        compiler->code->commands[compiler->commands_len] =
+            dipsh_command_init(compiler->ast, node, NULL);
+    }
+    return compiler->commands_len++;
+}
+
+static int
+dipshp_add_pipeline(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node
+)
+{
+    if (compiler->code) {
+        compiler->code->pipelines[compiler->pipelines_len] =
+            dipsh_pipeline_init(compiler->ast, node);
+    }
+    return compiler->pipelines_len++;
+}
+
+static int
+dipshp_compile_node(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node,
+    int is_tail
+);
+
+/* plain commands and pipelines of external commands need no subshell: their
+ * processes are started right away in a group of their own */
+static int
+dipshp_compile_bg(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node
+)
+{
+    int is_simple =
+        dipsh_symbol_command == node->type || dipsh_symbol_pipe == node->type;
+    if (is_simple) {
+        int idx = dipshp_add_pipeline(compiler, node);
+        if (!compiler->code) {
+            /* there is room made for both ways while counting */
+            dipshp_emit(compiler, dipsh_op_bg, idx, 0);
+        } else {
+            dipsh_pipeline **pipeline = &compiler->code->pipelines[idx];
+            /* builtins would run in the shell itself */
+            if (!*pipeline || !dipsh_pipeline_has_builtins(*pipeline)) {
+                dipshp_emit(compiler, dipsh_op_bg, idx, 0);
+                return 0;
+            }
+            dipsh_pipeline_destroy(*pipeline);
+            *pipeline = NULL;
+        }
+    }
+    int subshell = dipshp_emit(compiler, dipsh_op_bg_subshell, -1, 0);
+    int ret = dipshp_compile_node(compiler, node, 1);
+    dipshp_emit(compiler, dipsh_op_end, 0, 0);
+    dipshp_patch_jumps(compiler, subshell);
+    return ret;
+}
+
+static int
+dipshp_compile_list(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node,
+    int is_tail
+)
+{
+    const dipsh_ast_node *children = compiler->ast->nodes + node->first_child;
+    int ret = 0;
+    for (int i = 0; 0 == ret && i < node->children_len; ++i) {
+        ret = dipshp_compile_node(
+            compiler, &children[i], is_tail && node->children_len - 1 == i
+        );
+    }
+    return ret;
+}
+
+/* the children are commands with operators between them (and maybe past
+ * the last one) */
+static int
+dipshp_compile_seq_bg_start(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node,
+    int is_tail
+)
+{
+    const dipsh_ast_node *children = compiler->ast->nodes + node->first_child;
+    int ret = 0;
+    for (int i = 0; 0 == ret && i < node->children_len; i += 2) {
+        const dipsh_ast_node *command = &children[i];
+        const dipsh_ast_node *op =
+            i + 1 < node->children_len ? &children[i + 1] : NULL;
+        if (op && dipsh_symbol_bg == op->type) {
+            ret = dipshp_compile_bg(compiler, command);
+        } else {
+            int is_last = i + 2 >= node->children_len;
+            ret = dipshp_compile_node(
+                compiler, command, is_tail && is_last
+            );
+        }
+    }
+    return ret;
+}
+
+/* once an operator doesn't let the next command run, none of the rest runs */
+static int
+dipshp_compile_and_or(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node,
+    int is_tail
+)
+{
+    const dipsh_ast_node *children = compiler->ast->nodes + node->first_child;
+    int ret = 0;
+    int last_jump = -1;
+    for (int i = 0; 0 == ret && i < node->children_len; i += 2) {
+        const dipsh_ast_node *command = &children[i];
+        const dipsh_ast_node *op =
+            i + 1 < node->children_len ? &children[i + 1] : NULL;
+        ret = dipshp_compile_node(compiler, command, is_tail && !op);
+        if (!op) {
+            dipshp_emit(compiler, dipsh_op_check, 0, 0);
+        } else {
+            dipsh_opcode jump = dipsh_symbol_and == op->type
+                ? dipsh_op_jump_if_fail
+                : dipsh_op_jump_if_ok;
+            last_jump = dipshp_emit(compiler, jump, last_jump, 0);
+        }
+    }
+    dipshp_patch_jumps(compiler, last_jump);
+    return ret;
+}
+
+static int
+dipshp_compile_node(
+    dipshp_compiler *compiler,
+    const dipsh_ast_node *node,
+    int is_tail
+)
+{
+    switch (node->type) {
+    case dipsh_symbol_script:
+        return dipshp_compile_list(compiler, node, is_tail);
+    case dipsh_symbol_seq_bg_start:
+        return dipshp_compile_seq_bg_start(compiler, node, is_tail);
+    case dipsh_symbol_and_or:
+        return dipshp_compile_and_or(compiler, node, is_tail);
+    case dipsh_symbol_pipe:
+        dipshp_emit(
+            compiler, dipsh_op_pipeline,
+            dipshp_add_pipeline(compiler, node), 0
+        );
+        return 0;
+    case dipsh_symbol_command:
+        dipshp_emit(
+            compiler, dipsh_op_spawn,
+            dipshp_add_command(compiler, node), is_tail
+        );
+        return 0;
+    default: /* shouldn't happen */
+        return 1;
+    }
+}
+
+dipsh_bytecode *
+dipsh_bytecode_compile(
+    const dipsh_ast *ast,
+    const dipsh_ast_node *node
+)
+{
+    dipshp_compiler compiler = { ast, NULL, 0, 0, 0 };
+    int ret = dipshp_compile_node(&compiler, node, 1);
+    if (0 != ret)
+        return NULL;
+    dipshp_emit(&compiler, dipsh_op_end, 0, 0);
+
+    dipsh_bytecode *result = calloc(
+        sizeof(dipsh_bytecode) +
+            sizeof(dipsh_command *) * compiler.commands_len +
+            sizeof(dipsh_pipeline *) * compiler.pipelines_len +
+            sizeof(dipsh_instruction) * compiler.code_len,
+        1
+    );
+    if (!result)
+        return NULL;
+    result->commands = (dipsh_command **)(result + 1);
+    result->pipelines =
+        (dipsh_pipeline **)(result->commands + compiler.commands_len);
+    result->code =
+        (dipsh_instruction *)(result->pipelines + compiler.pipelines_len);
+
+    compiler.code = result;
+    compiler.code_len = 0;
+    compiler.commands_len = 0;
+    compiler.pipelines_len = 0;
+    dipshp_compile_node(&compiler, node, 1);
+    dipshp_emit(&compiler, dipsh_op_end, 0, 0);
+    result->code_len = compiler.code_len;
+    result->commands_len = compiler.commands_len;
+    result->pipelines_len = compiler.pipelines_len;
+    return result;
+}
+
+long
+dipsh_bytecode_get_size(
+    const dipsh_bytecode *code
+)
+{
+    long size = sizeof(dipsh_bytecode) +
+        sizeof(dipsh_command *) * code->commands_len +
+        sizeof(dipsh_pipeline *) * code->pipelines_len +
+        sizeof(dipsh_instruction) * code->code_len;
+    for (int i = 0; i < code->commands_len; ++i) {
+        if (code->commands[i])
+            size += dipsh_command_get_size(code->commands[i]);
+    }
+    for (int i = 0; i < code->pipelines_len; ++i) {
+        if (code->pipelines[i])
+            size += dipsh_pipeline_get_size(code->pipelines[i]);
+    }
+    return size;
+}
+
+void
+dipsh_bytecode_destroy(
+    dipsh_bytecode *code
+)
+{
+    if (!code)
+        return;
+    for (int i = 0; i < code->commands_len; ++i)
+        dipsh_command_destroy(code->commands[i]);
+    for (int i = 0; i < code->pipelines_len; ++i)
+        dipsh_pipeline_destroy(code->pipelines[i]);
+    free(code);
+}
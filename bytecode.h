@@ -0,0 +1,67 @@
+#ifndef _DIPSH_BYTECODE_H_
+#define _DIPSH_BYTECODE_H_
+
+#include "parser.h"
+#include "command.h"
+#include "pipeline.h"
+
+/* an AST lowered to a flat stream of instructions; the commands and the
+ * pipelines it runs are made once, when it's compiled, so that it can be run
+ * over and over again without going back to the AST (see execute.h) */
+
+typedef enum dipsh_opcode_tag
+{
+    dipsh_op_spawn,         /* runs commands[arg] and waits for it */
+    dipsh_op_pipeline,      /* runs pipelines[arg] and waits for it */
+    dipsh_op_bg,            /* starts pipelines[arg] in the background */
+    dipsh_op_bg_subshell,   /* starts the code after it, up to its end, in
+                             * a subshell in the background, then goes on
+                             * at arg */
+    dipsh_op_jump_if_fail,  /* goes on at arg if the last command has failed */
+    dipsh_op_jump_if_ok,    /* the same if it has succeeded */
+    dipsh_op_check,         /* stops if the last command hasn't exited */
+    dipsh_op_end
+}
+dipsh_opcode;
+
+typedef struct dipsh_instruction_tag
+{
+    unsigned char opcode;
+    unsigned char is_tail;  /* nothing is going to run after it */
+    int arg;
+}
+dipsh_instruction;
+
+typedef struct dipsh_bytecode_tag
+{
+    dipsh_instruction *code;
+    int code_len;
+    /* NULL for those that couldn't be made, which fail as they run */
+    dipsh_command **commands;
+    int commands_len;
+    dipsh_pipeline **pipelines;
+    int pipelines_len;
+}
+dipsh_bytecode;
+
+/* compiles the subtree of ast at node; the words are referenced, so ast may
+ * go away then. Returns NULL if there is no memory */
+dipsh_bytecode *
+dipsh_bytecode_compile(
+    const dipsh_ast *ast,
+    const dipsh_ast_node *node
+);
+
+/* the memory the code, its commands and its pipelines hold (see
+ * dipsh_command_get_size) */
+long
+dipsh_bytecode_get_size(
+    const dipsh_bytecode *code
+);
+
+void
+dipsh_bytecode_destroy(
+    dipsh_bytecode *code
+);
+
+#endif /* _DIPSH_BYTECODE_H_ */
@@ -1,5 +1,6 @@
 #include "change_group.h"
 #include <unistd.h>
+#include <fcntl.h>
 
 int
 dipsh_change_current_group(
@@ -15,3 +16,50 @@ dipsh_change_current_group(
     int ret = tcsetpgrp(0, new_group_id);
     return -1 == ret; 
 }
+
+void
+dipsh_release_barrier_reset(
+    dipsh_release_barrier *barrier
+)
+{
+    barrier->fds[0] = -1;
+    barrier->fds[1] = -1;
+}
+
+int
+dipsh_release_barrier_init(
+    dipsh_release_barrier *barrier
+)
+{
+    int ret = pipe2(barrier->fds, O_CLOEXEC);
+    if (-1 == ret) {
+        dipsh_release_barrier_reset(barrier);
+        return 1;
+    }
+    return 0;
+}
+
+int
+dipsh_release_barrier_wait(
+    dipsh_release_barrier *barrier
+)
+{
+    /* the child's own copy of the write end would keep the pipe open */
+    close(barrier->fds[1]);
+    char dummy;
+    int ret = read(barrier->fds[0], &dummy, 1);
+    close(barrier->fds[0]);
+    return -1 == ret;
+}
+
+void
+dipsh_release_barrier_release(
+    dipsh_release_barrier *barrier
+)
+{
+    if (-1 != barrier->fds[1])
+        close(barrier->fds[1]);
+    if (-1 != barrier->fds[0])
+        close(barrier->fds[0]);
+    dipsh_release_barrier_reset(barrier);
+}
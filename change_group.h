@@ -7,4 +7,34 @@ dipsh_change_current_group(
     int *old_group_id
 );
 
+/* a release barrier is a single pipe shared by every process of a job: 
+ * children block reading it until the shell closes the write end, so one 
+ * close releases the whole job at once */
+
+typedef struct dipsh_release_barrier_tag
+{
+    int fds[2];
+}
+dipsh_release_barrier;
+
+void
+dipsh_release_barrier_reset(
+    dipsh_release_barrier *barrier
+);
+
+int
+dipsh_release_barrier_init(
+    dipsh_release_barrier *barrier
+);
+
+int
+dipsh_release_barrier_wait(
+    dipsh_release_barrier *barrier
+);
+
+void
+dipsh_release_barrier_release(
+    dipsh_release_barrier *barrier
+);
+
 #endif /* _DIPSH_CHANGE_GROUP_H_ */
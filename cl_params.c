@@ -8,6 +8,9 @@ dipshp_print_usage(
 )
 {
     warnx("usage: %s [--parse-info] [SCRIPT]", command_name);
+    warnx("       %s --compile SCRIPT", command_name);
+    warnx("       %s --threaded SCRIPT", command_name);
+    warnx("       %s --cache-info", command_name);
 }
 
 dipsh_cl_params *
@@ -20,6 +23,28 @@ dipsh_read_cl_params(
 
     int should_show_parsing_info = 
         argc >= 2 && 0 == strcmp("--parse-info", argv[1]);
+    params.compile_only = argc >= 2 && 0 == strcmp("--compile", argv[1]);
+    params.threaded = argc >= 2 && 0 == strcmp("--threaded", argv[1]);
+    params.show_cache_info = argc >= 2 && 0 == strcmp("--cache-info", argv[1]);
+    /* the statement cache is the interactive shell's */
+    if (params.show_cache_info) {
+        if (2 != argc) {
+            dipshp_print_usage(argv[0]);
+            return NULL;
+        }
+        params.show_parsing_info = 0;
+        params.script_file = NULL;
+        return &params;
+    }
+    if (params.compile_only || params.threaded) {
+        if (3 != argc) {
+            dipshp_print_usage(argv[0]);
+            return NULL;
+        }
+        params.show_parsing_info = 0;
+        params.script_file = argv[2];
+        return &params;
+    }
 
     switch (argc) {
     case 1: 
@@ -4,6 +4,9 @@
 typedef struct dipsh_cl_params_tag 
 {
     int show_parsing_info;
+    int compile_only;       /* only make the cache of the script */
+    int threaded;           /* lex and parse the script in threads */
+    int show_cache_info;    /* the statement cache's counters at the end */
     char *script_file;
 }
 dipsh_cl_params;
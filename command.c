@@ -1,5 +1,7 @@
 #include "command.h"
 #include "handler.h"
+#include "intern.h"
+#include "event_loop.h"
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -9,19 +11,17 @@
 
 struct dipsh_command_tag
 {
-    char **argv;
     int argv_len;
-    int argv_cap;
     
     int pid_set;
     int pid;
     int no_system_error;
 
-    int suspend_pipe_fds[2];
-    int group_signal_pipe_fds[2];
+    dipsh_release_barrier *release_barrier;
 
     dipsh_redirect_list *redir_list;
     dipsh_command_traits traits;
+    struct dipsh_shell_state_tag *shell_state;
 
     int wait_performed;
     int wait_failed;
@@ -29,24 +29,12 @@ struct dipsh_command_tag
    
     int is_builtin; 
     dipsh_command_handler handler;
-};
 
-static void
-dipshp_append_word_to_argv(
-    dipsh_command *command,
-    const char *word
-)
-{
-    if (command->argv_len + 1 > command->argv_cap) {
-        char **old_argv = command->argv;
-        command->argv_cap *= 2;
-        command->argv = calloc(sizeof(char *), command->argv_cap);
-        memcpy(command->argv, old_argv, sizeof(char *) * command->argv_len);
-        free(old_argv);
-    }
-    command->argv[command->argv_len - 1] = strdup(word);
-    ++command->argv_len;
-}
+    /* the words are references to the interned ones of the AST, so the 
+     * commands of a loop share them; allocated along with the command, NULL 
+     * terminated */
+    char *argv[];
+};
 
 static void
 dipshp_clear_argv(
@@ -54,8 +42,7 @@ dipshp_clear_argv(
 )
 {
     for (int i = 0; i < command->argv_len; ++i)
-        free(command->argv[i]);
-    free(command->argv);
+        dipsh_intern_release(command->argv[i]);
 }
 
 static int
@@ -78,7 +65,7 @@ dipshp_insert_file_redir(
     (*curr)->redir.fd = fd;
     (*curr)->redir.type = type;
     (*curr)->redir.need_open_file = 1;
-    (*curr)->redir.file_name = strdup(file_name);
+    (*curr)->redir.file_name = dipsh_intern_ref(file_name);
     return dipsh_redir_set_ok;
 }
 
@@ -121,8 +108,8 @@ dipshp_clear_file_redirs(
     while (redir_list) {
         dipsh_redirect_list *temp = redir_list;
         redir_list = redir_list->next;
-        if (temp->redir.need_open_file)
-            free(temp->redir.file_name);
+        if (temp->redir.need_open_file && temp->redir.file_name)
+            dipsh_intern_release(temp->redir.file_name);
         free(temp);
     }
 }
@@ -169,23 +156,20 @@ dipshp_redir_to_type_fd(
 static int
 dipshp_add_redir(
     dipsh_command *command,
-    const dipsh_symbol *redir_child
+    const dipsh_ast *ast,
+    const dipsh_ast_node *redir_node
 )
 {
-    const dipsh_nonterminal *redir_symb = 
-        (const dipsh_nonterminal *)redir_child;
-    const dipsh_terminal *redir_type = 
-        (const dipsh_terminal *)redir_symb->children_list->child;
-    const dipsh_terminal *redir_file =
-        (const dipsh_terminal *)redir_symb->children_list->next->child;
+    const dipsh_ast_node *redir_type = ast->nodes + redir_node->first_child;
+    const dipsh_ast_node *redir_file = redir_type + 1;
     dipsh_redir_type type;
     int fd;
     int ret = dipshp_redir_to_type_fd(
-        redir_type->token.value, &type, &fd
+        ast->words[redir_type->word], &type, &fd
     );
     if (0 == ret) {
         ret = dipshp_insert_file_redir(
-            &command->redir_list, type, fd, redir_file->token.value
+            &command->redir_list, type, fd, ast->words[redir_file->word]
         );
     }
     return ret;
@@ -198,63 +182,51 @@ dipshp_set_default_trait_values(
 {
     traits->suspend_after_fork = 0;
     traits->run_in_separate_group = 1;
-    traits->will_wait_for_group_change = 0;
+    traits->process_group = 0;
     traits->execute_blocks = 1;
+    traits->fork_builtins = 0;
 }
 
 dipsh_command *
 dipsh_command_init(
-    const dipsh_symbol *command_tree,
+    const dipsh_ast *ast,
+    const dipsh_ast_node *command_node,
     const dipsh_command_traits *traits
 )
 {
-    if (dipsh_symbol_command != command_tree->type)
+    if (dipsh_symbol_command != command_node->type)
+        return NULL;
+
+    /* no more words than children, and the NULL after them */
+    dipsh_command *result = calloc(
+        sizeof(dipsh_command) + 
+            sizeof(char *) * (command_node->children_len + 1), 
+        1
+    );
+    if (!result)
         return NULL;
 
-    dipsh_command *result = calloc(sizeof(dipsh_command), 1);
-    result->argv = calloc(sizeof(char*), 1);
-    result->argv_len = 1;
-    result->argv_cap = 1;
-
-    const dipsh_nonterminal_child *children = 
-        ((dipsh_nonterminal *)command_tree)->children_list;
-    while (children) {
-        if (dipsh_symbol_word == children->child->type) {
-            dipshp_append_word_to_argv(
-                result, ((dipsh_terminal *)children->child)->token.value
-            );
-        } else if (dipsh_symbol_redir == children->child->type) {
-            int not_ok = dipshp_add_redir(result, children->child);
+    const dipsh_ast_node *child = ast->nodes + command_node->first_child;
+    const dipsh_ast_node *end = child + command_node->children_len;
+    for (; child != end; ++child) {
+        if (dipsh_symbol_word == child->type) {
+            result->argv[result->argv_len++] = 
+                (char *)dipsh_intern_ref(ast->words[child->word]);
+        } else if (dipsh_symbol_redir == child->type) {
+            int not_ok = dipshp_add_redir(result, ast, child);
             if (not_ok) 
                 goto fail;
         }
-        children = children->next;
     }
     
-    result->handler = dipsh_get_handler_by_name(result->argv[0]);
-    result->is_builtin = dipsh_has_builtin_handler(result->argv[0]);
+    result->handler = 
+        dipsh_get_handler_by_name(result->argv[0], &result->is_builtin);
     
     if (traits)
         memcpy(&result->traits, traits, sizeof(dipsh_command_traits));
     else
         dipshp_set_default_trait_values(&result->traits);
 
-    result->suspend_pipe_fds[0] = -1;
-    result->suspend_pipe_fds[1] = -1;
-    if (result->traits.suspend_after_fork) {
-        int not_ok = pipe2(result->suspend_pipe_fds, O_CLOEXEC);
-        if (-1 == not_ok)
-            goto fail;
-    }
-    result->group_signal_pipe_fds[0] = -1;
-    result->group_signal_pipe_fds[1] = -1;
-    if (result->traits.run_in_separate_group && 
-        result->traits.will_wait_for_group_change) {
-        int not_ok = pipe2(result->group_signal_pipe_fds, O_CLOEXEC);
-        if (-1 == not_ok)
-            goto fail;
-    }
-
     return result;
 
 fail:
@@ -276,6 +248,54 @@ dipsh_command_destroy(
     free(command);
 }
 
+/* the ones of the command line are the only ones with files to open */
+static void
+dipshp_clear_fd_redirs(
+    dipsh_redirect_list **redir_list
+)
+{
+    while (*redir_list) {
+        dipsh_redirect_list *temp = *redir_list;
+        if (temp->redir.need_open_file) {
+            redir_list = &temp->next;
+            continue;
+        }
+        *redir_list = temp->next;
+        free(temp);
+    }
+}
+
+long
+dipsh_command_get_size(
+    const dipsh_command *command
+)
+{
+    long size =
+        sizeof(dipsh_command) + sizeof(char *) * (command->argv_len + 1);
+    for (int i = 0; i < command->argv_len; ++i)
+        size += dipsh_intern_length(command->argv[i]) + 1;
+    const dipsh_redirect_list *redir = command->redir_list;
+    for (; redir; redir = redir->next)
+        size += sizeof(dipsh_redirect_list);
+    return size;
+}
+
+void
+dipsh_command_rewind(
+    dipsh_command *command
+)
+{
+    if (!command->traits.execute_blocks)
+        dipsh_wait_for_command(command);
+    dipshp_clear_fd_redirs(&command->redir_list);
+    command->pid_set = 0;
+    command->pid = 0;
+    command->release_barrier = NULL;
+    command->wait_performed = 0;
+    command->wait_failed = 0;
+    memset(&command->status, 0, sizeof(dipsh_command_status));
+}
+
 int
 dipsh_command_set_fd_redirect(
     dipsh_command *command,
@@ -306,10 +326,11 @@ dipsh_command_get_redirect(
     int command_fd
 )
 {
-    dipsh_redirect_list *pos = command->redir_list;
-    while (pos) {
-        if (pos->redir.fd == command_fd)
-            return (dipsh_redirect *)pos;
+    const dipsh_redirect_list *pos = command->redir_list;
+    for (; pos; pos = pos->next) {
+        /* fds to close are not about command_fd, whatever their fd is */
+        if (pos->redir.fd == command_fd && dipsh_redir_close != pos->redir.type)
+            return &pos->redir;
     }
     return NULL;
 }
@@ -322,12 +343,53 @@ dipsh_command_get_all_redirects(
     return command->redir_list;
 }
 
+void
+dipsh_command_clear_redirects(
+    dipsh_command *command
+)
+{
+    dipshp_clear_file_redirs(command->redir_list);
+    command->redir_list = NULL;
+}
+
+int
+dipsh_redirect_get_open_flags(
+    const dipsh_redirect *redir
+)
+{
+    if (!redir->need_open_file)
+        return -1;
+
+    switch (redir->type) {
+    case dipsh_redir_in:  
+        return O_RDONLY; 
+    case dipsh_redir_out: 
+        return O_WRONLY | O_CREAT | O_TRUNC; 
+    case dipsh_redir_app:
+        return O_WRONLY | O_CREAT | O_APPEND;
+    default:
+        return -1;
+    }
+}
+
+int
+dipsh_redirect_open_file(
+    const dipsh_redirect *redir
+)
+{
+    errno = 0;
+    int open_flags = dipsh_redirect_get_open_flags(redir);
+    if (-1 == open_flags)
+        return -1;
+    return open(redir->file_name, open_flags, 0666);
+}
+
 int
 dipsh_command_get_argc(
     const dipsh_command *command
 )
 {
-    return command->argv_len - 1;
+    return command->argv_len;
 }
 
 char **
@@ -367,55 +429,75 @@ dipsh_command_set_pid(
     command->pid = pid;
 }
 
-int
-dipsh_command_get_suspend_wait_fd(
-    const dipsh_command *command
+void
+dipsh_command_detach(
+    dipsh_command *command
 )
 {
-    return command->suspend_pipe_fds[0]; 
+    if (!command->pid_set)
+        return;
+    command->wait_performed = 1;
+    command->wait_failed = 1;
 }
 
-int
-dipsh_command_is_builtin(
-    const dipsh_command *command
+void
+dipsh_command_set_traits(
+    dipsh_command *command,
+    const dipsh_command_traits *traits
 )
 {
-    return command->is_builtin;
+    memcpy(&command->traits, traits, sizeof(dipsh_command_traits));
 }
 
-int
-dipsh_command_start_suspended(
-    dipsh_command *command
+void
+dipsh_command_set_process_group(
+    dipsh_command *command,
+    int process_group
 )
 {
-    if (!command->traits.suspend_after_fork)
-        return 1;
+    command->traits.process_group = process_group;
+}
 
-    int ret = write(command->suspend_pipe_fds[1], "", 1);
-    close(command->suspend_pipe_fds[0]);
-    close(command->suspend_pipe_fds[1]);
-    return 1 == ret ? 0 : 1;
+void
+dipsh_command_set_release_barrier(
+    dipsh_command *command,
+    dipsh_release_barrier *barrier
+)
+{
+    command->release_barrier = barrier;
 }
 
-int
-dipsh_command_signal_group_change(
-    dipsh_command *command
+dipsh_release_barrier *
+dipsh_command_get_release_barrier(
+    const dipsh_command *command
 )
 {
-    int ret = write(command->group_signal_pipe_fds[1], "", 1);
-    return 1 == ret ? 0 : 1;
+    return command->release_barrier;
+}
+
+void
+dipsh_command_set_shell_state(
+    dipsh_command *command,
+    struct dipsh_shell_state_tag *shell_state
+)
+{
+    command->shell_state = shell_state;
+}
+
+struct dipsh_shell_state_tag *
+dipsh_command_get_shell_state(
+    const dipsh_command *command
+)
+{
+    return command->shell_state;
 }
 
 int
-dipsh_command_wait_for_group_change(
-    dipsh_command *command
+dipsh_command_is_builtin(
+    const dipsh_command *command
 )
 {
-    char dummy;
-    int ret = read(command->group_signal_pipe_fds[0], &dummy, 1);
-    close(command->group_signal_pipe_fds[0]);
-    close(command->group_signal_pipe_fds[1]);
-    return 1 == ret ? 0 : 1;
+    return command->is_builtin;
 }
 
 void
@@ -440,6 +522,17 @@ dipsh_wait_status_to_command_status(
     }
 }
 
+void
+dipsh_command_set_status(
+    dipsh_command *command,
+    const dipsh_command_status *status
+)
+{
+    command->wait_performed = 1;
+    command->wait_failed = 0;
+    memcpy(&command->status, status, sizeof(dipsh_command_status));
+}
+
 const dipsh_command_status *
 dipsh_wait_for_command(
     dipsh_command *command
@@ -449,9 +542,11 @@ dipsh_wait_for_command(
         return command->wait_failed ? NULL : &command->status;
 
     command->wait_performed = 1;
-    if (!command->is_builtin) {
+    /* builtins run in the shell have no process to wait for */
+    if (command->pid_set) {
         int wait_status;
-        int wait_ret = waitpid(command->pid, &wait_status, 0);
+        int wait_ret = 
+            dipsh_event_loop_wait_for_child(command->pid, &wait_status);
         if (-1 == wait_ret) {
             command->wait_failed = 1;
             return NULL;
@@ -466,5 +561,7 @@ dipsh_command_execute(
     dipsh_command *command
 )
 {
+    if (command->is_builtin && command->traits.fork_builtins)
+        return dipsh_fork_builtin(command);
     return command->handler(command, &command->status);
 }
@@ -2,6 +2,7 @@
 #define _DIPSH_COMMAND_H_
 
 #include "parser.h"
+#include "change_group.h"
 
 typedef enum dipsh_redir_type_tag
 {
@@ -21,7 +22,7 @@ typedef struct dipsh_redirect_tag
     union
     {
         int inherited_fd;
-        char *file_name;
+        const char *file_name;  /* interned */
     };
 }
 dipsh_redirect;
@@ -35,18 +36,22 @@ dipsh_redirect_list;
 
 typedef struct dipsh_command_traits_tag
 {
-    int suspend_after_fork;
+    int suspend_after_fork;     /* wait on the release barrier before exec */
     int run_in_separate_group;
-    int will_wait_for_group_change;
+    int process_group;          /* group to join, 0 means a new group */
     int execute_blocks;
+    int fork_builtins;          /* run builtins in a child of their own */
 }
 dipsh_command_traits;
 
 typedef struct dipsh_command_tag dipsh_command;
 
+struct dipsh_shell_state_tag;
+
 dipsh_command *
 dipsh_command_init(
-    const dipsh_symbol *command_tree,
+    const dipsh_ast *ast,
+    const dipsh_ast_node *command_node,
     const dipsh_command_traits *traits
 );
 
@@ -55,6 +60,21 @@ dipsh_command_destroy(
     dipsh_command *command
 );
 
+/* the memory the command holds, its words counted as if they were its own
+ * (they are shared with whatever else refers to them) */
+long
+dipsh_command_get_size(
+    const dipsh_command *command
+);
+
+/* makes the command ready to run once again, as it was right after init: 
+ * the process it has run is forgotten (waited for first, if nobody has 
+ * done it), and so are the redirections set since init */
+void
+dipsh_command_rewind(
+    dipsh_command *command
+);
+
 enum
 {
     dipsh_redir_set_ok,
@@ -87,6 +107,24 @@ dipsh_command_get_all_redirects(
     const dipsh_command *command
 );
 
+/* forgets the redirections, e.g. once they have been applied for real */
+void
+dipsh_command_clear_redirects(
+    dipsh_command *command
+);
+
+int
+dipsh_redirect_get_open_flags(
+    const dipsh_redirect *redir
+);
+
+/* opens the file of a file redirection; returns the fd, or -1 (with errno 
+ * zeroed if the redirection has no file to open) */
+int
+dipsh_redirect_open_file(
+    const dipsh_redirect *redir
+);
+
 int
 dipsh_command_get_argc(
     const dipsh_command *command
@@ -102,6 +140,12 @@ dipsh_command_get_traits(
     const dipsh_command *command
 );
 
+void
+dipsh_command_set_traits(
+    dipsh_command *command,
+    const dipsh_command_traits *traits
+);
+
 int
 dipsh_command_get_pid(
     const dipsh_command *command
@@ -113,29 +157,44 @@ dipsh_command_set_pid(
     int pid
 );
 
-int
-dipsh_command_get_suspend_wait_fd(
-    const dipsh_command *command
+/* hands the started process over to somebody else to wait for, so that
+ * neither dipsh_wait_for_command nor destroying the command waits for it */
+void
+dipsh_command_detach(
+    dipsh_command *command
 );
 
-int
-dipsh_command_is_builtin(
+void
+dipsh_command_set_process_group(
+    dipsh_command *command,
+    int process_group
+);
+
+void
+dipsh_command_set_release_barrier(
+    dipsh_command *command,
+    dipsh_release_barrier *barrier
+);
+
+dipsh_release_barrier *
+dipsh_command_get_release_barrier(
     const dipsh_command *command
 );
 
-int
-dipsh_command_start_suspended(
-    dipsh_command *command
+void
+dipsh_command_set_shell_state(
+    dipsh_command *command,
+    struct dipsh_shell_state_tag *shell_state
 );
 
-int
-dipsh_command_signal_group_change(
-    dipsh_command *command
+struct dipsh_shell_state_tag *
+dipsh_command_get_shell_state(
+    const dipsh_command *command
 );
 
 int
-dipsh_command_wait_for_group_change(
-    dipsh_command *command
+dipsh_command_is_builtin(
+    const dipsh_command *command
 );
 
 typedef struct dipsh_command_status_tag
@@ -157,6 +216,12 @@ dipsh_wait_status_to_command_status(
     dipsh_command_status *command_status
 );
 
+void
+dipsh_command_set_status(
+    dipsh_command *command,
+    const dipsh_command_status *status
+);
+
 const dipsh_command_status *
 dipsh_wait_for_command(
     dipsh_command *command
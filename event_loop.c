@@ -0,0 +1,360 @@
+#include "event_loop.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/pidfd.h>
+
+#define DIPSHP_MAX_EVENTS 16
+
+typedef struct dipshp_reaped_child_tag
+{
+    int pid;
+    int wait_status;
+}
+dipshp_reaped_child;
+
+static struct
+{
+    int active;
+    int epoll_fd;
+    int signal_fd;
+    int watched_fd;
+    /* epoll doesn't take regular files, which are always ready anyway */
+    int is_watched_fd_always_ready;
+    sigset_t child_mask;
+
+    dipsh_child_reaped_cb reaped_cb;
+    void *reaped_ctx;
+
+    /* children reaped before anybody asked for them */
+    dipshp_reaped_child *unclaimed;
+    int unclaimed_len;
+    int unclaimed_cap;
+}
+dipshp_loop = {
+    .epoll_fd = -1,
+    .signal_fd = -1,
+    .watched_fd = -1
+};
+
+static int
+dipshp_add_to_epoll(
+    int fd
+)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+    return epoll_ctl(dipshp_loop.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void
+dipshp_close_loop_fds()
+{
+    if (-1 != dipshp_loop.epoll_fd)
+        close(dipshp_loop.epoll_fd);
+    if (-1 != dipshp_loop.signal_fd)
+        close(dipshp_loop.signal_fd);
+    dipshp_loop.epoll_fd = -1;
+    dipshp_loop.signal_fd = -1;
+    dipshp_loop.watched_fd = -1;
+    dipshp_loop.is_watched_fd_always_ready = 0;
+}
+
+int
+dipsh_event_loop_init()
+{
+    if (dipshp_loop.active)
+        return 0;
+
+    sigset_t chld_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    int ret = sigprocmask(SIG_BLOCK, &chld_mask, &dipshp_loop.child_mask);
+    if (-1 == ret)
+        return 1;
+    dipshp_loop.signal_fd = 
+        signalfd(-1, &chld_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (-1 == dipshp_loop.signal_fd)
+        goto fail;
+    dipshp_loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == dipshp_loop.epoll_fd)
+        goto fail;
+    ret = dipshp_add_to_epoll(dipshp_loop.signal_fd);
+    if (-1 == ret)
+        goto fail;
+    dipshp_loop.active = 1;
+    return 0;
+
+fail:
+    dipshp_close_loop_fds();
+    sigprocmask(SIG_SETMASK, &dipshp_loop.child_mask, NULL);
+    return 1;
+}
+
+void
+dipsh_event_loop_reset_after_fork()
+{
+    if (!dipshp_loop.active)
+        return;
+    dipshp_close_loop_fds();
+    sigprocmask(SIG_SETMASK, &dipshp_loop.child_mask, NULL);
+    free(dipshp_loop.unclaimed);
+    dipshp_loop.unclaimed = NULL;
+    dipshp_loop.unclaimed_len = 0;
+    dipshp_loop.unclaimed_cap = 0;
+    dipshp_loop.reaped_cb = NULL;
+    dipshp_loop.reaped_ctx = NULL;
+    dipshp_loop.active = 0;
+}
+
+int
+dipsh_event_loop_get_child_sigmask(
+    sigset_t *mask
+)
+{
+    if (!dipshp_loop.active)
+        return 1;
+    *mask = dipshp_loop.child_mask;
+    return 0;
+}
+
+void
+dipsh_event_loop_set_reaped_cb(
+    dipsh_child_reaped_cb cb,
+    void *ctx
+)
+{
+    dipshp_loop.reaped_cb = cb;
+    dipshp_loop.reaped_ctx = ctx;
+}
+
+static void
+dipshp_store_unclaimed(
+    int pid,
+    int wait_status
+)
+{
+    if (dipshp_loop.unclaimed_len == dipshp_loop.unclaimed_cap) {
+        int new_cap = dipshp_loop.unclaimed_cap
+            ? 2 * dipshp_loop.unclaimed_cap
+            : 8;
+        dipshp_reaped_child *new_unclaimed = realloc(
+            dipshp_loop.unclaimed, new_cap * sizeof(dipshp_reaped_child)
+        );
+        if (!new_unclaimed)
+            return;
+        dipshp_loop.unclaimed = new_unclaimed;
+        dipshp_loop.unclaimed_cap = new_cap;
+    }
+    dipshp_reaped_child *child =
+        &dipshp_loop.unclaimed[dipshp_loop.unclaimed_len++];
+    child->pid = pid;
+    child->wait_status = wait_status;
+}
+
+static int
+dipshp_take_unclaimed(
+    int pid,
+    int *wait_status
+)
+{
+    for (int i = 0; i < dipshp_loop.unclaimed_len; ++i) {
+        if (dipshp_loop.unclaimed[i].pid != pid)
+            continue;
+        *wait_status = dipshp_loop.unclaimed[i].wait_status;
+        dipshp_loop.unclaimed[i] =
+            dipshp_loop.unclaimed[--dipshp_loop.unclaimed_len];
+        return 1;
+    }
+    return 0;
+}
+
+static void
+dipshp_dispatch_reaped(
+    int pid,
+    int wait_status
+)
+{
+    int claimed = dipshp_loop.reaped_cb
+        ? dipshp_loop.reaped_cb(pid, wait_status, dipshp_loop.reaped_ctx)
+        : 0;
+    if (!claimed)
+        dipshp_store_unclaimed(pid, wait_status);
+}
+
+/* returns the number of reaped children, or -1 if there are no children */
+static int
+dipshp_reap_children()
+{
+    int reaped = 0;
+    for (;;) {
+        int wait_status;
+        int pid = waitpid(-1, &wait_status, WNOHANG);
+        if (0 < pid) {
+            dipshp_dispatch_reaped(pid, wait_status);
+            ++reaped;
+        } else if (-1 == pid && EINTR == errno) {
+            continue;
+        } else {
+            return -1 == pid && ECHILD == errno && 0 == reaped ? -1 : reaped;
+        }
+    }
+}
+
+static void
+dipshp_drain_signal_fd()
+{
+    struct signalfd_siginfo info;
+    while (sizeof(info) == read(dipshp_loop.signal_fd, &info, sizeof(info)))
+        ;
+}
+
+/* waits for the next batch of events, returns 1 if fd_to_watch is ready, 0
+ * if it isn't, or -1 on failure */
+static int
+dipshp_poll_events(
+    int fd_to_watch
+)
+{
+    struct epoll_event events[DIPSHP_MAX_EVENTS];
+    int events_num;
+    do {
+        events_num = epoll_wait(
+            dipshp_loop.epoll_fd, events, DIPSHP_MAX_EVENTS, -1
+        );
+    } while (-1 == events_num && EINTR == errno);
+    if (-1 == events_num)
+        return -1;
+
+    int fd_ready = 0;
+    for (int i = 0; i < events_num; ++i) {
+        if (events[i].data.fd == dipshp_loop.signal_fd)
+            dipshp_drain_signal_fd();
+        else if (-1 != fd_to_watch && events[i].data.fd == fd_to_watch)
+            fd_ready = 1;
+    }
+    return fd_ready;
+}
+
+static int
+dipshp_wait_for_child_blocking(
+    int pid,
+    int *wait_status
+)
+{
+    int ret;
+    do {
+        ret = waitpid(pid, wait_status, 0);
+    } while (-1 == ret && EINTR == errno);
+    return -1 == ret ? -1 : 0;
+}
+
+int
+dipsh_event_loop_wait_for_child(
+    int pid,
+    int *wait_status
+)
+{
+    if (!dipshp_loop.active)
+        return dipshp_wait_for_child_blocking(pid, wait_status);
+    if (dipshp_take_unclaimed(pid, wait_status))
+        return 0;
+
+    /* the pidfd wakes the loop exactly when this child exits, the signalfd
+     * takes care of every other child exiting meanwhile */
+    int pidfd = pidfd_open(pid, 0);
+    if (-1 != pidfd && -1 == dipshp_add_to_epoll(pidfd)) {
+        close(pidfd);
+        pidfd = -1;
+    }
+    int ret = 0;
+    for (;;) {
+        int reaped = dipshp_reap_children();
+        if (dipshp_take_unclaimed(pid, wait_status))
+            break;
+        if (-1 == reaped || -1 == dipshp_poll_events(-1)) {
+            ret = -1;
+            break;
+        }
+    }
+    if (-1 != pidfd)
+        close(pidfd);
+    return ret;
+}
+
+static int
+dipshp_watch_fd(
+    int fd
+)
+{
+    if (fd == dipshp_loop.watched_fd)
+        return 0;
+    if (-1 != dipshp_loop.watched_fd) {
+        if (!dipshp_loop.is_watched_fd_always_ready) {
+            epoll_ctl(
+                dipshp_loop.epoll_fd, EPOLL_CTL_DEL, dipshp_loop.watched_fd,
+                NULL
+            );
+        }
+        dipshp_loop.watched_fd = -1;
+    }
+    int ret = dipshp_add_to_epoll(fd);
+    if (-1 == ret && EPERM != errno)
+        return 1;
+    dipshp_loop.watched_fd = fd;
+    dipshp_loop.is_watched_fd_always_ready = -1 == ret;
+    return 0;
+}
+
+int
+dipsh_event_loop_wait_for_fd(
+    int fd
+)
+{
+    if (!dipshp_loop.active)
+        return dipsh_event_loop_fd_ready;
+    if (0 != dipshp_watch_fd(fd))
+        return dipsh_event_loop_failure;
+    if (dipshp_loop.is_watched_fd_always_ready) {
+        if (0 < dipshp_reap_children())
+            return dipsh_event_loop_children_reaped;
+        return dipsh_event_loop_fd_ready;
+    }
+    for (;;) {
+        if (0 < dipshp_reap_children())
+            return dipsh_event_loop_children_reaped;
+        int ret = dipshp_poll_events(fd);
+        if (-1 == ret)
+            return dipsh_event_loop_failure;
+        /* children reaped along with the fd becoming ready go first */
+        if (0 < dipshp_reap_children())
+            return dipsh_event_loop_children_reaped;
+        if (1 == ret)
+            return dipsh_event_loop_fd_ready;
+    }
+}
+
+int
+dipsh_event_loop_wait_for_children()
+{
+    if (!dipshp_loop.active) {
+        int wait_status;
+        int pid;
+        do {
+            pid = waitpid(-1, &wait_status, 0);
+        } while (-1 == pid && EINTR == errno);
+        if (-1 == pid)
+            return dipsh_event_loop_failure;
+        dipshp_dispatch_reaped(pid, wait_status);
+        return dipsh_event_loop_children_reaped;
+    }
+    for (;;) {
+        int reaped = dipshp_reap_children();
+        if (0 < reaped)
+            return dipsh_event_loop_children_reaped;
+        if (-1 == reaped || -1 == dipshp_poll_events(-1))
+            return dipsh_event_loop_failure;
+    }
+}
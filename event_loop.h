@@ -0,0 +1,66 @@
+#ifndef _DIPSH_EVENT_LOOP_H_
+#define _DIPSH_EVENT_LOOP_H_
+
+#include <signal.h>
+
+/* the shell's central event loop: SIGCHLD is blocked and received through a
+ * signalfd, which is polled with epoll along with pidfds of the children the
+ * shell waits for in the foreground and any fd the shell wants to read. Every
+ * child is reaped as soon as it exits; statuses of children nobody claims are
+ * kept until someone waits for them */
+
+int
+dipsh_event_loop_init();
+
+/* to be called in a forked child: closes the loop's fds and restores the
+ * signal mask; after that waits fall back to plain waitpid(2) */
+void
+dipsh_event_loop_reset_after_fork();
+
+/* the signal mask children should start with, returns 0 if it has been
+ * stored to mask, 1 if the loop isn't active and the mask doesn't matter */
+int
+dipsh_event_loop_get_child_sigmask(
+    sigset_t *mask
+);
+
+/* called for every reaped child; returns non-zero if the status has been
+ * consumed, zero if it has to be kept for a later wait */
+typedef int (*dipsh_child_reaped_cb)(
+    int pid,
+    int wait_status,
+    void *ctx
+);
+
+void
+dipsh_event_loop_set_reaped_cb(
+    dipsh_child_reaped_cb cb,
+    void *ctx
+);
+
+/* blocks until the child exits, returns 0 and its wait status, or -1 */
+int
+dipsh_event_loop_wait_for_child(
+    int pid,
+    int *wait_status
+);
+
+enum
+{
+    dipsh_event_loop_fd_ready,
+    dipsh_event_loop_children_reaped,
+    dipsh_event_loop_failure
+};
+
+/* blocks until fd becomes readable or some children are reaped; a regular
+ * file, which epoll can't watch, is always readable */
+int
+dipsh_event_loop_wait_for_fd(
+    int fd
+);
+
+/* blocks until some children are reaped */
+int
+dipsh_event_loop_wait_for_children();
+
+#endif /* _DIPSH_EVENT_LOOP_H_ */
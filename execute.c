@@ -1,4 +1,5 @@
 #include "execute.h"
+#include "bytecode.h"
 #include "command.h"
 #include "handler.h"
 #include "pipeline.h"
@@ -22,22 +23,6 @@ dipshp_handle_command_result(
     }
 }
 
-static int
-dipshp_execute_script(
-    const dipsh_symbol *ast,
-    dipsh_shell_state *state
-)
-{
-    dipsh_nonterminal_child *children =
-        ((dipsh_nonterminal *)ast)->children_list;
-    int ret = 0;
-    while (0 == ret && children) {
-        ret |= dipsh_execute_ast(children->child, state);
-        children = children->next;
-    }
-    return ret;
-}
-
 static void
 dipshp_bg_command_spawned_cb(
     int pid
@@ -46,132 +31,93 @@ dipshp_bg_command_spawned_cb(
     printf("[%d] Spawned\n", pid);
 }
 
-static int
-dipshp_execute_seq_bg_start(
-    const dipsh_symbol *ast,
-    dipsh_shell_state *state
-)
-{
-    dipsh_nonterminal_child *children =
-        ((dipsh_nonterminal *)ast)->children_list;
-    int seq_bg_ret = 0;
-    int is_bg_op = 0;
-    const dipsh_symbol *command;
-    const dipsh_symbol *op;
-    while (0 == seq_bg_ret && children) {
-        command = children->child;
-        op = children->next ? children->next->child : NULL;
-        is_bg_op = op && dipsh_symbol_bg == op->type;
-        if (is_bg_op) {
-            seq_bg_ret = dipsh_shell_state_spawn_bg_command(
-                state, command, dipshp_bg_command_spawned_cb
-            );
-        } else {
-            seq_bg_ret = dipsh_execute_ast(command, state);
-        }
-        if (op)
-            children = children->next->next;
-        else
-            children = NULL;
-    }
-    return seq_bg_ret;
-}
-
-static int
-dipshp_execute_and_or(
-    const dipsh_symbol *ast,
-    dipsh_shell_state *state
-)
-{
-    dipsh_nonterminal_child *children =
-        ((dipsh_nonterminal *)ast)->children_list;
-    int and_or_ret = 0; 
-    int curr_status = 0;
-    const dipsh_symbol *command;
-    const dipsh_symbol *op;
-    while (0 == and_or_ret && children) {
-        command = children->child;
-        op = children->next ? children->next->child : NULL;
-        and_or_ret = dipsh_execute_ast(command, state);
-        if (0 != and_or_ret || 
-            !state->last_status.exited_normally || 
-            !state->last_status.exited_by_code) {
-            and_or_ret = 1;
-            break;
-        }
-        curr_status = state->last_status.exit_code;
-        if (op) {
-            int is_and_op = dipsh_symbol_and == op->type;
-            if ((curr_status && is_and_op) ||
-                (!curr_status && !is_and_op)) {
-                break;
-            }
-            children = children->next->next;
-        } else {
-            children = NULL;
-        }
-    }
-    return and_or_ret;
-}
-
 static int
 dipshp_execute_pipe(
-    const dipsh_symbol *ast,
+    dipsh_pipeline *pipeline,
     dipsh_shell_state *state
 )
 {
-    dipsh_pipeline *pipeline = dipsh_pipeline_init(ast, 1);
     if (!pipeline) {
         warnx("pipeline unexpectedly failed");
         return 0;
     }
+    dipsh_pipeline_rewind(pipeline, 1, state);
     const dipsh_command_status *status;
-    int pipeline_ret = dipsh_pipeline_execute(pipeline, state->is_interactive);
+    int pipeline_ret = dipsh_pipeline_execute(pipeline);
     status = dipsh_pipeline_get_last_command_status(pipeline);
     if (0 == pipeline_ret && state->is_interactive)
         dipshp_handle_command_result("pipeline", status);
-    if (0 != pipeline_ret) 
-        goto cleanup;
+    if (0 != pipeline_ret) {
+        /* whatever has been started isn't left for the next run to reap */
+        dipsh_pipeline_wait(pipeline);
+        return pipeline_ret;
+    }
     memcpy(&state->last_status, status, sizeof(dipsh_command_status));
-cleanup:
-    dipsh_pipeline_destroy(pipeline);
     return pipeline_ret;
 }
 
 static int
 dipshp_execute_command(
-    const dipsh_symbol *ast,
-    dipsh_shell_state *state
+    dipsh_command *command,
+    dipsh_shell_state *state,
+    int is_tail
 )
 {
     const dipsh_command_traits traits = {
         .suspend_after_fork = state->is_interactive,
         .run_in_separate_group = 1,
-        .execute_blocks = 0
+        .process_group = 0,
+        .execute_blocks = 0,
+        .fork_builtins = 0
     };
-    dipsh_command *command = dipsh_command_init(ast, &traits);
     if (!command) {
         warnx("command unexpectedly failed");
         return 0;
     }
+    dipsh_command_rewind(command);
+    dipsh_command_set_traits(command, &traits);
+    dipsh_command_set_shell_state(command, state);
+    if (is_tail && !dipsh_command_is_builtin(command)) {
+        /* nothing is left to do after the command, so it takes the shell's 
+         * place; one that can't be found is run the usual way to fail */
+        int exec_ret = dipsh_exec_in_shell(command, 0);
+        if (-1 == exec_ret) {
+            warn("%s: can't redirect", *dipsh_command_get_argv(command));
+            return 1;
+        }
+    }
     const dipsh_command_status *status;
     int old_group;
+    int takes_terminal = 
+        state->is_interactive && !dipsh_command_is_builtin(command);
+    dipsh_release_barrier barrier;
+    dipsh_release_barrier_reset(&barrier);
+    if (takes_terminal) {
+        int not_ok = dipsh_release_barrier_init(&barrier);
+        if (not_ok) {
+            warn("couldn't create the release barrier for a command");
+            return 1;
+        }
+        dipsh_command_set_release_barrier(command, &barrier);
+    }
+    int group_changed = 0;
     int command_ret = dipsh_command_execute(command);
-    if (dipsh_handler_ok == command_ret && state->is_interactive &&
-        !dipsh_command_is_builtin(command)) {
+    if (dipsh_handler_ok == command_ret && takes_terminal &&
+        dipsh_command_get_pid(command)) {
         command_ret = dipsh_change_current_group(
             dipsh_command_get_pid(command), &old_group
         );
+        dipsh_release_barrier_release(&barrier);
         if (0 != command_ret) {
             warn("couldn't change current group for a command");
             goto cleanup;
         }
-        command_ret = dipsh_command_start_suspended(command);
+        group_changed = 1;
     }
     status = dipsh_wait_for_command(command);
     if (dipsh_handler_ok == command_ret && state->is_interactive)
         dipshp_handle_command_result(*dipsh_command_get_argv(command), status);
-    if (state->is_interactive && !dipsh_command_is_builtin(command)) {
+    if (group_changed) {
         command_ret = dipsh_change_current_group(old_group, NULL);
         if (0 != command_ret) {
             warn("couldn't restore current group for a command");
@@ -180,28 +126,184 @@ dipshp_execute_command(
     }
     memcpy(&state->last_status, status, sizeof(dipsh_command_status));
 cleanup:
-    dipsh_command_destroy(command);
+    dipsh_release_barrier_release(&barrier);
+    /* it's not left for the next run to reap either */
+    dipsh_wait_for_command(command);
+    dipsh_command_set_release_barrier(command, NULL);
     return command_ret;
 }
 
+typedef struct dipshp_subshell_ctx_tag
+{
+    const dipsh_bytecode *code;
+    int pc;
+}
+dipshp_subshell_ctx;
+
+static int
+dipshp_run_code(
+    const dipsh_bytecode *code,
+    int pc,
+    dipsh_shell_state *state,
+    int is_final
+);
+
+static int
+dipshp_run_subshell(
+    dipsh_shell_state *state,
+    void *ctx
+)
+{
+    dipshp_subshell_ctx *subshell = ctx;
+    return dipshp_run_code(subshell->code, subshell->pc, state, 1);
+}
+
+/* the exit code of the last command, -1 if it hasn't exited (which stops 
+ * everything) */
+static int
+dipshp_last_exit_code(
+    const dipsh_shell_state *state
+)
+{
+    if (!state->last_status.exited_normally || 
+        !state->last_status.exited_by_code) {
+        return -1;
+    }
+    return state->last_status.exit_code;
+}
+
+/* dispatches with computed gotos, each handler jumping right to the next one
+ * (a GNU extension, as is much else the shell relies on) */
+#define DIPSHP_DISPATCH() goto *dipshp_handlers[instr->opcode]
+#define DIPSHP_NEXT() do { ++instr; DIPSHP_DISPATCH(); } while (0)
+
+static int
+dipshp_run_code(
+    const dipsh_bytecode *code,
+    int pc,
+    dipsh_shell_state *state,
+    int is_final
+)
+{
+    static const void *const dipshp_handlers[] = {
+        [dipsh_op_spawn] = &&do_spawn,
+        [dipsh_op_pipeline] = &&do_pipeline,
+        [dipsh_op_bg] = &&do_bg,
+        [dipsh_op_bg_subshell] = &&do_bg_subshell,
+        [dipsh_op_jump_if_fail] = &&do_jump_if_fail,
+        [dipsh_op_jump_if_ok] = &&do_jump_if_ok,
+        [dipsh_op_check] = &&do_check,
+        [dipsh_op_end] = &&do_end
+    };
+    /* unless the shell is interactive, the last command of the final code
+     * replaces the shell instead of being waited for */
+    int allows_tail = is_final && !state->is_interactive;
+    const dipsh_instruction *instr = code->code + pc;
+    dipshp_subshell_ctx subshell = { code, 0 };
+    int ret;
+    DIPSHP_DISPATCH();
+
+do_spawn:
+    ret = dipshp_execute_command(
+        code->commands[instr->arg], state, allows_tail && instr->is_tail
+    );
+    if (0 != ret)
+        return ret;
+    DIPSHP_NEXT();
+do_pipeline:
+    ret = dipshp_execute_pipe(code->pipelines[instr->arg], state);
+    if (0 != ret)
+        return ret;
+    DIPSHP_NEXT();
+do_bg:
+    if (!code->pipelines[instr->arg])
+        return 1;
+    ret = dipsh_shell_state_spawn_bg_pipeline(
+        state, code->pipelines[instr->arg], dipshp_bg_command_spawned_cb
+    );
+    if (0 != ret)
+        return ret;
+    DIPSHP_NEXT();
+do_bg_subshell:
+    /* the subshell runs the code right after the instruction */
+    subshell.pc = instr - code->code + 1;
+    ret = dipsh_shell_state_spawn_bg_subshell(
+        state, dipshp_run_subshell, &subshell, dipshp_bg_command_spawned_cb
+    );
+    if (0 != ret)
+        return ret;
+    instr = code->code + instr->arg;
+    DIPSHP_DISPATCH();
+do_jump_if_fail:
+    ret = dipshp_last_exit_code(state);
+    if (-1 == ret)
+        return 1;
+    if (0 != ret) {
+        instr = code->code + instr->arg;
+        DIPSHP_DISPATCH();
+    }
+    DIPSHP_NEXT();
+do_jump_if_ok:
+    ret = dipshp_last_exit_code(state);
+    if (-1 == ret)
+        return 1;
+    if (0 == ret) {
+        instr = code->code + instr->arg;
+        DIPSHP_DISPATCH();
+    }
+    DIPSHP_NEXT();
+do_check:
+    if (-1 == dipshp_last_exit_code(state))
+        return 1;
+    DIPSHP_NEXT();
+do_end:
+    return 0;
+}
+
+int
+dipsh_execute_bytecode(
+    const dipsh_bytecode *code,
+    dipsh_shell_state *state
+)
+{
+    return dipshp_run_code(code, 0, state, 0);
+}
+
+int
+dipsh_execute_final_bytecode(
+    const dipsh_bytecode *code,
+    dipsh_shell_state *state
+)
+{
+    return dipshp_run_code(code, 0, state, 1);
+}
+
 int
 dipsh_execute_ast(
-    const dipsh_symbol *ast,
+    const dipsh_ast *ast,
+    const dipsh_ast_node *node,
     dipsh_shell_state *state
 )
 {
-    switch (ast->type) {
-    case dipsh_symbol_script:
-        return dipshp_execute_script(ast, state);
-    case dipsh_symbol_seq_bg_start:
-        return dipshp_execute_seq_bg_start(ast, state);
-    case dipsh_symbol_and_or:
-        return dipshp_execute_and_or(ast, state);
-    case dipsh_symbol_pipe:
-        return dipshp_execute_pipe(ast, state);
-    case dipsh_symbol_command:
-        return dipshp_execute_command(ast, state);
-    default: /* shouldn't happen */
+    dipsh_bytecode *code = dipsh_bytecode_compile(ast, node);
+    if (!code)
         return 1;
-    }
+    int ret = dipsh_execute_bytecode(code, state);
+    dipsh_bytecode_destroy(code);
+    return ret;
+}
+
+int
+dipsh_execute_final_ast(
+    const dipsh_ast *ast,
+    const dipsh_ast_node *node,
+    dipsh_shell_state *state
+)
+{
+    dipsh_bytecode *code = dipsh_bytecode_compile(ast, node);
+    if (!code)
+        return 1;
+    int ret = dipsh_execute_final_bytecode(code, state);
+    dipsh_bytecode_destroy(code);
+    return ret;
 }
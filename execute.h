@@ -2,11 +2,38 @@
 #define _DIPSH_EXECUTE_H_
 
 #include "parser.h"
+#include "bytecode.h"
 #include "shell_state.h"
 
+/* runs the code (see bytecode.h); it may be run once again afterwards */
+int
+dipsh_execute_bytecode(
+    const dipsh_bytecode *code,
+    dipsh_shell_state *state
+);
+
+/* the same, but nothing is going to run after the code: unless the shell is
+ * interactive, its last command replaces the shell instead of being waited 
+ * for */
+int
+dipsh_execute_final_bytecode(
+    const dipsh_bytecode *code,
+    dipsh_shell_state *state
+);
+
+/* compiles the subtree of ast at node and runs it once */
 int
 dipsh_execute_ast(
-    const dipsh_symbol *ast,
+    const dipsh_ast *ast,
+    const dipsh_ast_node *node,
+    dipsh_shell_state *state
+);
+
+/* the same, with the code run as final */
+int
+dipsh_execute_final_ast(
+    const dipsh_ast *ast,
+    const dipsh_ast_node *node,
     dipsh_shell_state *state
 );
 
@@ -0,0 +1,343 @@
+#include "format.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define DIPSHP_MAX_FLAGS 8
+#define DIPSHP_MAX_SPEC_LEN 48
+
+typedef struct dipshp_printf_state_tag
+{
+    int argc;
+    char **argv;
+    int pos;
+    FILE *errors;
+    int failed;
+}
+dipshp_printf_state;
+
+static int
+dipshp_is_octal_digit(
+    char c
+)
+{
+    return c >= '0' && c <= '7';
+}
+
+static int
+dipshp_hex_digit_value(
+    char c
+)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/* reads the escape sequence following a backslash, returns the number of
+ * chars it takes; *ch is -1 for \c. In a format, octal values go right after
+ * the backslash, in %b and echo they are preceded by a zero */
+static int
+dipshp_read_escape(
+    const char *str,
+    int is_format,
+    int *ch
+)
+{
+    static const char simple_from[] = "\\abefnrtv\"";
+    static const char simple_to[] = "\\\a\b\033\f\n\r\t\v\"";
+    const char *simple = *str ? strchr(simple_from, *str) : NULL;
+    if (simple) {
+        *ch = simple_to[simple - simple_from];
+        return 1;
+    }
+    if ('c' == *str) {
+        *ch = -1;
+        return 1;
+    }
+    if ('x' == *str && -1 != dipshp_hex_digit_value(str[1])) {
+        int len = 1;
+        *ch = 0;
+        for (; len < 3 && -1 != dipshp_hex_digit_value(str[len]); ++len)
+            *ch = *ch * 16 + dipshp_hex_digit_value(str[len]);
+        return len;
+    }
+    int skip = !is_format && '0' == *str;
+    if (skip || (is_format && dipshp_is_octal_digit(*str))) {
+        int len = skip;
+        *ch = 0;
+        for (; len < skip + 3 && dipshp_is_octal_digit(str[len]); ++len)
+            *ch = *ch * 8 + str[len] - '0';
+        *ch &= 0xff;
+        return len;
+    }
+    /* not an escape: the backslash stays as it is */
+    *ch = '\\';
+    return 0;
+}
+
+int
+dipsh_format_escapes(
+    FILE *out,
+    const char *str
+)
+{
+    while (*str) {
+        if ('\\' != *str) {
+            fputc(*str++, out);
+            continue;
+        }
+        int ch;
+        str += 1 + dipshp_read_escape(str + 1, 0, &ch);
+        if (-1 == ch)
+            return dipsh_format_stop;
+        fputc(ch, out);
+    }
+    return dipsh_format_ok;
+}
+
+static const char *
+dipshp_next_arg(
+    dipshp_printf_state *state
+)
+{
+    return state->pos < state->argc ? state->argv[state->pos++] : NULL;
+}
+
+static void
+dipshp_check_number(
+    dipshp_printf_state *state,
+    const char *arg,
+    const char *endptr
+)
+{
+    if (endptr == arg || *endptr) {
+        fprintf(state->errors, "printf: %s: invalid number\n", arg);
+        state->failed = 1;
+    } else if (ERANGE == errno) {
+        fprintf(state->errors, "printf: %s: out of range\n", arg);
+        state->failed = 1;
+    }
+}
+
+static long long
+dipshp_next_integer(
+    dipshp_printf_state *state
+)
+{
+    const char *arg = dipshp_next_arg(state);
+    if (!arg)
+        return 0;
+    /* a leading quote means the code of the next char */
+    if ('\'' == *arg || '"' == *arg)
+        return (unsigned char)arg[1];
+    char *endptr;
+    errno = 0;
+    long long result = strtoll(arg, &endptr, 0);
+    dipshp_check_number(state, arg, endptr);
+    return result;
+}
+
+static unsigned long long
+dipshp_next_unsigned(
+    dipshp_printf_state *state
+)
+{
+    const char *arg = dipshp_next_arg(state);
+    if (!arg)
+        return 0;
+    if ('\'' == *arg || '"' == *arg)
+        return (unsigned char)arg[1];
+    char *endptr;
+    errno = 0;
+    unsigned long long result = strtoull(arg, &endptr, 0);
+    dipshp_check_number(state, arg, endptr);
+    return result;
+}
+
+static double
+dipshp_next_double(
+    dipshp_printf_state *state
+)
+{
+    const char *arg = dipshp_next_arg(state);
+    if (!arg)
+        return 0;
+    if ('\'' == *arg || '"' == *arg)
+        return (unsigned char)arg[1];
+    char *endptr;
+    errno = 0;
+    double result = strtod(arg, &endptr);
+    dipshp_check_number(state, arg, endptr);
+    return result;
+}
+
+/* handles the conversion at fmt (right after '%'), returns the number of
+ * chars it takes, or -1 if the output has to stop */
+static int
+dipshp_format_conversion(
+    FILE *out,
+    dipshp_printf_state *state,
+    const char *fmt
+)
+{
+    const char *pos = fmt;
+    char flags[DIPSHP_MAX_FLAGS + 1];
+    int flags_len = 0;
+    for (; *pos && strchr("-+ #0", *pos); ++pos) {
+        if (flags_len < DIPSHP_MAX_FLAGS)
+            flags[flags_len++] = *pos;
+    }
+    flags[flags_len] = '\0';
+
+    int width = -1, precision = -1;
+    if ('*' == *pos) {
+        width = dipshp_next_integer(state);
+        ++pos;
+    } else if (*pos >= '0' && *pos <= '9') {
+        width = strtol(pos, (char **)&pos, 10);
+    }
+    if ('.' == *pos) {
+        ++pos;
+        if ('*' == *pos) {
+            precision = dipshp_next_integer(state);
+            ++pos;
+        } else {
+            precision = strtol(pos, (char **)&pos, 10);
+        }
+    }
+
+    char spec[DIPSHP_MAX_SPEC_LEN];
+    int spec_len = snprintf(spec, sizeof(spec), "%%%s", flags);
+    if (width >= 0)
+        spec_len += snprintf(spec + spec_len, 12, "%d", width);
+    if (precision >= 0)
+        spec_len += snprintf(spec + spec_len, 13, ".%d", precision);
+
+    char conv = *pos;
+    switch (conv) {
+    case 'd':
+    case 'i':
+        snprintf(spec + spec_len, 4, "ll%c", conv);
+        fprintf(out, spec, dipshp_next_integer(state));
+        break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+        snprintf(spec + spec_len, 4, "ll%c", conv);
+        fprintf(out, spec, dipshp_next_unsigned(state));
+        break;
+    case 'a':
+    case 'A':
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+        snprintf(spec + spec_len, 2, "%c", conv);
+        fprintf(out, spec, dipshp_next_double(state));
+        break;
+    case 'c':
+    case 's': {
+        const char *arg = dipshp_next_arg(state);
+        snprintf(spec + spec_len, 2, "%c", conv);
+        if ('c' == conv)
+            fprintf(out, spec, arg ? *arg : '\0');
+        else
+            fprintf(out, spec, arg ? arg : "");
+        break;
+    }
+    case 'b': {
+        const char *arg = dipshp_next_arg(state);
+        char *expanded = NULL;
+        size_t expanded_len = 0;
+        FILE *expanded_out = open_memstream(&expanded, &expanded_len);
+        if (!expanded_out)
+            return -1;
+        int ret = dipsh_format_escapes(expanded_out, arg ? arg : "");
+        fclose(expanded_out);
+        snprintf(spec + spec_len, 2, "s");
+        fprintf(out, spec, expanded);
+        free(expanded);
+        if (dipsh_format_stop == ret)
+            return -1;
+        break;
+    }
+    case '%':
+        fputc('%', out);
+        break;
+    default:
+        if (conv)
+            fprintf(state->errors, "printf: %%%c: invalid conversion\n", conv);
+        else
+            fprintf(state->errors, "printf: %%: missing conversion\n");
+        state->failed = 1;
+        return -1;
+    }
+    return pos - fmt + 1;
+}
+
+static int
+dipshp_format_once(
+    FILE *out,
+    dipshp_printf_state *state,
+    const char *format
+)
+{
+    while (*format) {
+        int ch, len;
+        switch (*format) {
+        case '\\':
+            len = dipshp_read_escape(format + 1, 1, &ch);
+            if (-1 == ch)
+                return dipsh_format_stop;
+            fputc(ch, out);
+            format += 1 + len;
+            break;
+        case '%':
+            len = dipshp_format_conversion(out, state, format + 1);
+            if (-1 == len)
+                return dipsh_format_stop;
+            format += 1 + len;
+            break;
+        default:
+            fputc(*format++, out);
+            break;
+        }
+    }
+    return dipsh_format_ok;
+}
+
+int
+dipsh_format_printf(
+    FILE *out,
+    FILE *errors,
+    const char *format,
+    int argc,
+    char **argv
+)
+{
+    dipshp_printf_state state = {
+        .argc = argc,
+        .argv = argv,
+        .pos = 0,
+        .errors = errors,
+        .failed = 0
+    };
+    for (;;) {
+        int pos_before = state.pos;
+        int ret = dipshp_format_once(out, &state, format);
+        /* a format without conversions is used just once */
+        if (dipsh_format_stop == ret || state.pos >= state.argc ||
+            state.pos == pos_before) {
+            break;
+        }
+    }
+    return state.failed;
+}
@@ -0,0 +1,34 @@
+#ifndef _DIPSH_FORMAT_H_
+#define _DIPSH_FORMAT_H_
+
+#include <stdio.h>
+
+/* the formatting behind the echo and printf builtins */
+
+enum
+{
+    dipsh_format_ok,
+    dipsh_format_stop   /* \c has been met: no more output at all */
+};
+
+/* writes str to out with backslash escapes interpreted the way echo -e and
+ * printf's %b do it (\0NNN for octal) */
+int
+dipsh_format_escapes(
+    FILE *out,
+    const char *str
+);
+
+/* formats the arguments the way printf(1) does, the format is reused while
+ * there are arguments left; invalid arguments are reported to errors, with
+ * the output still made. Returns 0, or 1 if there have been any errors */
+int
+dipsh_format_printf(
+    FILE *out,
+    FILE *errors,
+    const char *format,
+    int argc,
+    char **argv
+);
+
+#endif /* _DIPSH_FORMAT_H_ */
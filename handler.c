@@ -1,6 +1,14 @@
 #include "handler.h"
 #include "command.h"
 #include "change_group.h"
+#include "spawn.h"
+#include "path_cache.h"
+#include "intern.h"
+#include "event_loop.h"
+#include "shell_state.h"
+#include "format.h"
+#include "test_expr.h"
+#include "builtin_io.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -9,34 +17,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <math.h>
+#include <time.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 
-static int
-dipshp_open_file_redir(
-    const dipsh_redirect *redir
-)
-{
-    errno = 0;
-    if (!redir || !redir->need_open_file)
-        return -1;
-    
-    int open_flags;
-    switch (redir->type) {
-    case dipsh_redir_in:  
-        open_flags = O_RDONLY; 
-        break;
-    case dipsh_redir_out: 
-        open_flags = O_WRONLY | O_CREAT | O_TRUNC; 
-        break;
-    case dipsh_redir_app:
-        open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND;
-        break;
-    default:
-        return -1;
-    }
+#define DIPSHP_SHORT_MSG_SIZE 256
 
-    return open(redir->file_name, open_flags, 0666);
-}
+/* about 31 years, so that the deadline fits whatever time_t is */
+#define DIPSHP_MAX_SLEEP_SECONDS 1e9
 
 #define DIPSHP_CD_USAGE                                                        \
     "cd -- change working directory\n\n"                                       \
@@ -44,7 +33,10 @@ dipshp_open_file_redir(
     "   cd [-h|--help] [DIR]\n\n"                                              \
     "Description:\n"                                                           \
     "Changes working directory to DIR. If DIR is not specified, then the "     \
-    "value from HOME environment variable will be used.\n\n"                   \
+    "value from HOME environment variable will be used; if DIR is '-', then "  \
+    "the previous working directory (OLDPWD) will be used and printed. A "     \
+    "relative DIR is resolved against the logical working directory, i.e. "    \
+    "'..' goes back over symbolic links the way they have been followed.\n\n"  \
     "Parameters:\n"                                                            \
     "   DIR         the directory to change to\n"                              \
     "   -h, --help  this help message\n"                                        
@@ -52,12 +44,102 @@ dipshp_open_file_redir(
 #define DIPSHP_PWD_USAGE                                                       \
     "pwd -- print working directory\n\n"                                       \
     "Usage:\n"                                                                 \
-    "   pwd [-h|--help]\n\n"                                                   \
+    "   pwd [-h|--help] [-L|-P]\n\n"                                           \
     "Description:\n"                                                           \
     "Prints absolute path to the current working directory.\n\n"               \
     "Parameters:\n"                                                            \
+    "   -L          print the logical path, as cd has reached it (default)\n"  \
+    "   -P          print the physical path, with no symbolic links\n"         \
     "   -h, --help  this help message\n"                                        
 
+#define DIPSHP_PRINTF_USAGE                                                    \
+    "printf -- format and print data\n\n"                                      \
+    "Usage:\n"                                                                 \
+    "   printf [-h|--help] FORMAT [ARG...]\n\n"                                \
+    "Description:\n"                                                           \
+    "Prints ARGs according to FORMAT, the way printf(3) does. FORMAT is "      \
+    "reused as long as there are ARGs left; %b prints an ARG with backslash "  \
+    "escapes interpreted.\n\n"                                                 \
+    "Parameters:\n"                                                            \
+    "   FORMAT      the format string\n"                                       \
+    "   ARG         the values to format\n"                                    \
+    "   -h, --help  this help message\n"
+
+#define DIPSHP_SLEEP_USAGE                                                     \
+    "sleep -- delay for a specified amount of time\n\n"                        \
+    "Usage:\n"                                                                 \
+    "   sleep [-h|--help] NUMBER[SUFFIX]...\n\n"                               \
+    "Description:\n"                                                           \
+    "Pauses for the sum of the given intervals. NUMBER may be fractional, "    \
+    "SUFFIX may be 's' for seconds (default), 'm' for minutes, 'h' for "       \
+    "hours or 'd' for days.\n\n"                                               \
+    "Parameters:\n"                                                            \
+    "   NUMBER      the length of an interval\n"                               \
+    "   -h, --help  this help message\n"
+
+#define DIPSHP_BASENAME_USAGE                                                  \
+    "basename -- strip directory and suffix from a file name\n\n"              \
+    "Usage:\n"                                                                 \
+    "   basename [-h|--help] STRING [SUFFIX]\n\n"                              \
+    "Description:\n"                                                           \
+    "Prints STRING with everything up to the last slash removed, as well as "  \
+    "SUFFIX if it is given.\n\n"                                               \
+    "Parameters:\n"                                                            \
+    "   STRING      the file name\n"                                           \
+    "   SUFFIX      the suffix to remove\n"                                    \
+    "   -h, --help  this help message\n"
+
+#define DIPSHP_DIRNAME_USAGE                                                   \
+    "dirname -- strip the last component from a file name\n\n"                 \
+    "Usage:\n"                                                                 \
+    "   dirname [-h|--help] STRING\n\n"                                        \
+    "Description:\n"                                                           \
+    "Prints STRING with its last component removed, '.' if there is no "       \
+    "directory part.\n\n"                                                      \
+    "Parameters:\n"                                                            \
+    "   STRING      the file name\n"                                           \
+    "   -h, --help  this help message\n"
+
+#define DIPSHP_HASH_USAGE                                                      \
+    "hash -- remember command locations\n\n"                                   \
+    "Usage:\n"                                                                 \
+    "   hash [-h|--help] [-r] [NAME...]\n\n"                                   \
+    "Description:\n"                                                           \
+    "Without arguments, lists the remembered commands, the number of times "   \
+    "each of them has been looked up, and the cache hit and miss counters. "   \
+    "Otherwise, looks up every NAME in PATH and remembers the result.\n\n"     \
+    "Parameters:\n"                                                            \
+    "   NAME        the command to look up\n"                                  \
+    "   -r          forget all remembered locations\n"                         \
+    "   -h, --help  this help message\n"
+
+#define DIPSHP_WAIT_USAGE                                                      \
+    "wait -- wait for background commands\n\n"                                 \
+    "Usage:\n"                                                                 \
+    "   wait [-h|--help] [-n] [PID...]\n\n"                                    \
+    "Description:\n"                                                           \
+    "Waits for the background commands with the given PIDs and returns the "   \
+    "status of the last one. Without arguments, waits for all background "     \
+    "commands and returns zero.\n\n"                                           \
+    "Parameters:\n"                                                            \
+    "   PID         the background command to wait for\n"                      \
+    "   -n          wait for the next background command to finish and "       \
+    "return its status\n"                                                      \
+    "   -h, --help  this help message\n"
+
+#define DIPSHP_EXEC_USAGE                                                      \
+    "exec -- replace the shell with a command\n\n"                             \
+    "Usage:\n"                                                                 \
+    "   exec [-h|--help] [COMMAND [ARG...]]\n\n"                               \
+    "Description:\n"                                                           \
+    "Applies the redirections to the shell itself and replaces the shell "     \
+    "with COMMAND. Without COMMAND, the redirections stay in effect for the "  \
+    "rest of the shell's life.\n\n"                                            \
+    "Parameters:\n"                                                            \
+    "   COMMAND     the command to run in place of the shell\n"                \
+    "   ARG         its arguments\n"                                           \
+    "   -h, --help  this help message\n"
+
 static int
 dipshp_is_help_arg(
     const char *arg
@@ -66,110 +148,162 @@ dipshp_is_help_arg(
     return 0 == strcmp(arg, "--help") || 0 == strcmp(arg, "-h");
 }
 
+/* what the writes below return once one has failed, for the builtin to stop
+ * right away; dipshp_handle_builtin reports it and makes the builtin fail */
+#define DIPSHP_HANDLER_WRITE_FAILED (dipsh_handler_system_error + 1)
+
+static int
+dipshp_write_buf_to_command_fd(
+    dipsh_builtin_io *io,
+    int command_fd,
+    const char *buf,
+    int buf_len
+)
+{
+    if (-1 == dipsh_builtin_io_write(io, command_fd, buf, buf_len))
+        return DIPSHP_HANDLER_WRITE_FAILED;
+    return dipsh_handler_ok;
+}
+
 static int
 dipshp_write_to_command_fd(
-    dipsh_command *command,
-    dipsh_command_status *status,
+    dipsh_builtin_io *io,
     int command_fd,
     const char *msg
 )
 {
-    const char *command_name = *dipsh_command_get_argv(command);
-    if (status) {
-        status->exited_normally = 1;
-        status->exited_by_code = 1;
-        status->exit_code = 0;
-    }
-
-    int result_fd;
-    const dipsh_redirect *redir = dipsh_command_get_redirect(
-        command, command_fd
-    );
-   
-    int should_close_result_fd = 0; 
-    if (redir) {
-        if (redir->need_open_file) {
-            result_fd = dipshp_open_file_redir(redir);
-            should_close_result_fd = 1;
-        } else {
-            result_fd = redir->inherited_fd;
-        }
-    } else {
-        result_fd = command_fd;
-    }
-
-    if (-1 == result_fd) {
-        if (0 == errno)
-            warnx("%s: incorrect output file descriptor", command_name);
-        else
-            warn("%s: can't open file", command_name);
-        if (status)
-            status->exit_code = 1;
-        return dipsh_handler_ok;
-    }
-    int msg_len = strlen(msg);
-    int write_ret = write(result_fd, msg, msg_len);
-    if (msg_len != write_ret) {
-        warn("%s: writing to file failed", command_name);
-        if (status)
-            status->exit_code = 1;
-    }
-    if (should_close_result_fd)
-        close(result_fd);
-    return dipsh_handler_ok;
+    return dipshp_write_buf_to_command_fd(io, command_fd, msg, strlen(msg));
 }
 
 static int
 dipshp_write_fmt_to_command_fd(
-    dipsh_command *command,
-    dipsh_command_status *status,
+    dipsh_builtin_io *io,
     int command_fd,
     const char *fmt, ...
 )
 {
+    /* most messages are short enough to do without malloc */
+    char short_str[DIPSHP_SHORT_MSG_SIZE];
     va_list ap;
     va_start(ap, fmt);
-    char *res_str;
-    int ret = vasprintf(&res_str, fmt, ap);
+    int ret = vsnprintf(short_str, sizeof(short_str), fmt, ap);
     va_end(ap);
+    if (ret >= 0 && ret < (int)sizeof(short_str))
+        return dipshp_write_buf_to_command_fd(io, command_fd, short_str, ret);
 
-    if (ret <= 0) {
-        status->exited_normally = 0;
+    char *res_str;
+    va_start(ap, fmt);
+    ret = vasprintf(&res_str, fmt, ap);
+    va_end(ap);
+    if (ret < 0)
         return dipsh_handler_system_error; 
-    }
-    ret = dipshp_write_to_command_fd(command, status, command_fd, res_str);
+    ret = dipshp_write_buf_to_command_fd(io, command_fd, res_str, ret);
     free(res_str);
     return ret;
 }
 
-#define DIPSHP_PRINT_ERROR_TO_STDERR(command, status, err)             \
-    do {                                                               \
-        int ret = dipshp_write_to_command_fd(command, status, 2, err); \
-        if (dipsh_handler_ok == ret && status)                         \
-            status->exit_code = 1;                                     \
-        return ret;                                                    \
+#define DIPSHP_PRINT_ERROR_TO_STDERR(io, status, err)                          \
+    do {                                                                       \
+        int ret = dipshp_write_to_command_fd(io, 2, err);                      \
+        if (dipsh_handler_ok == ret && status)                                 \
+            status->exit_code = 1;                                             \
+        return ret;                                                            \
     } while (0)
 
-#define DIPSHP_PRINT_FMT_ERROR_TO_STDERR(command, status, fmt, ...)    \
-    do {                                                               \
-        int ret = dipshp_write_fmt_to_command_fd(                      \
-            command, status, 2, fmt, __VA_ARGS__                       \
-        );                                                             \
-        if (dipsh_handler_ok == ret && status)                         \
-            status->exit_code = 1;                                     \
-        return ret;                                                    \
+#define DIPSHP_PRINT_FMT_ERROR_TO_STDERR(io, status, fmt, ...)                 \
+    do {                                                                       \
+        int ret = dipshp_write_fmt_to_command_fd(io, 2, fmt, __VA_ARGS__);     \
+        if (dipsh_handler_ok == ret && status)                                 \
+            status->exit_code = 1;                                             \
+        return ret;                                                            \
     } while (0)
 
+/* the working directory as cd has reached it, symbolic links included */
+static char *dipshp_logical_pwd = NULL;
+
+static int
+dipshp_has_dot_components(
+    const char *path
+)
+{
+    for (const char *pos = path; *pos; ) {
+        const char *end = strchrnul(pos, '/');
+        int len = end - pos;
+        int is_dot = 1 == len && '.' == *pos;
+        int is_dot_dot = 2 == len && 0 == strncmp(pos, "..", 2);
+        if (is_dot || is_dot_dot)
+            return 1;
+        pos = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static const char *
+dipshp_get_logical_pwd()
+{
+    if (dipshp_logical_pwd)
+        return dipshp_logical_pwd;
+    /* PWD is trusted as long as it leads to the current directory */
+    const char *env_pwd = getenv("PWD");
+    struct stat env_st, dot_st;
+    int env_pwd_ok = env_pwd && '/' == *env_pwd &&
+        !dipshp_has_dot_components(env_pwd) &&
+        0 == stat(env_pwd, &env_st) && 0 == stat(".", &dot_st) &&
+        env_st.st_dev == dot_st.st_dev && env_st.st_ino == dot_st.st_ino;
+    dipshp_logical_pwd = env_pwd_ok ? strdup(env_pwd) : getcwd(NULL, 0);
+    return dipshp_logical_pwd;
+}
+
+/* resolves path against base without looking at the file system: '.' is
+ * dropped and '..' removes the previous component */
+static char *
+dipshp_make_logical_path(
+    const char *base,
+    const char *path
+)
+{
+    int is_absolute = '/' == *path;
+    char *result = malloc(strlen(base) + strlen(path) + 2);
+    if (!result)
+        return NULL;
+    int len = 0;
+    if (!is_absolute) {
+        len = strlen(base);
+        memcpy(result, base, len);
+        /* the root is kept as an empty string till the end */
+        if (1 == len)
+            len = 0;
+    }
+    for (const char *pos = path; *pos; ) {
+        const char *end = strchrnul(pos, '/');
+        int comp_len = end - pos;
+        if (2 == comp_len && 0 == strncmp(pos, "..", 2)) {
+            while (len > 0 && '/' != result[--len])
+                ;
+        } else if (comp_len && !(1 == comp_len && '.' == *pos)) {
+            result[len++] = '/';
+            memcpy(result + len, pos, comp_len);
+            len += comp_len;
+        }
+        pos = *end ? end + 1 : end;
+    }
+    if (!len)
+        result[len++] = '/';
+    result[len] = '\0';
+    return result;
+}
+
 static int
 dipshp_handle_cd(
     dipsh_command *command,
+    dipsh_builtin_io *io,
     dipsh_command_status *status
 )
 {
     int argc = dipsh_command_get_argc(command);
     char **argv = dipsh_command_get_argv(command);
     if (argc > 2 || (argc == 2 && dipshp_is_help_arg(argv[1]))) 
-        return dipshp_write_to_command_fd(command, status, 2, DIPSHP_CD_USAGE);
+        return dipshp_write_to_command_fd(io, 2, DIPSHP_CD_USAGE);
     
     if (status) { 
         status->exited_normally = 1;
@@ -177,20 +311,80 @@ dipshp_handle_cd(
         status->exit_code = 0;
     }
 
+    int is_back = argc == 2 && 0 == strcmp(argv[1], "-");
     const char *new_wd = argc == 2 ? argv[1] : getenv("HOME");
+    if (is_back)
+        new_wd = getenv("OLDPWD");
+    if (!new_wd && is_back) 
+        DIPSHP_PRINT_ERROR_TO_STDERR(io, status, "cd: unknown OLDPWD\n");
     if (!new_wd) 
-        DIPSHP_PRINT_ERROR_TO_STDERR(command, status, "cd: unknown HOME\n");
-    int chdir_ret = chdir(new_wd);
+        DIPSHP_PRINT_ERROR_TO_STDERR(io, status, "cd: unknown HOME\n");
+    const char *old_pwd = dipshp_get_logical_pwd();
+    char *new_pwd = old_pwd || '/' == *new_wd
+        ? dipshp_make_logical_path(old_pwd ? old_pwd : "/", new_wd)
+        : NULL;
+    int chdir_ret = new_pwd ? chdir(new_pwd) : -1;
+    if (-1 == chdir_ret) {
+        /* the logical path may lead nowhere if '..' follows a symbolic link 
+         * to somewhere else, then it's up to the kernel */
+        free(new_pwd);
+        chdir_ret = chdir(new_wd);
+        new_pwd = 0 == chdir_ret ? getcwd(NULL, 0) : NULL;
+    }
     if (-1 == chdir_ret) {
         DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
-            command, status,
+            io, status,
             "cd: can't change working directory: %s\n", 
             strerror(errno)
         );
     }
+    if (old_pwd)
+        setenv("OLDPWD", old_pwd, 1);
+    if (new_pwd)
+        setenv("PWD", new_pwd, 1);
+    free(dipshp_logical_pwd);
+    dipshp_logical_pwd = new_pwd;
+    if (is_back && new_pwd) {
+        return dipshp_write_fmt_to_command_fd(io, 1, "%s\n", new_pwd);
+    }
     return dipsh_handler_ok;
 }
 
+static int
+dipshp_handle_pwd(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    int is_physical = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-P")) {
+            is_physical = 1;
+        } else if (0 == strcmp(argv[i], "-L")) {
+            is_physical = 0;
+        } else {
+            int ret = dipshp_write_to_command_fd(io, 2, DIPSHP_PWD_USAGE);
+            if (status)
+                status->exit_code = !dipshp_is_help_arg(argv[i]);
+            return ret;
+        }
+    }
+    char *physical_pwd = is_physical ? getcwd(NULL, 0) : NULL;
+    const char *pwd = is_physical ? physical_pwd : dipshp_get_logical_pwd();
+    if (!pwd) {
+        DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
+            io, status, 
+            "pwd: can't get working directory: %s\n", strerror(errno)
+        );
+    }
+    int ret = dipshp_write_fmt_to_command_fd(io, 1, "%s\n", pwd);
+    free(physical_pwd);
+    return ret;
+}
+
 static int
 dipshp_handle_exit_code_only(
     dipsh_command *command,
@@ -207,6 +401,7 @@ dipshp_handle_exit_code_only(
 static int
 dipshp_handle_true(
     dipsh_command *command,
+    dipsh_builtin_io *io,
     dipsh_command_status *status
 )
 {
@@ -216,14 +411,443 @@ dipshp_handle_true(
 static int
 dipshp_handle_false(
     dipsh_command *command,
+    dipsh_builtin_io *io,
     dipsh_command_status *status
 )
 {
     return dipshp_handle_exit_code_only(command, status, 1);
 }
 
+static int
+dipshp_is_echo_option(
+    const char *arg
+)
+{
+    if ('-' != arg[0] || !arg[1])
+        return 0;
+    return strspn(arg + 1, "neE") == strlen(arg + 1);
+}
+
+/* *stopped is set if the output is to stop after str (\c, or no memory) */
+static int
+dipshp_write_escapes(
+    dipsh_builtin_io *io,
+    const char *str,
+    int *stopped
+)
+{
+    char *output = NULL;
+    size_t output_len = 0;
+    FILE *out = open_memstream(&output, &output_len);
+    *stopped = 1;
+    if (!out)
+        return dipsh_handler_ok;
+    *stopped = dipsh_format_stop == dipsh_format_escapes(out, str);
+    fclose(out);
+    int ret = dipshp_write_buf_to_command_fd(io, 1, output, output_len);
+    free(output);
+    return ret;
+}
+
+static int
+dipshp_handle_echo(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    int add_newline = 1, interpret_escapes = 0;
+    int i = 1;
+    for (; i < argc && dipshp_is_echo_option(argv[i]); ++i) {
+        for (const char *opt = argv[i] + 1; *opt; ++opt) {
+            if ('n' == *opt)
+                add_newline = 0;
+            else
+                interpret_escapes = 'e' == *opt;
+        }
+    }
+
+    int stopped = 0, ret = dipsh_handler_ok;
+    for (int first = i; i < argc && !stopped; ++i) {
+        if (i != first)
+            ret = dipshp_write_buf_to_command_fd(io, 1, " ", 1);
+        if (dipsh_handler_ok != ret)
+            return ret;
+        if (interpret_escapes)
+            ret = dipshp_write_escapes(io, argv[i], &stopped);
+        else
+            ret = dipshp_write_to_command_fd(io, 1, argv[i]);
+        if (dipsh_handler_ok != ret)
+            return ret;
+    }
+    if (add_newline && !stopped)
+        ret = dipshp_write_buf_to_command_fd(io, 1, "\n", 1);
+    return ret;
+}
+
+static int
+dipshp_handle_printf(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    if (argc == 1 || (argc == 2 && dipshp_is_help_arg(argv[1]))) {
+        int ret = dipshp_write_to_command_fd(io, 2, DIPSHP_PRINTF_USAGE);
+        if (status)
+            status->exit_code = argc == 1;
+        return ret;
+    }
+
+    char *output = NULL, *errors = NULL;
+    size_t output_len = 0, errors_len = 0;
+    FILE *out = open_memstream(&output, &output_len);
+    FILE *errors_out = open_memstream(&errors, &errors_len);
+    int failed = 1;
+    if (out && errors_out) {
+        failed = dipsh_format_printf(
+            out, errors_out, argv[1], argc - 2, argv + 2
+        );
+    }
+    if (out)
+        fclose(out);
+    if (errors_out)
+        fclose(errors_out);
+    if (!out || !errors_out) {
+        free(output);
+        free(errors);
+        return dipsh_handler_system_error;
+    }
+    int ret = dipshp_write_buf_to_command_fd(io, 1, output, output_len);
+    if (dipsh_handler_ok == ret && errors_len) {
+        ret = dipshp_write_buf_to_command_fd(
+            io, 2, errors, errors_len
+        );
+    }
+    if (status && failed)
+        status->exit_code = 1;
+    free(output);
+    free(errors);
+    return ret;
+}
+
+static int
+dipshp_handle_test(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    int is_bracket = 0 == strcmp(argv[0], "[");
+    char *error = NULL;
+    int result;
+    if (is_bracket && (argc < 2 || 0 != strcmp(argv[argc - 1], "]"))) {
+        error = strdup("missing ']'");
+        result = dipsh_test_error;
+    } else {
+        int expr_len = argc - 1 - is_bracket;
+        result = dipsh_test_evaluate(expr_len, argv + 1, &error);
+    }
+    if (dipsh_test_error != result)
+        return dipshp_handle_exit_code_only(command, status, result);
+
+    int ret = dipshp_write_fmt_to_command_fd(
+        io, 2, "%s: %s\n", argv[0], error ? error : "error"
+    );
+    free(error);
+    if (status)
+        status->exit_code = dipsh_test_error;
+    return ret;
+}
+
+/* parses NUMBER[SUFFIX] into seconds, returns -1 if it's not valid */
+static double
+dipshp_parse_interval(
+    const char *str
+)
+{
+    char *endptr;
+    double seconds = strtod(str, &endptr);
+    if (endptr == str || isnan(seconds) || seconds < 0)
+        return -1;
+    switch (*endptr) {
+    case '\0':
+    case 's': break;
+    case 'm': seconds *= 60; break;
+    case 'h': seconds *= 60 * 60; break;
+    case 'd': seconds *= 24 * 60 * 60; break;
+    default:  return -1;
+    }
+    return *endptr && endptr[1] ? -1 : seconds;
+}
+
+static int
+dipshp_handle_sleep(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    if (argc == 1 || (argc == 2 && dipshp_is_help_arg(argv[1]))) {
+        int ret = dipshp_write_to_command_fd(io, 2, DIPSHP_SLEEP_USAGE);
+        if (status)
+            status->exit_code = argc == 1;
+        return ret;
+    }
+    double seconds = 0;
+    for (int i = 1; i < argc; ++i) {
+        double interval = dipshp_parse_interval(argv[i]);
+        if (interval < 0) {
+            DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
+                io, status, "sleep: invalid time interval '%s'\n", argv[i]
+            );
+        }
+        seconds += interval;
+    }
+
+    /* an absolute deadline makes interrupted sleeps simple to resume */
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (seconds > DIPSHP_MAX_SLEEP_SECONDS)
+        seconds = DIPSHP_MAX_SLEEP_SECONDS;
+    long long whole_seconds = (long long)seconds;
+    deadline.tv_sec += whole_seconds;
+    deadline.tv_nsec += (long)((seconds - whole_seconds) * 1e9);
+    if (deadline.tv_nsec >= 1000000000L) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    int sleep_ret;
+    do {
+        sleep_ret = 
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    } while (EINTR == sleep_ret);
+    if (0 != sleep_ret) {
+        DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
+            io, status, "sleep: can't sleep: %s\n", strerror(sleep_ret)
+        );
+    }
+    return dipshp_handle_exit_code_only(command, status, 0);
+}
+
+static int
+dipshp_handle_basename(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    if (argc < 2 || argc > 3 || dipshp_is_help_arg(argv[1])) {
+        int ret = dipshp_write_to_command_fd(io, 2, DIPSHP_BASENAME_USAGE);
+        if (status)
+            status->exit_code = !dipshp_is_help_arg(argv[argc > 1]);
+        return ret;
+    }
+    const char *str = argv[1];
+    int len = strlen(str);
+    while (len > 1 && '/' == str[len - 1])
+        --len;
+    int start = len;
+    while (start > 0 && '/' != str[start - 1])
+        --start;
+    /* a string of slashes only is the root */
+    if (start == len && len)
+        start = len - 1;
+    if (argc == 3 && start != len - 1) {
+        int suffix_len = strlen(argv[2]);
+        int is_suffix = suffix_len < len - start &&
+            0 == strncmp(str + len - suffix_len, argv[2], suffix_len);
+        if (is_suffix)
+            len -= suffix_len;
+    }
+    return dipshp_write_fmt_to_command_fd(
+        io, 1, "%.*s\n", len - start, str + start
+    );
+}
+
+static int
+dipshp_handle_dirname(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    if (argc != 2 || dipshp_is_help_arg(argv[1])) {
+        int ret = dipshp_write_to_command_fd(io, 2, DIPSHP_DIRNAME_USAGE);
+        if (status)
+            status->exit_code = !dipshp_is_help_arg(argv[argc > 1]);
+        return ret;
+    }
+    const char *str = argv[1];
+    int len = strlen(str);
+    while (len > 1 && '/' == str[len - 1])
+        --len;
+    while (len > 0 && '/' != str[len - 1])
+        --len;
+    if (!len)
+        return dipshp_write_to_command_fd(io, 1, ".\n");
+    while (len > 1 && '/' == str[len - 1])
+        --len;
+    return dipshp_write_fmt_to_command_fd(io, 1, "%.*s\n", len, str);
+}
+
+static int
+dipshp_command_status_to_exit_code(
+    const dipsh_command_status *status
+)
+{
+    if (!status->exited_normally)
+        return 1;
+    return status->exited_by_code 
+        ? status->exit_code 
+        : 128 + status->signal_num;
+}
+
+static int
+dipshp_wait_for_pid(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status,
+    int pid
+)
+{
+    dipsh_shell_state *state = dipsh_command_get_shell_state(command);
+    dipsh_command_status bg_status;
+    int waited_pid = dipsh_shell_state_wait_bg_command(state, pid, &bg_status);
+    if (-1 == waited_pid) {
+        if (-1 == pid) {
+            DIPSHP_PRINT_ERROR_TO_STDERR(
+                io, status, "wait: no background commands\n"
+            );
+        }
+        DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
+            io, status, 
+            "wait: pid %d is not a background command of this shell\n", pid
+        );
+    }
+    return dipshp_handle_exit_code_only(
+        command, status, dipshp_command_status_to_exit_code(&bg_status)
+    );
+}
+
+static int
+dipshp_handle_wait(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    if (argc == 2 && dipshp_is_help_arg(argv[1]))
+        return dipshp_write_to_command_fd(io, 2, DIPSHP_WAIT_USAGE);
+    dipsh_shell_state *state = dipsh_command_get_shell_state(command);
+    if (argc == 1) {
+        while (-1 != dipsh_shell_state_wait_bg_command(state, -1, NULL))
+            ;
+        return dipshp_handle_exit_code_only(command, status, 0);
+    }
+    if (argc == 2 && 0 == strcmp(argv[1], "-n"))
+        return dipshp_wait_for_pid(command, io, status, -1);
+
+    int ret = dipsh_handler_ok;
+    for (int i = 1; i < argc && dipsh_handler_ok == ret; ++i) {
+        char *endptr;
+        long pid = strtol(argv[i], &endptr, 10);
+        if (endptr == argv[i] || *endptr || pid <= 0) {
+            DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
+                io, status, "wait: %s: not a pid\n", argv[i]
+            );
+        }
+        ret = dipshp_wait_for_pid(command, io, status, pid);
+    }
+    return ret;
+}
+
 static void
-dipshp_make_redirs(
+dipshp_print_hash_entry(
+    const char *name,
+    const char *path,
+    unsigned long hits,
+    void *io
+)
+{
+    dipshp_write_fmt_to_command_fd(
+        io, 1, path ? "%4lu\t%s\n" : "%4lu\t%s (not found)\n",
+        hits, path ? path : name
+    );
+}
+
+static int
+dipshp_list_hash_entries(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int ret = dipshp_write_to_command_fd(io, 1, "hits\tcommand\n");
+    if (dipsh_handler_ok != ret)
+        return ret;
+    /* a failed write to an entry shows in the write after them */
+    dipsh_path_cache_for_each(dipshp_print_hash_entry, io);
+    dipsh_path_cache_stats stats;
+    dipsh_path_cache_get_stats(&stats);
+    return dipshp_write_fmt_to_command_fd(
+        io, 1, "cache: %lu hits, %lu misses\n", stats.hits, stats.misses
+    );
+}
+
+static int
+dipshp_handle_hash(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    if (argc == 2 && dipshp_is_help_arg(argv[1]))
+        return dipshp_write_to_command_fd(io, 2, DIPSHP_HASH_USAGE);
+    if (argc == 1)
+        return dipshp_list_hash_entries(command, io, status);
+
+    dipshp_handle_exit_code_only(command, status, 0);
+    int not_found = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-r")) {
+            dipsh_path_cache_reset();
+            continue;
+        }
+        int ret = dipsh_path_cache_add(argv[i]);
+        if (0 != ret) {
+            ret = dipshp_write_fmt_to_command_fd(
+                io, 2, "hash: %s: not found\n", argv[i]
+            );
+            if (dipsh_handler_ok != ret)
+                return ret;
+            not_found = 1;
+        }
+    }
+    if (status)
+        status->exit_code = not_found;
+    return dipsh_handler_ok;
+}
+
+/* returns -1 if a redirect can't be made, the ones made before stay */
+static int
+dipshp_apply_redirs(
     dipsh_command *command
 )
 {
@@ -237,57 +861,112 @@ dipshp_make_redirs(
 
         int fd_to_dup;
         if (redirs->redir.need_open_file)
-            fd_to_dup = dipshp_open_file_redir(&redirs->redir);
+            fd_to_dup = dipsh_redirect_open_file(&redirs->redir);
         else
             fd_to_dup = redirs->redir.inherited_fd;
-        int dup_ret = dup2(fd_to_dup, redirs->redir.fd);
-        if (-1 == dup_ret)
-            err(1, "%s: failure in dup2()", *dipsh_command_get_argv(command));
-        close(fd_to_dup);
+        if (-1 == fd_to_dup)
+            return -1;
+        /* the file may have been opened right at the target fd */
+        if (fd_to_dup != redirs->redir.fd) {
+            int dup_ret = dup2(fd_to_dup, redirs->redir.fd);
+            close(fd_to_dup);
+            if (-1 == dup_ret)
+                return -1;
+        }
         redirs = redirs->next;
     }
+    return 0;
 }
 
-static int
-dipshp_wait_for_signal(
+static void
+dipshp_make_redirs(
     dipsh_command *command
 )
 {
-    char dummy;
-    int wait_fd = dipsh_command_get_suspend_wait_fd(command);
-    return read(wait_fd, &dummy, 1);
-}
-
-static int
-dipshp_create_new_group()
-{
-    return setpgid(0, 0);
+    int ret = dipshp_apply_redirs(command);
+    if (-1 == ret)
+        err(1, "%s: can't redirect", *dipsh_command_get_argv(command));
 }
 
+/* what a forked child does before it runs the command itself */
 static void
-dipshp_execute_external_command(
+dipshp_prepare_forked_command(
     dipsh_command *command
 )
 {
     char **argv = dipsh_command_get_argv(command);
     const dipsh_command_traits *traits = dipsh_command_get_traits(command);
+    dipsh_event_loop_reset_after_fork();
     if (traits->run_in_separate_group) {
-         int ret = dipshp_create_new_group();
-         if (-1 == ret)
-             err(1, "%s: can't create a new group", argv[0]);
-         if (traits->will_wait_for_group_change) {
-             ret = dipsh_command_signal_group_change(command);
-             if (0 != ret)
-                 err(1, "%s: can't signal a group change", argv[0]);
-         }
+        int ret = setpgid(0, traits->process_group);
+        if (-1 == ret)
+            err(1, "%s: can't join the process group", argv[0]);
     }
     if (traits->suspend_after_fork) {
-        int ret = dipshp_wait_for_signal(command);
-        if (-1 == ret)
+        dipsh_release_barrier *barrier = 
+            dipsh_command_get_release_barrier(command);
+        int ret = barrier ? dipsh_release_barrier_wait(barrier) : 0;
+        if (0 != ret)
             err(1, "%s: can't wait for command starting", argv[0]);
     }
     dipshp_make_redirs(command);
-    execvp(argv[0], argv);
+}
+
+static void
+dipshp_execute_external_command(
+    dipsh_command *command,
+    const char *path
+)
+{
+    dipshp_prepare_forked_command(command);
+    dipsh_exec_command(path, dipsh_command_get_argv(command));
+}
+
+static void
+dipshp_set_child_group(
+    dipsh_command *command,
+    int pid
+)
+{
+    const dipsh_command_traits *traits = dipsh_command_get_traits(command);
+    if (traits->run_in_separate_group) {
+        /* the child makes the same call, so the group exists as soon as 
+         * either of them gets here; a failure means the child has already 
+         * joined it and exec'd */
+        int pgid = traits->process_group ? traits->process_group : pid;
+        setpgid(pid, pgid);
+    }
+}
+
+static int
+dipshp_fork_external_command(
+    dipsh_command *command,
+    const char *path,
+    int *pid
+)
+{
+    *pid = fork();
+    if (0 == *pid) {
+        dipshp_execute_external_command(command, path);
+        err(1, "%s: can't execute command", *dipsh_command_get_argv(command));
+    } else if (0 < *pid) {
+        dipshp_set_child_group(command, *pid);
+    }
+    return -1 == *pid ? dipsh_spawn_failed : dipsh_spawn_ok;
+}
+
+static void
+dipshp_set_spawn_failure_status(
+    dipsh_command *command
+)
+{
+    /* the same status a forked child reports when exec fails */
+    const dipsh_command_status status = {
+        .exited_normally = 1,
+        .exited_by_code = 1,
+        .exit_code = 1
+    };
+    dipsh_command_set_status(command, &status);
 }
 
 static int
@@ -295,27 +974,34 @@ dipshp_run_external_command(
     dipsh_command *command
 )
 {
-    int pid = fork();
+    int pid;
     char *command_name = *dipsh_command_get_argv(command);
     const dipsh_command_traits *traits = dipsh_command_get_traits(command);
-    if (0 == pid) {
-        dipshp_execute_external_command(command);
-        err(1, "%s: can't execute command", command_name);
-    } else if (0 < pid) {
-        dipsh_command_set_pid(command, pid);
-        const dipsh_command_status *status;
-        if (traits->execute_blocks) {
-            status = dipsh_wait_for_command(command);
-            if (!status) {
-                warn("%s: can't wait for the command", command_name);
-                return dipsh_handler_system_error;
-            }
-        }
+    const char *path = dipsh_path_cache_lookup(command_name);
+    int spawn_ret = path 
+        ? dipsh_spawn_command(command, path, &pid) 
+        : dipsh_spawn_failed;
+    if (dipsh_spawn_failed == spawn_ret) {
+        warn("%s: can't execute command", command_name);
+        dipshp_set_spawn_failure_status(command);
         return dipsh_handler_ok;
-    } else {
-        warn("%s: failure in fork()", command_name);
-        return dipsh_handler_system_error;
+    } else if (dipsh_spawn_unsupported == spawn_ret) {
+        spawn_ret = dipshp_fork_external_command(command, path, &pid);
+        if (dipsh_spawn_failed == spawn_ret) {
+            warn("%s: failure in fork()", command_name);
+            return dipsh_handler_system_error;
+        }
     }
+
+    dipsh_command_set_pid(command, pid);
+    if (traits->execute_blocks) {
+        const dipsh_command_status *status = dipsh_wait_for_command(command);
+        if (!status) {
+            warn("%s: can't wait for the command", command_name);
+            return dipsh_handler_system_error;
+        }
+    }
+    return dipsh_handler_ok;
 }
 
 static int
@@ -334,40 +1020,185 @@ dipshp_handle_external_command(
     return ret;
 }
 
+int
+dipsh_exec_in_shell(
+    dipsh_command *command,
+    int argv_offset
+)
+{
+    char **argv = dipsh_command_get_argv(command) + argv_offset;
+    const char *path = NULL;
+    if (*argv) {
+        path = dipsh_path_cache_lookup(*argv);
+        if (!path)
+            return 1;
+    }
+    /* whatever is buffered belongs to the old stdout */
+    fflush(stdout);
+    int ret = dipshp_apply_redirs(command);
+    if (-1 == ret || !*argv)
+        return ret;
+    dipsh_event_loop_reset_after_fork();
+    dipsh_exec_command(path, argv);
+    err(1, "%s: can't execute command", *argv);
+}
+
+static int
+dipshp_handle_exec(
+    dipsh_command *command,
+    dipsh_builtin_io *io,
+    dipsh_command_status *status
+)
+{
+    int argc = dipsh_command_get_argc(command);
+    char **argv = dipsh_command_get_argv(command);
+    if (argc == 2 && dipshp_is_help_arg(argv[1]))
+        return dipshp_write_to_command_fd(io, 2, DIPSHP_EXEC_USAGE);
+    int ret = dipsh_exec_in_shell(command, 1);
+    if (1 == ret) {
+        DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
+            io, status, "exec: %s: not found\n", argv[1]
+        );
+    } else if (-1 == ret) {
+        DIPSHP_PRINT_FMT_ERROR_TO_STDERR(
+            io, status, "exec: can't redirect: %s\n", strerror(errno)
+        );
+    }
+    return dipshp_handle_exit_code_only(command, status, 0);
+}
+
+typedef int (*dipshp_builtin)(
+    dipsh_command *, dipsh_builtin_io *, dipsh_command_status *
+);
+
 typedef struct dipshp_handler_traits
 {
     const char *name;
-    dipsh_command_handler handler;
+    dipshp_builtin handler;
+    int applies_redirs;     /* to the shell itself, no builtin I/O for them */
 }
 dipshp_handler_traits;
 
 static const dipshp_handler_traits
 dipshp_handlers[] = {
-    { "cd", dipshp_handle_cd },
-    { "true", dipshp_handle_true },
-    { "false", dipshp_handle_false },
-    { NULL, dipshp_handle_external_command }
+    { "cd", dipshp_handle_cd, 0 },
+    { "pwd", dipshp_handle_pwd, 0 },
+    { "echo", dipshp_handle_echo, 0 },
+    { "printf", dipshp_handle_printf, 0 },
+    { "test", dipshp_handle_test, 0 },
+    { "[", dipshp_handle_test, 0 },
+    { "sleep", dipshp_handle_sleep, 0 },
+    { "basename", dipshp_handle_basename, 0 },
+    { "dirname", dipshp_handle_dirname, 0 },
+    { "true", dipshp_handle_true, 0 },
+    { "false", dipshp_handle_false, 0 },
+    { "hash", dipshp_handle_hash, 0 },
+    { "wait", dipshp_handle_wait, 0 },
+    { "exec", dipshp_handle_exec, 1 },
+    { NULL, NULL, 0 }
 };
 
-dipsh_command_handler
-dipsh_get_handler_by_name(
+/* the names of dipshp_handlers interned on the first lookup, so that 
+ * command names are matched by their pointers; they are never released */
+static const char *
+dipshp_builtin_names[sizeof(dipshp_handlers) / sizeof(*dipshp_handlers)];
+
+static const dipshp_handler_traits *
+dipshp_find_builtin(
     const char *command_name
 )
 {
-    const dipshp_handler_traits *traits = dipshp_handlers;
-    while (traits->name) {
-        if (0 == strcmp(traits->name, command_name))
-            return traits->handler;
-        ++traits;
+    if (!command_name)
+        return NULL;
+    if (!dipshp_builtin_names[0]) {
+        for (int i = 0; dipshp_handlers[i].name; ++i) {
+            const char *name = dipshp_handlers[i].name;
+            dipshp_builtin_names[i] = dipsh_intern(name, strlen(name));
+        }
     }
-    return dipshp_handle_external_command;
+    for (int i = 0; dipshp_handlers[i].name; ++i) {
+        if (dipshp_builtin_names[i] == command_name)
+            return &dipshp_handlers[i];
+    }
+    return NULL;
+}
+
+/* runs a builtin in the shell with its redirections made through the 
+ * builtin I/O */
+static int
+dipshp_handle_builtin(
+    dipsh_command *command,
+    dipsh_command_status *status
+)
+{
+    const char *command_name = *dipsh_command_get_argv(command);
+    const dipshp_handler_traits *traits = dipshp_find_builtin(command_name);
+    status->exited_normally = 1;
+    status->exited_by_code = 1;
+    status->exit_code = 0;
+
+    dipsh_builtin_io io;
+    const dipsh_redirect_list *redirs = traits->applies_redirs
+        ? NULL
+        : dipsh_command_get_all_redirects(command);
+    if (-1 == dipsh_builtin_io_init(&io, redirs)) {
+        warn("%s: can't redirect", command_name);
+        status->exit_code = 1;
+        return dipsh_handler_ok;
+    }
+    int ret = traits->handler(command, &io, status);
+    if (DIPSHP_HANDLER_WRITE_FAILED == ret) {
+        warn("%s: writing to file failed", command_name);
+        status->exit_code = 1;
+        dipsh_builtin_io_destroy(&io);
+        return dipsh_handler_ok;
+    }
+    /* what is still in the buffer may fail to be written too */
+    if (-1 == dipsh_builtin_io_destroy(&io)) {
+        warn("%s: writing to file failed", command_name);
+        if (dipsh_handler_ok == ret && 0 == status->exit_code)
+            status->exit_code = 1;
+    }
+    return ret;
+}
+
+dipsh_command_handler
+dipsh_get_handler_by_name(
+    const char *command_name,
+    int *is_builtin
+)
+{
+    *is_builtin = NULL != dipshp_find_builtin(command_name);
+    return *is_builtin
+        ? dipshp_handle_builtin
+        : dipshp_handle_external_command;
 }
 
 int
-dipsh_has_builtin_handler(
-    const char *command_name
+dipsh_fork_builtin(
+    dipsh_command *command
 )
 {
-    return dipshp_handle_external_command != 
-        dipsh_get_handler_by_name(command_name);
+    char *command_name = *dipsh_command_get_argv(command);
+    /* whatever is buffered would be written twice otherwise */
+    fflush(stdout);
+    int pid = fork();
+    if (0 == pid) {
+        dipshp_prepare_forked_command(command);
+        /* the redirections are in place now, the handler must not make them 
+         * once again */
+        dipsh_command_clear_redirects(command);
+        dipsh_command_status status;
+        int ret = dipshp_handle_builtin(command, &status);
+        fflush(stdout);
+        _exit(dipsh_handler_ok == ret 
+            ? dipshp_command_status_to_exit_code(&status) 
+            : 1);
+    } else if (-1 == pid) {
+        warn("%s: failure in fork()", command_name);
+        return dipsh_handler_system_error;
+    }
+    dipshp_set_child_group(command, pid);
+    dipsh_command_set_pid(command, pid);
+    return dipsh_handler_ok;
 }
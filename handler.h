@@ -12,14 +12,30 @@ enum
     dipsh_handler_system_error
 };
 
+/* command_name must be interned (see intern.h); *is_builtin is set to 
+ * whether the command is run by the shell itself */
 dipsh_command_handler
 dipsh_get_handler_by_name(
-    const char *command_name
+    const char *command_name,
+    int *is_builtin
 );
 
+/* applies the command's redirections to the shell itself and replaces the 
+ * shell with the command, argv starting from argv_offset; if there is no 
+ * command, just the redirections are applied. Returns 0 in the latter case, 
+ * 1 if the command can't be found (the shell is left intact then), or -1 
+ * with errno set if some redirection fails */
 int
-dipsh_has_builtin_handler(
-    const char *command_name
+dipsh_exec_in_shell(
+    dipsh_command *command,
+    int argv_offset
+);
+
+/* runs a builtin in a child process, the way an external command would be 
+ * run; the command's pid is set, its status is left to be waited for */
+int
+dipsh_fork_builtin(
+    dipsh_command *command
 );
 
 #endif /* _DIPSH_HANDLER_H_ */
@@ -0,0 +1,257 @@
+#include "intern.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#define DIPSHP_INTERN_INITIAL_BUCKETS 256
+
+typedef struct dipshp_intern_entry_tag
+{
+    struct dipshp_intern_entry_tag *next;
+    unsigned hash;
+    int refs;
+    int len;
+    char str[];
+}
+dipshp_intern_entry;
+
+static struct
+{
+    dipshp_intern_entry **buckets;
+    int buckets_len;
+    int entries_len;
+
+    unsigned long lookups;
+    unsigned long hits;
+    long bytes;
+
+    int is_shared;
+    int is_fork_handled;
+    pthread_mutex_t lock;
+}
+dipshp_table = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void
+dipshp_lock()
+{
+    if (dipshp_table.is_shared)
+        pthread_mutex_lock(&dipshp_table.lock);
+}
+
+static void
+dipshp_unlock()
+{
+    if (dipshp_table.is_shared)
+        pthread_mutex_unlock(&dipshp_table.lock);
+}
+
+/* the lock is held across a fork, so that the child doesn't get the table
+ * halfway through a change */
+static void
+dipshp_unlock_in_child()
+{
+    dipshp_unlock();
+    dipshp_table.is_shared = 0;
+}
+
+void
+dipsh_intern_set_shared(
+    int is_shared
+)
+{
+    if (is_shared && !dipshp_table.is_fork_handled) {
+        pthread_atfork(dipshp_lock, dipshp_unlock, dipshp_unlock_in_child);
+        dipshp_table.is_fork_handled = 1;
+    }
+    dipshp_table.is_shared = is_shared;
+}
+
+static unsigned
+dipshp_hash_chars(
+    const char *str,
+    int len
+)
+{
+    unsigned hash = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static dipshp_intern_entry *
+dipshp_entry_of(
+    const char *interned
+)
+{
+    return (dipshp_intern_entry *)
+        (interned - offsetof(dipshp_intern_entry, str));
+}
+
+static dipshp_intern_entry **
+dipshp_find_entry(
+    const char *str,
+    int len,
+    unsigned hash
+)
+{
+    if (!dipshp_table.buckets_len)
+        return NULL;
+    dipshp_intern_entry **entry =
+        &dipshp_table.buckets[hash & (dipshp_table.buckets_len - 1)];
+    for (; *entry; entry = &(*entry)->next) {
+        if ((*entry)->hash == hash && (*entry)->len == len &&
+            0 == memcmp((*entry)->str, str, len)) {
+            return entry;
+        }
+    }
+    return entry;
+}
+
+static void
+dipshp_grow_buckets()
+{
+    int new_len = dipshp_table.buckets_len
+        ? 2 * dipshp_table.buckets_len
+        : DIPSHP_INTERN_INITIAL_BUCKETS;
+    dipshp_intern_entry **new_buckets =
+        calloc(sizeof(dipshp_intern_entry *), new_len);
+    if (!new_buckets)
+        return;
+    for (int i = 0; i < dipshp_table.buckets_len; ++i) {
+        dipshp_intern_entry *entry = dipshp_table.buckets[i];
+        while (entry) {
+            dipshp_intern_entry *temp = entry;
+            entry = entry->next;
+            dipshp_intern_entry **bucket =
+                &new_buckets[temp->hash & (new_len - 1)];
+            temp->next = *bucket;
+            *bucket = temp;
+        }
+    }
+    free(dipshp_table.buckets);
+    dipshp_table.buckets = new_buckets;
+    dipshp_table.buckets_len = new_len;
+}
+
+static const char *
+dipshp_intern_hashed(
+    const char *str,
+    int len,
+    unsigned hash
+)
+{
+    if (dipshp_table.entries_len + 1 > 3 * dipshp_table.buckets_len / 4)
+        dipshp_grow_buckets();
+    dipshp_intern_entry **place = dipshp_find_entry(str, len, hash);
+    ++dipshp_table.lookups;
+    if (!place)
+        return NULL;
+    if (*place) {
+        ++dipshp_table.hits;
+        ++(*place)->refs;
+        return (*place)->str;
+    }
+    dipshp_intern_entry *entry = malloc(sizeof(*entry) + len + 1);
+    if (!entry)
+        return NULL;
+    entry->next = NULL;
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->len = len;
+    memcpy(entry->str, str, len);
+    entry->str[len] = '\0';
+    *place = entry;
+    ++dipshp_table.entries_len;
+    dipshp_table.bytes += len + 1;
+    return entry->str;
+}
+
+const char *
+dipsh_intern(
+    const char *str,
+    int len
+)
+{
+    unsigned hash = dipshp_hash_chars(str, len);
+    dipshp_lock();
+    const char *interned = dipshp_intern_hashed(str, len, hash);
+    dipshp_unlock();
+    return interned;
+}
+
+const char *
+dipsh_intern_find(
+    const char *str,
+    int len
+)
+{
+    unsigned hash = dipshp_hash_chars(str, len);
+    dipshp_lock();
+    dipshp_intern_entry **entry = dipshp_find_entry(str, len, hash);
+    const char *interned = entry && *entry ? (*entry)->str : NULL;
+    dipshp_unlock();
+    return interned;
+}
+
+const char *
+dipsh_intern_ref(
+    const char *interned
+)
+{
+    dipshp_lock();
+    ++dipshp_entry_of(interned)->refs;
+    dipshp_unlock();
+    return interned;
+}
+
+void
+dipsh_intern_release(
+    const char *interned
+)
+{
+    dipshp_intern_entry *entry = dipshp_entry_of(interned);
+    dipshp_lock();
+    if (--entry->refs) {
+        dipshp_unlock();
+        return;
+    }
+    dipshp_intern_entry **place =
+        dipshp_find_entry(entry->str, entry->len, entry->hash);
+    *place = entry->next;
+    --dipshp_table.entries_len;
+    dipshp_table.bytes -= entry->len + 1;
+    dipshp_unlock();
+    free(entry);
+}
+
+unsigned
+dipsh_intern_hash(
+    const char *interned
+)
+{
+    return dipshp_entry_of(interned)->hash;
+}
+
+int
+dipsh_intern_length(
+    const char *interned
+)
+{
+    return dipshp_entry_of(interned)->len;
+}
+
+void
+dipsh_intern_get_stats(
+    dipsh_intern_stats *stats
+)
+{
+    dipshp_lock();
+    stats->lookups = dipshp_table.lookups;
+    stats->hits = dipshp_table.hits;
+    stats->strings = dipshp_table.entries_len;
+    stats->bytes = dipshp_table.bytes;
+    dipshp_unlock();
+}
@@ -0,0 +1,70 @@
+#ifndef _DIPSH_INTERN_H_
+#define _DIPSH_INTERN_H_
+
+/* shell-wide table of interned strings: every string is stored once, so
+ * interned strings are equal only if their pointers are. The lexer interns
+ * the words it reads, and so the same command names and arguments repeated
+ * over a script share their memory, which is freed once the last reference
+ * to a string is released */
+
+/* returns the interned string with the len chars at str, adding a
+ * reference to it; NULL if there is no memory */
+const char *
+dipsh_intern(
+    const char *str,
+    int len
+);
+
+/* the same, with no reference added; NULL if str is not interned */
+const char *
+dipsh_intern_find(
+    const char *str,
+    int len
+);
+
+/* adds a reference to an interned string, returns it */
+const char *
+dipsh_intern_ref(
+    const char *interned
+);
+
+void
+dipsh_intern_release(
+    const char *interned
+);
+
+/* while the table is shared, by the threads reading a script (see
+ * shell_modes.c), every change to it is made under a lock; it must be set
+ * and unset with no other threads around. A child forked meanwhile has the
+ * table to itself, unshared */
+void
+dipsh_intern_set_shared(
+    int is_shared
+);
+
+/* the hash the string has been interned with */
+unsigned
+dipsh_intern_hash(
+    const char *interned
+);
+
+int
+dipsh_intern_length(
+    const char *interned
+);
+
+typedef struct dipsh_intern_stats_tag
+{
+    unsigned long lookups;
+    unsigned long hits;     /* lookups that have found the string */
+    int strings;
+    long bytes;             /* of the strings themselves */
+}
+dipsh_intern_stats;
+
+void
+dipsh_intern_get_stats(
+    dipsh_intern_stats *stats
+);
+
+#endif /* _DIPSH_INTERN_H_ */
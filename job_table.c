@@ -0,0 +1,391 @@
+#include "job_table.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define DIPSHP_JOBS_PER_CHUNK 256
+#define DIPSHP_INITIAL_BUCKETS 64
+#define DIPSHP_INITIAL_PROCS 64
+
+struct dipsh_job_status_slot_tag
+{
+    int written;
+    dipsh_command_status status;
+};
+
+struct dipsh_job_proc_tag
+{
+    int pid;        /* 0 for a free entry */
+    int job_idx;
+    int next_by_pid;
+    int next_in_job;
+};
+
+void
+dipsh_job_table_init(
+    dipsh_job_table *table
+)
+{
+    table->chunks = NULL;
+    table->status_pages = NULL;
+    table->chunks_len = 0;
+    table->procs = NULL;
+    table->procs_cap = 0;
+    table->procs_free_head = -1;
+    table->procs_len = 0;
+    table->buckets = NULL;
+    table->buckets_len = 0;
+    table->running_len = 0;
+    table->free_head = -1;
+    table->finished_head = -1;
+    table->finished_tail = -1;
+}
+
+void
+dipsh_job_table_destroy(
+    dipsh_job_table *table
+)
+{
+    for (int i = 0; i < table->chunks_len; ++i) {
+        free(table->chunks[i]);
+        munmap(
+            table->status_pages[i],
+            DIPSHP_JOBS_PER_CHUNK * sizeof(dipsh_job_status_slot)
+        );
+    }
+    free(table->chunks);
+    free(table->status_pages);
+    free(table->procs);
+    free(table->buckets);
+    dipsh_job_table_init(table);
+}
+
+static dipsh_job *
+dipshp_job_at(
+    const dipsh_job_table *table,
+    int idx
+)
+{
+    return &table->chunks[idx / DIPSHP_JOBS_PER_CHUNK]
+        [idx % DIPSHP_JOBS_PER_CHUNK];
+}
+
+static int
+dipshp_add_chunk(
+    dipsh_job_table *table
+)
+{
+    int new_len = table->chunks_len + 1;
+    dipsh_job **new_chunks =
+        realloc(table->chunks, new_len * sizeof(dipsh_job *));
+    if (!new_chunks)
+        return 1;
+    table->chunks = new_chunks;
+    dipsh_job_status_slot **new_pages =
+        realloc(table->status_pages, new_len * sizeof(dipsh_job_status_slot *));
+    if (!new_pages)
+        return 1;
+    table->status_pages = new_pages;
+
+    dipsh_job *chunk = calloc(sizeof(dipsh_job), DIPSHP_JOBS_PER_CHUNK);
+    if (!chunk)
+        return 1;
+    void *page = mmap(
+        NULL, DIPSHP_JOBS_PER_CHUNK * sizeof(dipsh_job_status_slot),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0
+    );
+    if (MAP_FAILED == page) {
+        free(chunk);
+        return 1;
+    }
+    table->chunks[table->chunks_len] = chunk;
+    table->status_pages[table->chunks_len] = page;
+    int first_idx = table->chunks_len * DIPSHP_JOBS_PER_CHUNK;
+    /* lower ids go first */
+    for (int i = DIPSHP_JOBS_PER_CHUNK - 1; i >= 0; --i) {
+        chunk[i].id = first_idx + i + 1;
+        chunk[i].next = table->free_head;
+        table->free_head = first_idx + i;
+    }
+    table->chunks_len = new_len;
+    return 0;
+}
+
+dipsh_job *
+dipsh_job_table_new_job(
+    dipsh_job_table *table
+)
+{
+    if (-1 == table->free_head && 0 != dipshp_add_chunk(table))
+        return NULL;
+    dipsh_job *job = dipshp_job_at(table, table->free_head);
+    table->free_head = job->next;
+    job->pid = 0;
+    job->finished = 0;
+    job->last_pid = 0;
+    job->running_len = 0;
+    job->first_proc = -1;
+    job->prev = -1;
+    job->next = -1;
+    dipsh_job_table_get_status_slot(table, job)->written = 0;
+    return job;
+}
+
+static int *
+dipshp_get_bucket(
+    const dipsh_job_table *table,
+    int pid
+)
+{
+    unsigned hash = (unsigned)pid * 2654435761u;
+    return &table->buckets[hash & (table->buckets_len - 1)];
+}
+
+static int
+dipshp_grow_buckets(
+    dipsh_job_table *table
+)
+{
+    int new_len = table->buckets_len
+        ? 2 * table->buckets_len
+        : DIPSHP_INITIAL_BUCKETS;
+    int *new_buckets = malloc(new_len * sizeof(int));
+    if (!new_buckets)
+        return 1;
+    for (int i = 0; i < new_len; ++i)
+        new_buckets[i] = -1;
+    free(table->buckets);
+    table->buckets = new_buckets;
+    table->buckets_len = new_len;
+    for (int i = 0; i < table->procs_cap; ++i) {
+        dipsh_job_proc *proc = &table->procs[i];
+        if (!proc->pid)
+            continue;
+        int *bucket = dipshp_get_bucket(table, proc->pid);
+        proc->next_by_pid = *bucket;
+        *bucket = i;
+    }
+    return 0;
+}
+
+static int
+dipshp_grow_procs(
+    dipsh_job_table *table
+)
+{
+    int new_cap = table->procs_cap
+        ? 2 * table->procs_cap
+        : DIPSHP_INITIAL_PROCS;
+    dipsh_job_proc *new_procs =
+        realloc(table->procs, new_cap * sizeof(dipsh_job_proc));
+    if (!new_procs)
+        return 1;
+    table->procs = new_procs;
+    for (int i = new_cap - 1; i >= table->procs_cap; --i) {
+        new_procs[i].pid = 0;
+        new_procs[i].next_in_job = table->procs_free_head;
+        table->procs_free_head = i;
+    }
+    table->procs_cap = new_cap;
+    return 0;
+}
+
+int
+dipsh_job_table_add_pid(
+    dipsh_job_table *table,
+    dipsh_job *job,
+    int pid
+)
+{
+    if (table->procs_len + 1 > 3 * table->buckets_len / 4) {
+        int ret = dipshp_grow_buckets(table);
+        if (0 != ret && !table->buckets_len)
+            return 1;
+    }
+    if (-1 == table->procs_free_head && 0 != dipshp_grow_procs(table))
+        return 1;
+    int proc_idx = table->procs_free_head;
+    dipsh_job_proc *proc = &table->procs[proc_idx];
+    table->procs_free_head = proc->next_in_job;
+    ++table->procs_len;
+
+    proc->pid = pid;
+    proc->job_idx = job->id - 1;
+    int *bucket = dipshp_get_bucket(table, pid);
+    proc->next_by_pid = *bucket;
+    *bucket = proc_idx;
+    proc->next_in_job = job->first_proc;
+    job->first_proc = proc_idx;
+
+    if (!job->pid)
+        job->pid = pid;
+    if (!job->running_len)
+        ++table->running_len;
+    ++job->running_len;
+    job->last_pid = pid;
+    return 0;
+}
+
+void
+dipsh_job_table_set_failed_last(
+    dipsh_job *job,
+    const dipsh_command_status *status
+)
+{
+    job->status = *status;
+    job->last_pid = -1;
+}
+
+static dipsh_job_proc *
+dipshp_find_proc(
+    const dipsh_job_table *table,
+    int pid
+)
+{
+    if (!table->buckets_len || pid <= 0)
+        return NULL;
+    int idx = *dipshp_get_bucket(table, pid);
+    while (-1 != idx) {
+        dipsh_job_proc *proc = &table->procs[idx];
+        if (proc->pid == pid)
+            return proc;
+        idx = proc->next_by_pid;
+    }
+    return NULL;
+}
+
+dipsh_job *
+dipsh_job_table_find_by_pid(
+    const dipsh_job_table *table,
+    int pid
+)
+{
+    const dipsh_job_proc *proc = dipshp_find_proc(table, pid);
+    return proc ? dipshp_job_at(table, proc->job_idx) : NULL;
+}
+
+static void
+dipshp_remove_proc(
+    dipsh_job_table *table,
+    int proc_idx
+)
+{
+    dipsh_job_proc *proc = &table->procs[proc_idx];
+    int *idx = dipshp_get_bucket(table, proc->pid);
+    while (*idx != proc_idx)
+        idx = &table->procs[*idx].next_by_pid;
+    *idx = proc->next_by_pid;
+    proc->pid = 0;
+    proc->next_in_job = table->procs_free_head;
+    table->procs_free_head = proc_idx;
+    --table->procs_len;
+}
+
+static void
+dipshp_unlink_finished(
+    dipsh_job_table *table,
+    dipsh_job *job
+)
+{
+    if (-1 != job->prev)
+        dipshp_job_at(table, job->prev)->next = job->next;
+    else
+        table->finished_head = job->next;
+    if (-1 != job->next)
+        dipshp_job_at(table, job->next)->prev = job->prev;
+    else
+        table->finished_tail = job->prev;
+}
+
+void
+dipsh_job_table_remove(
+    dipsh_job_table *table,
+    dipsh_job *job
+)
+{
+    while (-1 != job->first_proc) {
+        int proc_idx = job->first_proc;
+        job->first_proc = table->procs[proc_idx].next_in_job;
+        dipshp_remove_proc(table, proc_idx);
+    }
+    if (job->finished)
+        dipshp_unlink_finished(table, job);
+    else if (job->running_len)
+        --table->running_len;
+    job->pid = 0;
+    job->finished = 0;
+    job->next = table->free_head;
+    table->free_head = job->id - 1;
+}
+
+dipsh_job_status_slot *
+dipsh_job_table_get_status_slot(
+    const dipsh_job_table *table,
+    const dipsh_job *job
+)
+{
+    int idx = job->id - 1;
+    return &table->status_pages[idx / DIPSHP_JOBS_PER_CHUNK]
+        [idx % DIPSHP_JOBS_PER_CHUNK];
+}
+
+void
+dipsh_job_status_slot_write(
+    dipsh_job_status_slot *slot,
+    const dipsh_command_status *status
+)
+{
+    slot->status = *status;
+    slot->written = 1;
+}
+
+dipsh_job *
+dipsh_job_table_mark_reaped(
+    dipsh_job_table *table,
+    int pid,
+    int wait_status
+)
+{
+    dipsh_job *job = dipsh_job_table_find_by_pid(table, pid);
+    if (!job || job->finished)
+        return NULL;
+    if (job->last_pid == pid) {
+        /* the process is reaped already, so whatever it has written is 
+         * there */
+        const dipsh_job_status_slot *slot =
+            dipsh_job_table_get_status_slot(table, job);
+        if (slot->written)
+            job->status = slot->status;
+        else
+            dipsh_wait_status_to_command_status(1, wait_status, &job->status);
+    }
+    if (0 != --job->running_len)
+        return job;
+    job->finished = 1;
+    --table->running_len;
+    job->next = -1;
+    job->prev = table->finished_tail;
+    if (-1 != table->finished_tail)
+        dipshp_job_at(table, table->finished_tail)->next = job->id - 1;
+    else
+        table->finished_head = job->id - 1;
+    table->finished_tail = job->id - 1;
+    return job;
+}
+
+dipsh_job *
+dipsh_job_table_first_finished(
+    const dipsh_job_table *table
+)
+{
+    return -1 != table->finished_head
+        ? dipshp_job_at(table, table->finished_head)
+        : NULL;
+}
+
+int
+dipsh_job_table_get_running_count(
+    const dipsh_job_table *table
+)
+{
+    return table->running_len;
+}
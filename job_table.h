@@ -0,0 +1,138 @@
+#ifndef _DIPSH_JOB_TABLE_H_
+#define _DIPSH_JOB_TABLE_H_
+
+#include "command.h"
+
+/* background jobs of the shell: jobs live in fixed-size chunks, so pointers
+ * to them stay valid while the table grows. A job is made of one or more 
+ * processes (a subshell, or the commands of a pipeline), which are indexed 
+ * by pid with a hash table. Every chunk has a page of status slots shared 
+ * with the forked children (MAP_SHARED), which is where a subshell leaves 
+ * its last status for the shell to pick up when the subshell is reaped; so 
+ * the table takes no fds no matter how many jobs there are */
+
+typedef struct dipsh_job_status_slot_tag dipsh_job_status_slot;
+
+typedef struct dipsh_job_tag
+{
+    int id;         /* 1-based, stable while the job is in the table */
+    int pid;        /* the first process, 0 till the job has been started */
+    int finished;
+    /* the status of the last process (the job's status), or the one set 
+     * beforehand if the last process couldn't be started */
+    dipsh_command_status status;
+
+    /* the rest is the table's business */
+    int last_pid;
+    int running_len;
+    int first_proc;
+    int prev;
+    int next;
+}
+dipsh_job;
+
+typedef struct dipsh_job_proc_tag dipsh_job_proc;
+
+typedef struct dipsh_job_table_tag
+{
+    dipsh_job **chunks;
+    dipsh_job_status_slot **status_pages;
+    int chunks_len;
+
+    dipsh_job_proc *procs;
+    int procs_cap;
+    int procs_free_head;
+    int procs_len;
+    int *buckets;   /* process indices by pid */
+    int buckets_len;
+
+    int running_len;
+    int free_head;
+    /* reaped, but not reported or waited for yet, the oldest first */
+    int finished_head;
+    int finished_tail;
+}
+dipsh_job_table;
+
+void
+dipsh_job_table_init(
+    dipsh_job_table *table
+);
+
+void
+dipsh_job_table_destroy(
+    dipsh_job_table *table
+);
+
+/* reserves a job along with its status slot, returns NULL on failure */
+dipsh_job *
+dipsh_job_table_new_job(
+    dipsh_job_table *table
+);
+
+/* adds a started process to the job, the last one added gives the job its 
+ * status */
+int
+dipsh_job_table_add_pid(
+    dipsh_job_table *table,
+    dipsh_job *job,
+    int pid
+);
+
+/* the job's last process couldn't be started and status is its status, 
+ * which the processes added before it don't override as they are reaped */
+void
+dipsh_job_table_set_failed_last(
+    dipsh_job *job,
+    const dipsh_command_status *status
+);
+
+/* drops the job from the table, whatever state it is in */
+void
+dipsh_job_table_remove(
+    dipsh_job_table *table,
+    dipsh_job *job
+);
+
+dipsh_job *
+dipsh_job_table_find_by_pid(
+    const dipsh_job_table *table,
+    int pid
+);
+
+dipsh_job_status_slot *
+dipsh_job_table_get_status_slot(
+    const dipsh_job_table *table,
+    const dipsh_job *job
+);
+
+/* to be called by the job's process right before it exits */
+void
+dipsh_job_status_slot_write(
+    dipsh_job_status_slot *slot,
+    const dipsh_command_status *status
+);
+
+/* to be called for every reaped process, returns the job it belongs to 
+ * (NULL if none); the job is queued as finished once all its processes are 
+ * reaped. The last process's status is taken from the job's slot, or from 
+ * the wait status if nothing has been written there */
+dipsh_job *
+dipsh_job_table_mark_reaped(
+    dipsh_job_table *table,
+    int pid,
+    int wait_status
+);
+
+/* the job finished the earliest, NULL if there are none */
+dipsh_job *
+dipsh_job_table_first_finished(
+    const dipsh_job_table *table
+);
+
+int
+dipsh_job_table_get_running_count(
+    const dipsh_job_table *table
+);
+
+#endif /* _DIPSH_JOB_TABLE_H_ */
@@ -1,4 +1,6 @@
 #include "lexer.h"
+#include "lexer_index.h"
+#include "intern.h"
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
@@ -22,9 +24,20 @@ dipshp_parse_state;
 
 struct dipsh_lexer_state_tag
 {
+    /* the word being read: a slice of the input till it has to be rewritten
+     * (quotes, escapes) or outlives the input, then a copy in word */
     char *word;
     int word_length;
     int word_capacity;
+    int word_is_slice;
+    int slice_start;
+    /* what dipsh_lexer_scan is going through, NULL for single chars */
+    const char *input;
+    int input_pos;
+    /* the index of the input's chars from block_start on, -1 if none */
+    dipsh_lexer_block block;
+    int block_start;
+    int block_len;
     int line;
     char *error;
     dipshp_parse_state parse_state;
@@ -59,7 +72,7 @@ dipshp_is_delim(
 }
 
 #define DIPSHP_SET_STATE_ERROR(st, fmt, ...) \
-    asprintf(&st->error, fmt, __VA_ARGS__)
+    (free(st->error), asprintf(&st->error, fmt, __VA_ARGS__))
 #define DIPSHP_UNEXPECTED_CHAR  "unexpected character: '%d'"
 #define DIPSHP_UNEXPECTED_STATE "unexpected state '%d'"
 
@@ -71,6 +84,12 @@ dipsh_lexer_state_init()
     st->word = calloc(1, 1);
     st->word_length = 0;
     st->word_capacity = 1;
+    st->word_is_slice = 0;
+    st->slice_start = 0;
+    st->input = NULL;
+    st->input_pos = 0;
+    st->block_start = -1;
+    st->block_len = 0;
     st->parse_state = dipshp_waiting_token;
     st->error = NULL;
     st->quotes_on = 0;
@@ -87,6 +106,23 @@ dipsh_lexer_state_destroy(
     free(state);
 }
 
+void
+dipsh_lexer_state_reset(
+    dipsh_lexer_state *state
+)
+{
+    state->word_length = 0;
+    state->word[0] = '\0';
+    state->word_is_slice = 0;
+    state->input = NULL;
+    state->block_start = -1;
+    state->line = 1;
+    free(state->error);
+    state->error = NULL;
+    state->parse_state = dipshp_waiting_token;
+    state->quotes_on = 0;
+}
+
 int
 dipsh_lexer_state_is_idle(
     const dipsh_lexer_state *state
@@ -112,23 +148,95 @@ dipsh_lexer_state_get_error(
 }
 
 static void
-dipshp_append_character(
+dipshp_reserve_word(
     dipsh_lexer_state *state,
-    int c
+    int length
+)
+{
+    if (length + 1 <= state->word_capacity)
+        return;
+    int new_capacity = state->word_capacity;
+    while (length + 1 > new_capacity)
+        new_capacity *= 2;
+    char *new_buf = malloc(new_capacity);
+    memcpy(new_buf, state->word, state->word_length + 1);
+    free(state->word);
+    state->word = new_buf;
+    state->word_capacity = new_capacity;
+}
+
+/* copies the word out of the input */
+static void
+dipshp_unslice_word(
+    dipsh_lexer_state *state
 )
 {
-    if (2 + state->word_length > state->word_capacity) {
-        char *new_buf = malloc(2 * state->word_capacity);
-        state->word_capacity *= 2;
-        memcpy(new_buf, state->word, state->word_length + 1);
-        free(state->word);
-        state->word = new_buf;
+    if (!state->word_is_slice)
+        return;
+    state->word_is_slice = 0;
+    int length = state->word_length;
+    state->word_length = 0;
+    dipshp_reserve_word(state, length);
+    memcpy(state->word, state->input + state->slice_start, length);
+    state->word_length = length;
+    state->word[length] = '\0';
+}
+
+static void
+dipshp_append_chars(
+    dipsh_lexer_state *state,
+    const char *chars,
+    int count
+)
+{
+    /* the chars are the input's current ones, so a slice goes on while 
+     * nothing is skipped between its chars */
+    if (state->input && !state->word_length) {
+        state->word_is_slice = 1;
+        state->slice_start = state->input_pos;
     }
-    ++state->word_length;
-    state->word[state->word_length - 1] = c;
+    if (state->word_is_slice) {
+        if (state->slice_start + state->word_length == state->input_pos) {
+            state->word_length += count;
+            return;
+        }
+        dipshp_unslice_word(state);
+    }
+    dipshp_reserve_word(state, state->word_length + count);
+    memcpy(state->word + state->word_length, chars, count);
+    state->word_length += count;
     state->word[state->word_length] = '\0';
 }
 
+static void
+dipshp_append_character(
+    dipsh_lexer_state *state,
+    int c
+)
+{
+    char ch = c;
+    dipshp_append_chars(state, &ch, 1);
+}
+
+static const char *
+dipshp_word_chars(
+    const dipsh_lexer_state *state
+)
+{
+    return state->word_is_slice 
+        ? state->input + state->slice_start 
+        : state->word;
+}
+
+int
+dipsh_lexer_state_is_line_end(
+    const dipsh_lexer_state *state
+)
+{
+    return dipshp_read_non_ws_delim == state->parse_state &&
+        '\n' == *dipshp_word_chars(state);
+}
+
 static void
 dipshp_flush_token(
     dipsh_lexer_state *state,
@@ -136,7 +244,21 @@ dipshp_flush_token(
     dipsh_token_type type
 )
 {
-    dipsh_token_init(token, type, state->line, state->word);
+    /* the same words come over and over again, so they are shared; if 
+     * there is no memory for that, the token gets the word on its own */
+    const char *interned = 
+        dipsh_intern(dipshp_word_chars(state), state->word_length);
+    if (interned) {
+        dipsh_token_init_interned(token, type, state->line, interned);
+    } else if (state->word_is_slice) {
+        dipsh_token_init_slice(
+            token, type, state->line, 
+            state->input + state->slice_start, state->word_length
+        );
+    } else {
+        dipsh_token_init(token, type, state->line, state->word);
+    }
+    state->word_is_slice = 0;
     state->word_length = 0;
     state->word[0] = '\0';
 }
@@ -299,6 +421,9 @@ dipshp_handle_flushing_state(
         dipshp_append_character(state, c);
         state->parse_state = dipshp_reading_word;
     } else {
+        /* no token comes with an error, nor does the wrong char start one */
+        dipsh_token_clean(token);
+        state->parse_state = dipshp_waiting_token;
         DIPSHP_SET_STATE_ERROR(state, DIPSHP_UNEXPECTED_CHAR, c);
         return dipsh_lexer_error;
     }
@@ -312,13 +437,14 @@ dipshp_handle_read_non_ws_delim(
     dipsh_token *token
 )
 {
-    if (('&' == c || '|' == c || '>' == c) && (*state->word == c)) {
+    char delim = *dipshp_word_chars(state);
+    if (('&' == c || '|' == c || '>' == c) && delim == c) {
         dipshp_append_character(state, c);
         state->parse_state = dipshp_read_dbl_amp_bar_gt;
         return dipsh_lexer_no_token;
     } 
     return dipshp_handle_flushing_state(
-        state, c, token, dipsh_delim_to_type(*state->word)
+        state, c, token, dipsh_delim_to_type(delim)
     );
 }
 
@@ -330,7 +456,7 @@ dipshp_handle_read_dbl_amp_bar_gt(
 )
 {
     return dipshp_handle_flushing_state(
-        state, c, token, dipsh_dbl_delim_to_type(state->word)
+        state, c, token, dipsh_dbl_delim_to_type(*dipshp_word_chars(state))
     );
 }
 
@@ -341,7 +467,7 @@ dipshp_handle_read_digits_lt_gt(
     dipsh_token *token
 )
 {
-    int last_char = state->word[strlen(state->word) - 1];
+    int last_char = dipshp_word_chars(state)[state->word_length - 1];
     if ('>' == c && '>' == last_char) {
         dipshp_append_character(state, c);
         state->parse_state = dipshp_read_digits_dbl_gt;
@@ -365,8 +491,8 @@ dipshp_handle_read_digits_dbl_gt(
     );
 }
 
-int
-dipsh_lexer_next_token(
+static int
+dipshp_accept_char(
     dipsh_lexer_state *state,
     int c,
     dipsh_token *token
@@ -411,154 +537,161 @@ dipsh_lexer_next_token(
 }
 
 int
-dipsh_tokenize_error_set(
-    dipsh_tokenize_error *err,
-    int line,
-    const char *format, ...
+dipsh_lexer_next_token(
+    dipsh_lexer_state *state,
+    int c,
+    dipsh_token *token
 )
 {
-    if (!err)
-        return 1;
-    err->line = line;
-    
-    va_list ap;
-    va_start(ap, format);
-    int ret = vasprintf(&err->message, format, ap);
-    va_end(ap);
-    if (-1 == ret) { 
-        err->message = NULL;
-        return 1;
-    }
-    return 0;
+    state->input = NULL;
+    state->block_start = -1;
+    return dipshp_accept_char(state, c, token);
 }
 
-void
-dipsh_tokenize_error_clean(
-    dipsh_tokenize_error *err
+/* the number of chars from the input's current one on that take the state 
+ * machine nowhere: whitespace while waiting for a token, and chars that 
+ * aren't structural (see lexer_index.h) while reading a word; 0 for any 
+ * other state */
+static int
+dipshp_plain_run(
+    dipsh_lexer_state *state,
+    int len
 )
 {
-    free(err->message);
+    if (dipshp_waiting_token != state->parse_state &&
+        dipshp_reading_word != state->parse_state &&
+        dipshp_reading_quoted_word != state->parse_state) {
+        return 0;
+    }
+    int pos = state->input_pos;
+    if (-1 == state->block_start ||
+        pos >= state->block_start + state->block_len) {
+        int block_len = len - pos < DIPSH_LEXER_BLOCK_SIZE
+            ? len - pos
+            : DIPSH_LEXER_BLOCK_SIZE;
+        dipsh_lexer_index_block(
+            state->input + pos, block_len, 0, state->quotes_on, &state->block
+        );
+        state->block_start = pos;
+        state->block_len = block_len;
+    }
+    uint64_t stops = dipshp_waiting_token == state->parse_state
+        ? ~state->block.ws
+        : state->block.structural;
+    int offset = pos - state->block_start;
+    stops >>= offset;
+    return stops ? __builtin_ctzll(stops) : state->block_len - offset;
 }
 
 static void
-dipshp_insert_new_token(
-    dipsh_token_list **first, 
-    dipsh_token_list **last,
-    dipsh_token_list *new_token
+dipshp_accept_run(
+    dipsh_lexer_state *state,
+    int run
 )
 {
-    if (!*last) {
-        *first = new_token;
-    } else {
-        (*last)->next = new_token;
-    }
-    new_token->next = NULL;
-    *last = new_token;
+    if (dipshp_waiting_token == state->parse_state)
+        return;
+    int offset = state->input_pos - state->block_start;
+    uint64_t newlines = state->block.newlines >> offset;
+    if (run < DIPSH_LEXER_BLOCK_SIZE)
+        newlines &= ((uint64_t)1 << run) - 1;
+    state->line += __builtin_popcountll(newlines);
+    dipshp_append_chars(state, state->input + state->input_pos, run);
 }
 
-static int
-dipshp_add_char(
+int
+dipsh_lexer_scan(
     dipsh_lexer_state *state,
-    int c,
-    dipsh_token_list **first, 
-    dipsh_token_list **last,
-    dipsh_tokenize_error *err
+    const char *buf,
+    int len,
+    int *pos,
+    dipsh_token *token
 )
 {
-    dipsh_token_list *new_token = malloc(sizeof(dipsh_token_list));
-    int next_token_ret = dipsh_lexer_next_token(state, c, &new_token->token);
-    switch (next_token_ret) {
-
-    case dipsh_lexer_no_token: {
-        free(new_token);
-        break;
+    if (!buf)
+        return dipsh_lexer_next_token(state, EOF, token);
+    if (buf != state->input)
+        state->block_start = -1;
+    state->input = buf;
+    int ret = dipsh_lexer_no_token;
+    while (*pos < len && dipsh_lexer_no_token == ret) {
+        state->input_pos = *pos;
+        /* runs of chars are taken at once, the state machine only goes 
+         * through the structural ones */
+        int run = dipshp_plain_run(state, len);
+        if (run) {
+            dipshp_accept_run(state, run);
+            *pos += run;
+            continue;
+        }
+        ret = dipshp_accept_char(state, (unsigned char)buf[*pos], token);
+        ++*pos;
+        /* the state machine stays where it was on a wrong char, which the 
+         * index doesn't know of: after a backslash, it escapes the next char 
+         * too */
+        if (dipsh_lexer_error == ret)
+            state->block_start = -1;
     }
-
-    case dipsh_lexer_new_token: {
-        dipshp_insert_new_token(first, last, new_token);
-        break;
+    if (*pos == len) {
+        /* the next buffer is somewhere else */
+        dipshp_unslice_word(state);
+        state->input = NULL;
+        state->block_start = -1;
     }
-
-    case dipsh_lexer_error: {
-        dipsh_tokenize_error_set(
-            err, dipsh_lexer_state_get_line(state),
-            dipsh_lexer_state_get_error(state)
-        );
-        return 1;
-    }
-
-    default: {  /* shouldn't happen */
-        dipsh_tokenize_error_set(
-            err, dipsh_lexer_state_get_line(state),
-            "unknown lexer error"
-        );
-    }
-
-    }
-
-    return 0;
+    return ret;
 }
 
-dipsh_token_list *
-dipsh_tokenize_string(
-    const char *str,
-    dipsh_tokenize_error *err
+int
+dipsh_lexer_feed(
+    dipsh_lexer_state *state,
+    const char *buf,
+    int len,
+    dipsh_token_vec *tokens
 )
 {
-    FILE *str_stream = fmemopen((void*)str, strlen(str), "r");
-    if (!str_stream) {
-        dipsh_tokenize_error_set(
-            err, 0, "fmemopen failed: %s", strerrordesc_np(errno)
-        );
-        return NULL;
-    }
-    dipsh_token_list *list = dipsh_tokenize_stream(str_stream, err);
-    fclose(str_stream);
-    return list;
+    int pos = 0;
+    do {
+        if (0 != dipsh_token_vec_reserve(tokens, 1)) {
+            free(state->error);
+            state->error = strdup("can't allocate memory for tokens");
+            return -1;
+        }
+        dipsh_token *token = &tokens->tokens[tokens->length];
+        int ret = dipsh_lexer_scan(state, buf, len, &pos, token);
+        if (dipsh_lexer_error == ret)
+            return -1;
+        if (dipsh_lexer_new_token == ret)
+            ++tokens->length;
+    } while (buf && pos < len);
+    return 0;
 }
 
-dipsh_token_list *
-dipsh_tokenize_stream(
-    FILE *stream,
-    dipsh_tokenize_error *err
+int
+dipsh_tokenize_error_set(
+    dipsh_tokenize_error *err,
+    int line,
+    const char *format, ...
 )
 {
-    dipsh_token_list *first = NULL, *last = NULL;
-    dipsh_lexer_state *state = dipsh_lexer_state_init();
-    if (!state) {
-        dipsh_tokenize_error_set(err, 0, "can't initialize the tokenizer");
-        goto fail;
-    }
-
-    int c;
-    while ((c = fgetc(stream)) != EOF) {
-        int not_ok = dipshp_add_char(state, c, &first, &last, err);
-        if (not_ok)
-            goto fail;
+    if (!err)
+        return 1;
+    err->line = line;
+    
+    va_list ap;
+    va_start(ap, format);
+    int ret = vasprintf(&err->message, format, ap);
+    va_end(ap);
+    if (-1 == ret) { 
+        err->message = NULL;
+        return 1;
     }
-    int not_ok = dipshp_add_char(state, EOF, &first, &last, err);
-    if (not_ok)
-        goto fail;
-
-    dipsh_lexer_state_destroy(state);
-    return first;
-
-fail:
-    dipsh_lexer_state_destroy(state);
-    dipsh_clean_token_list(first);
-    return NULL;
+    return 0;
 }
 
 void
-dipsh_clean_token_list(
-    dipsh_token_list *list
+dipsh_tokenize_error_clean(
+    dipsh_tokenize_error *err
 )
 {
-    dipsh_token_list *pos = list;
-    while (pos) {
-        dipsh_token_list *temp = pos;
-        pos = pos->next;
-        dipsh_token_clean(&temp->token);
-        free(temp);
-    }
+    free(err->message);
 }
@@ -16,11 +16,25 @@ dipsh_lexer_state_destroy(
     dipsh_lexer_state *state
 );
 
+/* back to the state right after init, with the memory kept */
+void
+dipsh_lexer_state_reset(
+    dipsh_lexer_state *state
+);
+
 int
 dipsh_lexer_state_is_idle(
     const dipsh_lexer_state *state
 );
 
+/* whether the last character has been a newline ending a line: neither 
+ * quoted nor escaped (an escaped one leaves the lexer idle, as if it were 
+ * whitespace). Its token comes out with the next character, or with EOF */
+int
+dipsh_lexer_state_is_line_end(
+    const dipsh_lexer_state *state
+);
+
 int
 dipsh_lexer_state_get_line(
     const dipsh_lexer_state *state
@@ -59,14 +73,35 @@ dipsh_lexer_next_token(
     dipsh_token *token
 );
 
-/* string and stream tokenizing functions */
+/* the same for a buffer: accepts its characters from *pos on till a token is 
+ * produced or the buffer is over (then *pos is len, and the result is 
+ * dipsh_lexer_no_token). The words are interned (see intern.h), but if there 
+ * is no memory for that, those that need no rewriting are returned as slices 
+ * of buf (see dipsh_token), so buf must stay the same till it's over; 
+ * buf NULL means the end of the input. After an error the scan can go on, 
+ * past the wrong character */
+int
+dipsh_lexer_scan(
+    dipsh_lexer_state *state,
+    const char *buf,
+    int len,
+    int *pos,
+    dipsh_token *token
+);
 
-typedef struct dipsh_token_list_tag
-{
-    dipsh_token token;
-    struct dipsh_token_list_tag *next;
-}
-dipsh_token_list;
+/* accepts all the len characters at buf (NULL for the end of the input), 
+ * appending the tokens produced to tokens; the tokens may be slices of buf 
+ * as with dipsh_lexer_scan. Returns 0, or -1 if there has been an error (the 
+ * tokens produced before it stay in tokens) */
+int
+dipsh_lexer_feed(
+    dipsh_lexer_state *state,
+    const char *buf,
+    int len,
+    dipsh_token_vec *tokens
+);
+
+/* an error found while tokenizing a piece of the input */
 
 typedef struct dipsh_tokenize_error_tag
 {
@@ -87,21 +122,4 @@ dipsh_tokenize_error_clean(
     dipsh_tokenize_error *err
 );
 
-dipsh_token_list *
-dipsh_tokenize_string(
-    const char *str,
-    dipsh_tokenize_error *err
-);
-
-dipsh_token_list *
-dipsh_tokenize_stream(
-    FILE *stream,
-    dipsh_tokenize_error *err
-);
-
-void
-dipsh_clean_token_list(
-    dipsh_token_list *list
-);
-
 #endif /* _DIPSH_LEXER_H_ */
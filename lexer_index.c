@@ -0,0 +1,243 @@
+#include "lexer_index.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define DIPSHP_X86
+#endif
+
+typedef void (*dipshp_classifier)(
+    const char *buf,
+    dipsh_lexer_block *block
+);
+
+/* for blocks shorter than DIPSH_LEXER_BLOCK_SIZE and for CPUs the vector
+ * versions aren't for */
+static void
+dipshp_classify_scalar(
+    const char *buf,
+    int len,
+    dipsh_lexer_block *block
+)
+{
+    for (int i = 0; i < len; ++i) {
+        unsigned char c = buf[i];
+        uint64_t bit = (uint64_t)1 << i;
+        switch (c) {
+        case ' ':
+        case '\t':
+        case '\v':
+            block->ws |= bit;
+            break;
+        case '\n':
+            block->newlines |= bit;
+            block->delims |= bit;
+            break;
+        case '&': case '|': case ';': case '<': case '>':
+        case '(': case ')': case '{': case '}':
+            block->delims |= bit;
+            break;
+        case '"':
+            block->quotes |= bit;
+            break;
+        case '\\':
+            block->backslashes |= bit;
+            break;
+        default:
+            if (c < 0x20 || c >= 0x7f)
+                block->others |= bit;
+        }
+    }
+}
+
+#ifdef DIPSHP_X86
+
+#define DIPSHP_EQ128(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define DIPSHP_MASK128(v, shift) \
+    ((uint64_t)(uint16_t)_mm_movemask_epi8(v) << (shift))
+
+static void
+dipshp_classify_sse2(
+    const char *buf,
+    dipsh_lexer_block *block
+)
+{
+    for (int i = 0; i < DIPSH_LEXER_BLOCK_SIZE; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i newlines = DIPSHP_EQ128(v, '\n');
+        __m128i tabs = _mm_or_si128(DIPSHP_EQ128(v, '\t'),
+                                    DIPSHP_EQ128(v, '\v'));
+        __m128i ws = _mm_or_si128(tabs, DIPSHP_EQ128(v, ' '));
+        __m128i delims = _mm_or_si128(
+            _mm_or_si128(
+                _mm_or_si128(DIPSHP_EQ128(v, '&'), DIPSHP_EQ128(v, '|')),
+                _mm_or_si128(DIPSHP_EQ128(v, ';'), DIPSHP_EQ128(v, '<'))
+            ),
+            _mm_or_si128(
+                _mm_or_si128(DIPSHP_EQ128(v, '>'), DIPSHP_EQ128(v, '(')),
+                _mm_or_si128(DIPSHP_EQ128(v, ')'), DIPSHP_EQ128(v, '{'))
+            )
+        );
+        delims = _mm_or_si128(
+            delims, _mm_or_si128(DIPSHP_EQ128(v, '}'), newlines)
+        );
+        /* signed, so the chars from 0x80 on are below 0x20 as well */
+        __m128i others = _mm_or_si128(
+            _mm_cmplt_epi8(v, _mm_set1_epi8(0x20)), DIPSHP_EQ128(v, 0x7f)
+        );
+        others = _mm_andnot_si128(_mm_or_si128(tabs, newlines), others);
+
+        block->ws |= DIPSHP_MASK128(ws, i);
+        block->delims |= DIPSHP_MASK128(delims, i);
+        block->newlines |= DIPSHP_MASK128(newlines, i);
+        block->quotes |= DIPSHP_MASK128(DIPSHP_EQ128(v, '"'), i);
+        block->backslashes |= DIPSHP_MASK128(DIPSHP_EQ128(v, '\\'), i);
+        block->others |= DIPSHP_MASK128(others, i);
+    }
+}
+
+#define DIPSHP_EQ256(v, c) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define DIPSHP_MASK256(v, shift) \
+    ((uint64_t)(uint32_t)_mm256_movemask_epi8(v) << (shift))
+
+__attribute__((target("avx2")))
+static void
+dipshp_classify_avx2(
+    const char *buf,
+    dipsh_lexer_block *block
+)
+{
+    for (int i = 0; i < DIPSH_LEXER_BLOCK_SIZE; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i newlines = DIPSHP_EQ256(v, '\n');
+        __m256i tabs = _mm256_or_si256(DIPSHP_EQ256(v, '\t'),
+                                       DIPSHP_EQ256(v, '\v'));
+        __m256i ws = _mm256_or_si256(tabs, DIPSHP_EQ256(v, ' '));
+        __m256i delims = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_or_si256(DIPSHP_EQ256(v, '&'), DIPSHP_EQ256(v, '|')),
+                _mm256_or_si256(DIPSHP_EQ256(v, ';'), DIPSHP_EQ256(v, '<'))
+            ),
+            _mm256_or_si256(
+                _mm256_or_si256(DIPSHP_EQ256(v, '>'), DIPSHP_EQ256(v, '(')),
+                _mm256_or_si256(DIPSHP_EQ256(v, ')'), DIPSHP_EQ256(v, '{'))
+            )
+        );
+        delims = _mm256_or_si256(
+            delims, _mm256_or_si256(DIPSHP_EQ256(v, '}'), newlines)
+        );
+        __m256i others = _mm256_or_si256(
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), v),
+            DIPSHP_EQ256(v, 0x7f)
+        );
+        others = _mm256_andnot_si256(_mm256_or_si256(tabs, newlines), others);
+
+        block->ws |= DIPSHP_MASK256(ws, i);
+        block->delims |= DIPSHP_MASK256(delims, i);
+        block->newlines |= DIPSHP_MASK256(newlines, i);
+        block->quotes |= DIPSHP_MASK256(DIPSHP_EQ256(v, '"'), i);
+        block->backslashes |= DIPSHP_MASK256(DIPSHP_EQ256(v, '\\'), i);
+        block->others |= DIPSHP_MASK256(others, i);
+    }
+}
+
+#else
+
+static void
+dipshp_classify_full_scalar(
+    const char *buf,
+    dipsh_lexer_block *block
+)
+{
+    dipshp_classify_scalar(buf, DIPSH_LEXER_BLOCK_SIZE, block);
+}
+
+#endif /* DIPSHP_X86 */
+
+static void
+dipshp_classify_first(
+    const char *buf,
+    dipsh_lexer_block *block
+);
+
+static dipshp_classifier dipshp_classify = dipshp_classify_first;
+
+/* picks the classifier for the CPU on the first call */
+static void
+dipshp_classify_first(
+    const char *buf,
+    dipsh_lexer_block *block
+)
+{
+#ifdef DIPSHP_X86
+    __builtin_cpu_init();
+    dipshp_classify = __builtin_cpu_supports("avx2")
+        ? dipshp_classify_avx2
+        : dipshp_classify_sse2;
+#else
+    dipshp_classify = dipshp_classify_full_scalar;
+#endif
+    dipshp_classify(buf, block);
+}
+
+/* the chars escaped by backslashes (a run of them escapes the char past it
+ * if it's of odd length), found with no branches the way simdjson does it:
+ * adding the starts of the runs to the runs carries each run over to the
+ * char past it, and where it lands tells the parity of its length */
+static uint64_t
+dipshp_find_escaped(
+    uint64_t backslashes,
+    int escaped_first
+)
+{
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    uint64_t carry = escaped_first ? 1 : 0;
+    backslashes &= ~carry;
+    uint64_t follows_escape = backslashes << 1 | carry;
+    uint64_t odd_starts = backslashes & ~even_bits & ~follows_escape;
+    uint64_t even_runs_ends = (odd_starts + backslashes) << 1;
+    return (even_bits ^ even_runs_ends) & follows_escape;
+}
+
+/* bit i is the xor of bits 0 to i */
+static uint64_t
+dipshp_prefix_xor(
+    uint64_t mask
+)
+{
+    mask ^= mask << 1;
+    mask ^= mask << 2;
+    mask ^= mask << 4;
+    mask ^= mask << 8;
+    mask ^= mask << 16;
+    mask ^= mask << 32;
+    return mask;
+}
+
+void
+dipsh_lexer_index_block(
+    const char *buf,
+    int len,
+    int escaped,
+    int quoted,
+    dipsh_lexer_block *block
+)
+{
+    memset(block, 0, sizeof(*block));
+    if (DIPSH_LEXER_BLOCK_SIZE == len)
+        dipshp_classify(buf, block);
+    else
+        dipshp_classify_scalar(buf, len, block);
+
+    uint64_t valid = DIPSH_LEXER_BLOCK_SIZE == len
+        ? ~(uint64_t)0
+        : ((uint64_t)1 << len) - 1;
+    block->escaped = dipshp_find_escaped(block->backslashes, escaped) & valid;
+    block->in_quotes = dipshp_prefix_xor(block->quotes & ~block->escaped);
+    if (quoted)
+        block->in_quotes = ~block->in_quotes;
+    block->in_quotes &= valid;
+    block->structural = block->quotes | block->backslashes | block->others |
+        block->escaped | ~valid |
+        ((block->ws | block->delims) & ~block->in_quotes);
+}
@@ -0,0 +1,41 @@
+#ifndef _DIPSH_LEXER_INDEX_H_
+#define _DIPSH_LEXER_INDEX_H_
+
+#include <stdint.h>
+
+/* structural index of the lexer's input: a block of up to 64 chars is
+ * classified at once (with SSE2 or AVX2 where the CPU has them), bit i of
+ * each mask being about the block's char i. Bits past the block's length
+ * are clear in all the masks but structural, where they are set */
+
+#define DIPSH_LEXER_BLOCK_SIZE 64
+
+typedef struct dipsh_lexer_block_tag
+{
+    uint64_t ws;            /* ' ', '\t', '\v' */
+    uint64_t delims;        /* &|;<>(){} and '\n' */
+    uint64_t newlines;
+    uint64_t quotes;
+    uint64_t backslashes;
+    uint64_t others;        /* neither printable nor whitespace */
+    uint64_t escaped;       /* follows a backslash which isn't escaped */
+    uint64_t in_quotes;     /* the opening quote included, the closing not */
+    /* the chars the lexer can't just append to the word being read: what
+     * ends or rewrites a word, depending on in_quotes, and escaped chars */
+    uint64_t structural;
+}
+dipsh_lexer_block;
+
+/* indexes the len chars at buf (len is 1 to DIPSH_LEXER_BLOCK_SIZE);
+ * escaped and quoted tell whether the lexer takes buf[0] as an escaped
+ * char and whether it is within quotes */
+void
+dipsh_lexer_index_block(
+    const char *buf,
+    int len,
+    int escaped,
+    int quoted,
+    dipsh_lexer_block *block
+);
+
+#endif /* _DIPSH_LEXER_INDEX_H_ */
@@ -9,11 +9,15 @@ main(
     dipsh_cl_params *params = dipsh_read_cl_params(argc, argv);
     if (!params)
         return 1;
-    if (params->script_file) {
+    if (params->compile_only) {
+        return dipsh_compile_script(params->script_file);
+    } else if (params->script_file) {
         return dipsh_execute_script(
-            params->script_file, params->show_parsing_info
+            params->script_file, params->show_parsing_info, params->threaded
         );
     } else {
-        return dipsh_interactive_shell(params->show_parsing_info);
+        return dipsh_interactive_shell(
+            params->show_parsing_info, params->show_cache_info
+        );
     }
 }
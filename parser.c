@@ -1,4 +1,7 @@
 #include "parser.h"
+#include "parser_grammar.h"
+#include "parser_tables.h"
+#include "intern.h"
 #include <stdlib.h>
 #include <string.h>
 #include <err.h>
@@ -49,595 +52,307 @@ dipsh_symbol_type_to_string(
     return traits->name;
 }
 
-static void
-dipshp_nonterminal_clear(
-    dipsh_nonterminal *symb
-)
-{
-    dipsh_nonterminal_child *curr = symb->children_list;
-    while (curr) {
-        dipsh_nonterminal_child *temp = curr;
-        curr = curr->next;
-        dipsh_symbol_clear(temp->child);
-        free(temp);
-    }
-    free(symb);
-}
-
-static void
-dipshp_terminal_clear(
-    dipsh_terminal *symb
-)
-{
-    dipsh_token_clean(&symb->token);
-    free(symb);
-}
-
-void
-dipsh_symbol_clear(
-    dipsh_symbol *symb
-)
-{
-    if (!symb)
-        return;
-    if (symb->type & dipsh_symbol_nonterminal)
-        dipshp_nonterminal_clear((dipsh_nonterminal *)symb);
-    else if (symb->type & dipsh_symbol_terminal)
-        dipshp_terminal_clear((dipsh_terminal *)symb);
-}
-
-typedef struct dipshp_grammar_rule_tag
-{
-    dipsh_symbol_type left_hand_symb;
-    int right_hand_size;
-    const dipsh_symbol_type *right_hand_symb;
-}
-dipshp_grammar_rule;
-
-#define DIPSHP_DEFINE_GRAMMAR_RULE(rule_name, left_hand, ...)              \
-static const dipsh_symbol_type dipshp_right_hand_##rule_name[] =           \
-    { __VA_ARGS__ };                                                       \
-static const dipshp_grammar_rule rule_name = {                             \
-    left_hand,                                                             \
-    sizeof(dipshp_right_hand_##rule_name) / sizeof(dipsh_symbol_type),     \
-    dipshp_right_hand_##rule_name                                          \
-};
-
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    start, dipsh_symbol_script, 
-    dipsh_symbol_strings
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    strings_1, dipsh_symbol_strings,
-    dipsh_symbol_seq_bg_start
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    strings_2, dipsh_symbol_strings,
-    dipsh_symbol_strings, dipsh_symbol_newline
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    strings_3, dipsh_symbol_strings,
-    dipsh_symbol_strings, dipsh_symbol_newline, dipsh_symbol_seq_bg_start
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    seq_bg_start_1, dipsh_symbol_seq_bg_start,
-    dipsh_symbol_seq_bg
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    seq_bg_start_2, dipsh_symbol_seq_bg_start,
-    dipsh_symbol_seq_bg, dipsh_symbol_bg
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    seq_bg_start_3, dipsh_symbol_seq_bg_start,
-    dipsh_symbol_seq_bg, dipsh_symbol_seq
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    seq_bg_1, dipsh_symbol_seq_bg,
-    dipsh_symbol_and_or
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    seq_bg_2, dipsh_symbol_seq_bg,
-    dipsh_symbol_seq_bg, dipsh_symbol_bg, dipsh_symbol_and_or
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    seq_bg_3, dipsh_symbol_seq_bg,
-    dipsh_symbol_seq_bg, dipsh_symbol_seq, dipsh_symbol_and_or
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    and_or_1, dipsh_symbol_and_or,
-    dipsh_symbol_pipe
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    and_or_2, dipsh_symbol_and_or,
-    dipsh_symbol_and_or, dipsh_symbol_and, dipsh_symbol_pipe
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    and_or_3, dipsh_symbol_and_or,
-    dipsh_symbol_and_or, dipsh_symbol_or, dipsh_symbol_pipe
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    pipe_1, dipsh_symbol_pipe,
-    dipsh_symbol_command
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    pipe_2, dipsh_symbol_pipe,
-    dipsh_symbol_pipe, dipsh_symbol_pipe_bar, dipsh_symbol_command
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    command_1, dipsh_symbol_command,
-    dipsh_symbol_word
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    command_2, dipsh_symbol_command,
-    dipsh_symbol_command, dipsh_symbol_word
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    command_3, dipsh_symbol_command,
-    dipsh_symbol_command, dipsh_symbol_redir
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    redir_1, dipsh_symbol_redir,
-    dipsh_symbol_redir_out, dipsh_symbol_word
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    redir_2, dipsh_symbol_redir,
-    dipsh_symbol_redir_in, dipsh_symbol_word
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    redir_3, dipsh_symbol_redir,
-    dipsh_symbol_redir_app, dipsh_symbol_word
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    redir_4, dipsh_symbol_redir,
-    dipsh_symbol_redir_dig_out, dipsh_symbol_word
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    redir_5, dipsh_symbol_redir,
-    dipsh_symbol_redir_dig_in, dipsh_symbol_word
-)
-DIPSHP_DEFINE_GRAMMAR_RULE(
-    redir_6, dipsh_symbol_redir,
-    dipsh_symbol_redir_dig_app, dipsh_symbol_word
-)
-
-static const dipshp_grammar_rule *dipshp_grammar_rules[] = {
-    &start,
-    &strings_1, &strings_2, &strings_3,
-    &seq_bg_start_1, &seq_bg_start_2, &seq_bg_start_3,
-    &seq_bg_1, &seq_bg_2, &seq_bg_3,
-    &and_or_1, &and_or_2, &and_or_3,
-    &pipe_1, &pipe_2,
-    &command_1, &command_2, &command_3,
-    &redir_1, &redir_2, &redir_3, &redir_4, &redir_5, &redir_6
-};
-
-typedef enum dipshp_parse_action_type_tag
-{
-    dipshp_parse_shift,
-    dipshp_parse_reduce,
-    dipshp_parse_accept,
-    dipshp_parse_error
-}
-dipshp_parse_action_type;
-
-typedef struct dipshp_parse_action_tag
-{
-    dipshp_parse_action_type type;
-    int number;
-}
-dipshp_parse_action;
-
-#define S(num) { dipshp_parse_shift, num }
-#define R(num) { dipshp_parse_reduce, num }
-#define A      { dipshp_parse_accept }
-#define E      { dipshp_parse_error }
-
-#define DIPSHP_TOTAL_STATES 34
+#define DIPSHP_PARSER_INITIAL_CAP 64
 
-static const dipsh_symbol_type dipshp_symbol_types[] = {
-    dipsh_symbol_script,
-    dipsh_symbol_strings,
-    dipsh_symbol_seq_bg_start,
-    dipsh_symbol_seq_bg,
-    dipsh_symbol_and_or,
-    dipsh_symbol_pipe,
-    dipsh_symbol_command,
-    dipsh_symbol_redir,
-
-    dipsh_symbol_newline,
-    dipsh_symbol_seq,
-    dipsh_symbol_bg,
-    dipsh_symbol_and,
-    dipsh_symbol_or,
-    dipsh_symbol_pipe_bar,
-    dipsh_symbol_word,
-    dipsh_symbol_redir_out,
-    dipsh_symbol_redir_in,
-    dipsh_symbol_redir_app,
-    dipsh_symbol_redir_dig_out,
-    dipsh_symbol_redir_dig_in,
-    dipsh_symbol_redir_dig_app,
-
-    dipsh_symbol_end_of_stream
-};
-
-#define DIPSHP_SYMBOL_TYPES_NUM \
-    sizeof(dipshp_symbol_types) / sizeof(dipsh_symbol_type)
-
-static const dipshp_parse_action 
-dipshp_parse_actions[DIPSHP_TOTAL_STATES][DIPSHP_SYMBOL_TYPES_NUM] = {
-    /* 0 */
-    { E,     S(1),  S(2),  S(3),  S(4),  S(5),  S(6),  E,
-      E,     E,     E,     E,     E,     E,     S(7),  
-      E,     E,     E,     E,     E,     E,     E      },
-    /* 1 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      S(8),  E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     A     },
-    /* 2 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(1),  E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     R(1)  },
-    /* 3 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(4),  S(9),  S(10), E,     E,     E,     E,  
-      E,     E,     E,     E,     E,     E,     R(1)  },
-    /* 4 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(7),  R(7),  R(7),  S(11), S(12), E,     E,  
-      E,     E,     E,     E,     E,     E,     R(7)  },
-    /* 5 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(10), R(10), R(10), R(10), R(10), S(13), E,  
-      E,     E,     E,     E,     E,     E,     R(10) },
-    /* 6 */
-    { E,     E,     E,     E,     E,     E,     E,     S(15),
-      R(13), R(13), R(13), R(13), R(13), R(13), S(14),  
-      S(16), S(17), S(18), S(19), S(20), S(21), R(13) },
-    /* 7 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(15), R(15), R(15), R(15), R(15), R(15), R(15),  
-      R(15), R(15), R(15), R(15), R(15), R(15), R(15) },
-    /* 8 */
-    { E,     E,     S(22), S(3),  S(4),  S(5),  S(6),  E,
-      R(2),  E,     E,     E,     E,     E,     S(7),  
-      E,     E,     E,     E,     E,     E,     R(2)  },
-    /* 9 */
-    { E,     E,     E,     E,     S(23), S(5),  S(6),  E,
-      R(5),  E,     E,     E,     E,     E,     S(7),  
-      E,     E,     E,     E,     E,     E,     R(5)  },
-    /* 10 */
-    { E,     E,     E,     E,     S(24), S(5),  S(6),  E,
-      R(6),  E,     E,     E,     E,     E,     S(7),  
-      E,     E,     E,     E,     E,     E,     R(6)  },
-    /* 11 */
-    { E,     E,     E,     E,     E,     S(25), S(6),  E,
-      E,     E,     E,     E,     E,     E,     S(7),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 12 */
-    { E,     E,     E,     E,     E,     S(26), S(6),  E,
-      E,     E,     E,     E,     E,     E,     S(7),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 13 */
-    { E,     E,     E,     E,     E,     E,     S(27), E,
-      E,     E,     E,     E,     E,     E,     S(7),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 14 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(16), R(16), R(16), R(16), R(16), R(16), R(16),  
-      R(16), R(16), R(16), R(16), R(16), R(16), R(16) },
-    /* 15 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(17), R(17), R(17), R(17), R(17), R(17), R(17),  
-      R(17), R(17), R(17), R(17), R(17), R(17), R(17) },
-    /* 16 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     S(28),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 17 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     S(29),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 18 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     S(30),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 19 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     S(31),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 20 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     S(32),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 21 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     S(33),  
-      E,     E,     E,     E,     E,     E,     E     },
-    /* 22 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(3),  E,     E,     E,     E,     E,     E,
-      E,     E,     E,     E,     E,     E,     R(3)  },
-    /* 23 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(8),  R(8),  R(8),  S(11), S(12), E,     E,
-      E,     E,     E,     E,     E,     E,     R(8)  },
-    /* 24 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(9),  R(9),  R(9),  S(11), S(12), E,     E,
-      E,     E,     E,     E,     E,     E,     R(9)  },
-    /* 25 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(11), R(11), R(11), R(11), R(11), S(13), E,
-      E,     E,     E,     E,     E,     E,     R(11) },
-    /* 26 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(12), R(12), R(12), R(12), R(12), S(13), E,
-      E,     E,     E,     E,     E,     E,     R(12) },
-    /* 27 */
-    { E,     E,     E,     E,     E,     E,     E,     S(15),
-      R(14), R(14), R(14), R(14), R(14), R(14), S(14),  
-      S(16), S(17), S(18), S(19), S(20), S(21), R(14) },
-    /* 28 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(18), R(18), R(18), R(18), R(18), R(18), R(18),  
-      R(18), R(18), R(18), R(18), R(18), R(18), R(18) },
-    /* 29 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(19), R(19), R(19), R(19), R(19), R(19), R(19),  
-      R(19), R(19), R(19), R(19), R(19), R(19), R(19) },
-    /* 30 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(20), R(20), R(20), R(20), R(20), R(20), R(20),  
-      R(20), R(20), R(20), R(20), R(20), R(20), R(20) },
-    /* 31 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(21), R(21), R(21), R(21), R(21), R(21), R(21),  
-      R(21), R(21), R(21), R(21), R(21), R(21), R(21) },
-    /* 32 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(22), R(22), R(22), R(22), R(22), R(22), R(22),  
-      R(22), R(22), R(22), R(22), R(22), R(22), R(22) },
-    /* 33 */
-    { E,     E,     E,     E,     E,     E,     E,     E,
-      R(23), R(23), R(23), R(23), R(23), R(23), R(23),  
-      R(23), R(23), R(23), R(23), R(23), R(23), R(23) },
-};
-
-#undef S
-#undef R
-#undef A
-#undef E
-
-typedef struct dipshp_parser_stack_tag
+typedef struct dipshp_parser_stack_entry_tag
 {
-    union
-    {
-        dipsh_symbol *symb;
-        int state_num;
-    };
-    struct dipshp_parser_stack_tag *next;
+    int state_num;
+    /* of the symbol that has led to the state: a terminal, or the list of 
+     * a nonterminal with its children among the open ones */
+    dipsh_ast_node node;
 } 
-dipshp_parser_stack;
+dipshp_parser_stack_entry;
 
 struct dipsh_parser_state_tag
 {
-    dipshp_parser_stack *symbol_stack, *state_stack;
-    int clear_symbol_stack;
+    /* the bottom entry has the start state and no symbol */
+    dipshp_parser_stack_entry *stack;
+    int stack_len;
+    int stack_cap;
+    /* the children of the lists not reduced into others yet, the ones of 
+     * the innermost list last */
+    dipsh_ast_node *open_nodes;
+    int open_nodes_len;
+    int open_nodes_cap;
+    /* the AST parsed so far, the children of the lists closed; the root, 
+     * which is the last one closed, goes first */
+    dipsh_ast_node *nodes;
+    int nodes_len;
+    int nodes_cap;
+    /* the references to them are the parser's till the AST is taken */
+    const char **words;
+    int words_len;
+    int words_cap;
     int last_line;
     char *error;
 };
 
-static void
-dipshp_push_onto_stack(
-    dipshp_parser_stack **stack,
-    dipshp_parser_stack *new_top
-)
-{
-    new_top->next = *stack;
-    *stack = new_top;
-}
-
-static dipshp_parser_stack *
-dipshp_pop_stack(
-    dipshp_parser_stack **stack
-)
-{
-    dipshp_parser_stack *top = *stack;
-    *stack = (*stack)->next;
-    return top;
-}
-
-static void
-dipshp_push_slr_state(
-    dipsh_parser_state *state,
-    int state_num
-)
-{
-    dipshp_parser_stack *new_top = calloc(sizeof(dipshp_parser_stack), 1);
-    new_top->state_num = state_num;
-    dipshp_push_onto_stack(&state->state_stack, new_top);
-}
+/* makes room for more items of size bytes in *array; the arrays are kept 
+ * from one parse to another. Returns 1 if there is no memory */
+static int
+dipshp_reserve(
+    void **array,
+    int *cap,
+    int len,
+    int more,
+    int size
+)
+{
+    if (len + more <= *cap)
+        return 0;
+    int new_cap = *cap ? *cap : DIPSHP_PARSER_INITIAL_CAP;
+    while (new_cap < len + more)
+        new_cap *= 2;
+    void *new_array = realloc(*array, (long)new_cap * size);
+    if (!new_array)
+        return 1;
+    *array = new_array;
+    *cap = new_cap;
+    return 0;
+}
+
+#define DIPSHP_RESERVE(state, name, more)                                      \
+    dipshp_reserve(                                                            \
+        (void **)&(state)->name, &(state)->name##_cap, (state)->name##_len,    \
+        more, sizeof(*(state)->name)                                           \
+    )
 
-static void
-dipshp_push_slr_symbol(
+static int
+dipshp_push_slr_entry(
     dipsh_parser_state *state,
-    dipsh_symbol *symb
+    int state_num,
+    const dipsh_ast_node *node
 )
 {
-    dipshp_parser_stack *new_top = calloc(sizeof(dipshp_parser_stack), 1);
-    new_top->symb = symb;
-    dipshp_push_onto_stack(&state->symbol_stack, new_top);
+    if (0 != DIPSHP_RESERVE(state, stack, 1))
+        return 1;
+    state->stack[state->stack_len].state_num = state_num;
+    state->stack[state->stack_len].node = *node;
+    ++state->stack_len;
+    return 0;
 }
 
-static dipshp_parser_stack *
-dipshp_pop_slr_state(
-    dipsh_parser_state *state
+static int
+dipshp_top_slr_state(
+    const dipsh_parser_state *state
 )
 {
-    return dipshp_pop_stack(&state->state_stack);
+    return state->stack[state->stack_len - 1].state_num;
 }
 
-static dipshp_parser_stack *
-dipshp_pop_slr_symbol(
-    dipsh_parser_state *state
+/* the dense id the tables know a terminal by, -1 for other symbols */
+static int
+dipshp_terminal_id(
+    dipsh_symbol_type type
 )
 {
-    return dipshp_pop_stack(&state->symbol_stack);
+    if (dipsh_symbol_end_of_stream == type)
+        return DIPSHP_TERMINALS_NUM - 1;
+    if (!(type & dipsh_symbol_terminal))
+        return -1;
+    int offset = type - dipsh_symbol_terminal;
+    return offset >= 1 && offset < DIPSHP_TERMINALS_NUM ? offset - 1 : -1;
 }
 
+/* the terminals that only separate what the lists have, so that the AST 
+ * has no nodes for them */
 static int
-dipshp_type_index(
+dipshp_is_punctuation(
     dipsh_symbol_type type
 )
 {
-    for (const dipsh_symbol_type *curr = dipshp_symbol_types; 
-         curr - dipshp_symbol_types < DIPSHP_SYMBOL_TYPES_NUM;
-         ++curr) {
-        if (*curr == type)
-            return curr - dipshp_symbol_types;
-    }
-    return -1;
+    return dipsh_symbol_newline == type || dipsh_symbol_pipe_bar == type;
 }
 
-static void
-dipshp_parser_state_destroy_stack(
-    dipshp_parser_stack *stack,
-    int clear_symbol_stack
+/* moves the children of a list, the last open one, into the AST; a list 
+ * with a single nonterminal child is replaced by the child, so that there 
+ * are no chains of lists. Returns 1 if there is no memory */
+static int
+dipshp_close_list(
+    dipsh_parser_state *state,
+    dipsh_ast_node *list,
+    int may_collapse
 )
 {
-    dipshp_parser_stack *curr = stack;
-    while (curr) {
-        dipshp_parser_stack *temp = curr;
-        curr = curr->next;
-        if (clear_symbol_stack)
-            dipsh_symbol_clear(temp->symb);
-        free(temp);
-    } 
+    const dipsh_ast_node *children = state->open_nodes + list->first_child;
+    state->open_nodes_len = list->first_child;
+    if (may_collapse && 1 == list->children_len &&
+        (children->type & dipsh_symbol_nonterminal)) {
+        *list = *children;
+        return 0;
+    }
+    if (0 != DIPSHP_RESERVE(state, nodes, list->children_len))
+        return 1;
+    memcpy(
+        state->nodes + state->nodes_len, children, 
+        list->children_len * sizeof(dipsh_ast_node)
+    );
+    list->first_child = state->nodes_len;
+    state->nodes_len += list->children_len;
+    return 0;
 }
 
-static dipsh_symbol *
-dipshp_build_nonterminal(
-    dipsh_symbol_type type,
-    dipshp_parser_stack *stack 
-)
-{
-    dipsh_nonterminal *result = calloc(sizeof(dipsh_nonterminal), 1);
-    dipsh_nonterminal_child *last_child = NULL;
-    result->symb.type = type;
-    for (dipshp_parser_stack *pos = stack; pos; pos = pos->next) {
-        dipsh_nonterminal_child *ch = 
-            calloc(sizeof(dipsh_nonterminal_child), 1);
-        ch->child = pos->symb;
-        if (!last_child) {
-            result->children_list = ch;
-        } else {
-            last_child->next = ch;
+static int
+dipshp_handle_reduce(
+    dipsh_parser_state *state,
+    int rule_num
+)
+{
+    const dipshp_grammar_rule *rule = dipshp_grammar_rules[rule_num];
+    dipshp_parser_stack_entry *entries = 
+        state->stack + state->stack_len - rule->right_hand_size;
+    int first = dipshp_ast_extend == rule->ast_action ? 1 : 0;
+    /* the lists of the symbols become children, the last one is open last */
+    for (int i = rule->right_hand_size - 1; i >= first; --i) {
+        if ((entries[i].node.type & dipsh_symbol_nonterminal) &&
+            0 != dipshp_close_list(state, &entries[i].node, 1)) {
+            return 1;
         }
-        last_child = ch;
     }
-    return (dipsh_symbol *)result;
+    dipsh_ast_node list = { rule->left_hand_symb };
+    if (first) {
+        list.first_child = entries[0].node.first_child;
+        list.children_len = entries[0].node.children_len;
+    } else {
+        list.first_child = state->open_nodes_len;
+    }
+    if (0 != DIPSHP_RESERVE(state, open_nodes, rule->right_hand_size))
+        return 1;
+    for (int i = first; i < rule->right_hand_size; ++i) {
+        if (dipshp_is_punctuation(entries[i].node.type))
+            continue;
+        state->open_nodes[state->open_nodes_len++] = entries[i].node;
+        ++list.children_len;
+    }
+    state->stack_len -= rule->right_hand_size;
+    int left_hand_id = rule->left_hand_symb - dipsh_symbol_nonterminal - 1;
+    return dipshp_push_slr_entry(
+        state, dipshp_parse_gotos[dipshp_top_slr_state(state)][left_hand_id],
+        &list
+    );
 }
 
-static void
-dipshp_handle_reduce(
+/* the node of a terminal, with the word of the token taken over */
+static int
+dipshp_make_terminal_node(
     dipsh_parser_state *state,
-    const dipshp_parse_action *action
-)
-{
-    const dipshp_grammar_rule *rule = dipshp_grammar_rules[action->number];
-    const dipsh_symbol_type *rule_symb = 
-        rule->right_hand_symb + rule->right_hand_size - 1;
-    dipshp_parser_stack *st = NULL;
-    for (; rule_symb >= rule->right_hand_symb; --rule_symb) {
-        dipshp_parser_stack *symb_top = dipshp_pop_slr_symbol(state);
-        dipshp_parser_stack *state_top = dipshp_pop_slr_state(state);
-        free(state_top);
-        dipshp_push_onto_stack(&st, symb_top);
-    }
-    int left_hand_index = dipshp_type_index(rule->left_hand_symb);
-    int top_state = state->state_stack->state_num; 
-    const dipshp_parse_action *lh_action = 
-        &dipshp_parse_actions[top_state][left_hand_index];
-    dipsh_symbol *nonterm = 
-        dipshp_build_nonterminal(rule->left_hand_symb, st);
-    dipshp_parser_state_destroy_stack(st, 0);
-    dipshp_push_slr_state(state, lh_action->number);
-    dipshp_push_slr_symbol(state, nonterm);
+    dipsh_symbol_type type,
+    dipsh_token *token,
+    dipsh_ast_node *node
+)
+{
+    node->type = type;
+    node->word = 0;
+    node->word_len = 0;
+    if (dipshp_is_punctuation(type))
+        return 0;
+    if (0 != DIPSHP_RESERVE(state, words, 1))
+        return 1;
+    const char *word = dipsh_token_take_interned(token);
+    if (!word)
+        return 1;
+    node->word = state->words_len;
+    node->word_len = token->length;
+    state->words[state->words_len++] = word;
+    return 0;
 }
 
 #define DIPSHP_SET_STATE_ERROR(st, str) st->error = strdup(str)
-#define DIPSHP_SET_STATE_ERROR_VA(st, fmt, ...) \
+#define DIPSHP_SET_STATE_ERROR_VA(st, fmt, ...)                                \
     asprintf(&st->error, fmt, __VA_ARGS__)
-#define DIPSHP_UNKNOWN_TOKEN          "line %d: unknown token: '%s'"
+#define DIPSHP_UNKNOWN_TOKEN          "line %d: unknown token: '%.*s'"
 #define DIPSHP_UNKNOWN_SYMBOL         "unknown symbol type encountered"
-#define DIPSHP_UNEXPECTED_NONTERMINAL "parser didn't expect a nonterminal here"
-#define DIPSHP_TOKEN_UNEXPECTED_HERE  "line %d: token '%s' unexpected here"
+#define DIPSHP_TOKEN_UNEXPECTED_HERE  "line %d: token '%.*s' unexpected here"
+#define DIPSHP_END_UNEXPECTED_HERE    "line %d: token '%s' unexpected here"
+#define DIPSHP_NO_MEMORY              "no memory for the syntax tree"
 
+/* token is NULL for the end of stream */
 static int
 dipshp_parser_next_symbol(
     dipsh_parser_state *state,
-    dipsh_symbol *symb
+    dipsh_symbol_type type,
+    dipsh_token *token
 )
 {
-    int symb_index = dipshp_type_index(symb->type);
-    dipsh_terminal *term_symb = (dipsh_terminal *)symb;
-    if (-1 == symb_index || 
-        (!(symb->type & dipsh_symbol_terminal) &&
-         (symb->type != dipsh_symbol_end_of_stream))) {
-        if (symb->type & dipsh_symbol_terminal) {
+    int symb_id = dipshp_terminal_id(type);
+    if (-1 == symb_id) {
+        if (type & dipsh_symbol_terminal) {
             DIPSHP_SET_STATE_ERROR_VA(
                 state, DIPSHP_UNKNOWN_TOKEN, 
-                term_symb->token.line, term_symb->token.value
+                token->line, token->length, token->value
             );
         } else {
             DIPSHP_SET_STATE_ERROR(state, DIPSHP_UNKNOWN_SYMBOL);
         }
         return dipsh_parser_error;
     }
-    if (symb->type & dipsh_symbol_terminal)
-        state->last_line = term_symb->token.line;
+    if (token)
+        state->last_line = token->line;
     for (;;) {
-        int top_state = state->state_stack->state_num;
-
-        const dipshp_parse_action *action = 
-            &dipshp_parse_actions[top_state][symb_index];
-        switch (action->type) {
-        case dipshp_parse_shift: 
-            dipshp_push_slr_state(state, action->number);
-            dipshp_push_slr_symbol(state, symb);
-            return dipsh_parser_accepted;
-        case dipshp_parse_reduce: 
-            dipshp_handle_reduce(state, action);
-            break;
-        case dipshp_parse_accept: {
-            dipshp_parse_action acc_act = { dipshp_parse_reduce, 0 };
-            dipshp_handle_reduce(state, &acc_act);
+        int top_state = dipshp_top_slr_state(state);
+        int action = dipshp_parse_actions[top_state][symb_id];
+        if (action > 0) {
+            dipsh_ast_node node;
+            if (0 != dipshp_make_terminal_node(state, type, token, &node) ||
+                0 != dipshp_push_slr_entry(state, action, &node)) {
+                break;
+            }
             return dipsh_parser_accepted;
-        }
-        default:
-            if (symb->type & dipsh_symbol_terminal) {
+        } else if (action < 0) {
+            if (0 != dipshp_handle_reduce(state, -1 - action))
+                break;
+            /* reducing by the start rule accepts */
+            if (-1 == action)
+                return dipsh_parser_accepted;
+        } else {
+            if (token) {
                 DIPSHP_SET_STATE_ERROR_VA(
                     state, DIPSHP_TOKEN_UNEXPECTED_HERE, 
-                    term_symb->token.line, term_symb->token.value
+                    token->line, token->length, token->value
                 );
             } else {
                 DIPSHP_SET_STATE_ERROR_VA(
-                    state, DIPSHP_TOKEN_UNEXPECTED_HERE,
+                    state, DIPSHP_END_UNEXPECTED_HERE,
                     state->last_line, "end of stream"
                 );
             }
             return dipsh_parser_error;
         }
     }
+    DIPSHP_SET_STATE_ERROR(state, DIPSHP_NO_MEMORY);
+    return dipsh_parser_error;
+}
+
+static void
+dipshp_release_words(
+    const char **words,
+    int words_len
+)
+{
+    for (int i = 0; i < words_len; ++i)
+        dipsh_intern_release(words[i]);
+}
+
+void
+dipsh_ast_clean(
+    dipsh_ast *ast
+)
+{
+    dipshp_release_words(ast->words, ast->words_len);
+    ast->words_len = 0;
 }
 
 dipsh_parser_state *
 dipsh_parser_state_init()
 {
     dipsh_parser_state *result = calloc(sizeof(dipsh_parser_state), 1);
-    result->clear_symbol_stack = 1;
-    dipshp_push_slr_state(result, 0);
+    if (!result)
+        return NULL;
+    dipsh_parser_state_reset(result);
+    if (result->error) {
+        dipsh_parser_state_destroy(result);
+        return NULL;
+    }
     return result;
 }
 
@@ -648,13 +363,52 @@ dipsh_parser_state_destroy(
 {
     if (state->error)
         free(state->error);
-    dipshp_parser_state_destroy_stack(state->state_stack, 0);
-    dipshp_parser_state_destroy_stack(
-        state->symbol_stack, state->clear_symbol_stack
-    );
+    dipshp_release_words(state->words, state->words_len);
+    free(state->stack);
+    free(state->open_nodes);
+    free(state->nodes);
+    free(state->words);
     free(state);
 }
 
+/* drops what has been parsed, the start state left on the stack; the words, 
+ * if any, are to be released by then */
+static void
+dipshp_parser_start_over(
+    dipsh_parser_state *state
+)
+{
+    /* the start state is the only one there is no symbol for */
+    state->stack_len = 1;
+    state->open_nodes_len = 0;
+    /* room for the root */
+    state->nodes_len = 1;
+    state->words_len = 0;
+}
+
+void
+dipsh_parser_state_reset(
+    dipsh_parser_state *state
+)
+{
+    if (state->error) {
+        free(state->error);
+        state->error = NULL;
+    }
+    state->last_line = 0;
+    dipshp_release_words(state->words, state->words_len);
+    state->words_len = 0;
+    state->stack_len = 0;
+    state->nodes_len = 0;
+    dipsh_ast_node none = { dipsh_symbol_error };
+    /* only the first reset, the one of init, may need memory for that */
+    if (0 != dipshp_push_slr_entry(state, 0, &none) ||
+        0 != DIPSHP_RESERVE(state, nodes, 1)) {
+        DIPSHP_SET_STATE_ERROR(state, DIPSHP_NO_MEMORY);
+    }
+    dipshp_parser_start_over(state);
+}
+
 const char *
 dipsh_parser_state_get_error(
     const dipsh_parser_state *state
@@ -663,25 +417,22 @@ dipsh_parser_state_get_error(
     return state->error;
 }
 
-static const struct 
-{
-    dipsh_token_type token_type;
-    dipsh_symbol_type symbol_type;
-}
-dipshp_tokens_to_symbols[] = {
-    { dipsh_token_word,          dipsh_symbol_word          },
-    { dipsh_token_amp,           dipsh_symbol_bg            },
-    { dipsh_token_dbl_amp,       dipsh_symbol_and           },
-    { dipsh_token_bar,           dipsh_symbol_pipe_bar      },
-    { dipsh_token_dbl_bar,       dipsh_symbol_or            },
-    { dipsh_token_semicolon,     dipsh_symbol_seq           },
-    { dipsh_token_lt,            dipsh_symbol_redir_in      },
-    { dipsh_token_gt,            dipsh_symbol_redir_out     },
-    { dipsh_token_dbl_gt,        dipsh_symbol_redir_app     },
-    { dipsh_token_digits_lt,     dipsh_symbol_redir_dig_in  },
-    { dipsh_token_digits_gt,     dipsh_symbol_redir_dig_out },
-    { dipsh_token_digits_dbl_gt, dipsh_symbol_redir_dig_app },
-    { dipsh_token_newline,       dipsh_symbol_newline       }
+/* the symbols of the token types, 0 for those the grammar doesn't know */
+static const dipsh_symbol_type dipshp_token_symbols[] = {
+    [dipsh_token_word]          = dipsh_symbol_word,
+    [dipsh_token_amp]           = dipsh_symbol_bg,
+    [dipsh_token_dbl_amp]       = dipsh_symbol_and,
+    [dipsh_token_bar]           = dipsh_symbol_pipe_bar,
+    [dipsh_token_dbl_bar]       = dipsh_symbol_or,
+    [dipsh_token_semicolon]     = dipsh_symbol_seq,
+    [dipsh_token_lt]            = dipsh_symbol_redir_in,
+    [dipsh_token_gt]            = dipsh_symbol_redir_out,
+    [dipsh_token_dbl_gt]        = dipsh_symbol_redir_app,
+    [dipsh_token_digits_lt]     = dipsh_symbol_redir_dig_in,
+    [dipsh_token_digits_gt]     = dipsh_symbol_redir_dig_out,
+    [dipsh_token_digits_dbl_gt] = dipsh_symbol_redir_dig_app,
+    [dipsh_token_newline]       = dipsh_symbol_newline,
+    [dipsh_token_error]         = 0
 };
 
 static dipsh_symbol_type
@@ -689,210 +440,109 @@ dipshp_token_type_to_symbol_type(
     dipsh_token_type token_type
 )
 {
-    int tokens_to_symbols_len = sizeof(dipshp_tokens_to_symbols) /
-        sizeof(dipshp_tokens_to_symbols[0]);
-    for (int i = 0; i < tokens_to_symbols_len; ++i) {
-        if (dipshp_tokens_to_symbols[i].token_type == token_type)
-            return dipshp_tokens_to_symbols[i].symbol_type;
-    }
-    return dipsh_symbol_error;
-}
-
-static dipsh_symbol *
-dipshp_token_to_symbol(
-    const dipsh_token *token
-)
-{
-    dipsh_terminal *result = calloc(sizeof(dipsh_terminal), 1);
-    result->symb.type = dipshp_token_type_to_symbol_type(token->type);
-    dipsh_token_init(&result->token, token->type, token->line, token->value);
-    return (dipsh_symbol *)result;
+    dipsh_symbol_type type = dipshp_token_symbols[token_type];
+    return type ? type : dipsh_symbol_error;
 }
 
 int
 dipsh_parser_next_token(
     dipsh_parser_state *state,
-    const dipsh_token *token
+    dipsh_token *token
 )
 {
-    dipsh_symbol *symb = dipshp_token_to_symbol(token);
-    int ret = dipshp_parser_next_symbol(state, symb);
-    if (dipsh_parser_error == ret)
-        dipsh_symbol_clear(symb);
-    return ret;
+    /* blank lines before the first command have nothing to separate */
+    if (1 == state->stack_len && dipsh_token_newline == token->type)
+        return dipsh_parser_accepted;
+    return dipshp_parser_next_symbol(
+        state, dipshp_token_type_to_symbol_type(token->type), token
+    );
 }
 
-int
-dipsh_parser_finish(
+/* closes the list of a script into the root of the AST, and copies the 
+ * AST into arena, the references to the words going with it; the parser 
+ * starts over then */
+static int
+dipshp_take_ast(
     dipsh_parser_state *state,
-    dipsh_symbol **parse_tree_root
+    dipsh_ast_node *script,
+    dipsh_arena *arena,
+    dipsh_ast *ast
 )
 {
-    dipsh_symbol symb = { dipsh_symbol_end_of_stream };
-    int return_val = dipshp_parser_next_symbol(state, &symb);
-    if (dipsh_parser_accepted == return_val) {
-        state->clear_symbol_stack = 0;
-        *parse_tree_root = state->symbol_stack->symb;
+    script->type = dipsh_symbol_script;
+    if (0 != dipshp_close_list(state, script, 0)) {
+        DIPSHP_SET_STATE_ERROR(state, DIPSHP_NO_MEMORY);
+        return dipsh_parser_error;
     }
-    return return_val;
-}
-
-int
-dipsh_parse_token_list(
-    dipsh_token_list *token_list,
-    dipsh_symbol **parse_tree_root,
-    char **parser_error
-)
-{
-    dipsh_parser_state *state = dipsh_parser_state_init();
-
-    int parser_ret;
-    for (dipsh_token_list *curr = token_list; curr; curr = curr->next) {
-        parser_ret = dipsh_parser_next_token(state, &curr->token);
-        if (dipsh_parser_accepted != parser_ret) 
-            break; 
+    state->nodes[0] = *script;
+    ast->nodes_len = state->nodes_len;
+    ast->words_len = state->words_len;
+    ast->nodes = 
+        dipsh_arena_alloc(arena, ast->nodes_len * sizeof(dipsh_ast_node));
+    ast->words = 
+        dipsh_arena_alloc(arena, ast->words_len * sizeof(const char *));
+    if (!ast->nodes || !ast->words) {
+        DIPSHP_SET_STATE_ERROR(state, DIPSHP_NO_MEMORY);
+        return dipsh_parser_error;
     }
-    if (dipsh_parser_accepted == parser_ret)
-        parser_ret = dipsh_parser_finish(state, parse_tree_root);
-    if (dipsh_parser_accepted != parser_ret && parser_error)
-        *parser_error = strdup(dipsh_parser_state_get_error(state));
-
-    dipsh_parser_state_destroy(state);
-    return parser_ret;
+    memcpy(ast->nodes, state->nodes, ast->nodes_len * sizeof(dipsh_ast_node));
+    memcpy(ast->words, state->words, ast->words_len * sizeof(const char *));
+    dipshp_parser_start_over(state);
+    return dipsh_parser_accepted;
 }
 
-static void
-dipshp_prune_terminals(
-    dipsh_nonterminal_child **list
-)
-{
-    dipsh_nonterminal_child **curr = list;
-    while (*curr) {
-        if ((*curr)->child->type & dipsh_symbol_terminal) {
-            dipsh_nonterminal_child *temp = *curr;
-            *curr = (*curr)->next;
-            dipsh_symbol_clear(temp->child);
-            free(temp);
-        } else {
-            curr = &((*curr)->next);
-        }
-    }
+int
+dipsh_parser_finish(
+    dipsh_parser_state *state,
+    dipsh_arena *arena,
+    dipsh_ast *ast
+)
+{
+    ast->nodes_len = 0;
+    if (1 == state->stack_len)
+        return dipsh_parser_accepted;
+    int return_val = 
+        dipshp_parser_next_symbol(state, dipsh_symbol_end_of_stream, NULL);
+    if (dipsh_parser_accepted != return_val)
+        return return_val;
+    return dipshp_take_ast(
+        state, &state->stack[state->stack_len - 1].node, arena, ast
+    );
 }
 
-static void
-dipshp_flatten_left_recursion(
-    dipsh_symbol **parse_tree_root,
-    dipsh_symbol_type symb_to_flatten,
-    int preserve_terminals
+int
+dipsh_parser_take_statement(
+    dipsh_parser_state *state,
+    dipsh_arena *arena,
+    dipsh_ast *ast
 )
 {
-    dipsh_nonterminal_child *flat_children = NULL;
-    dipsh_nonterminal_child *root_children =
-        (*(dipsh_nonterminal **)parse_tree_root)->children_list;
-    if (symb_to_flatten != root_children->child->type)
-        return;
-    while (root_children) {
-        dipsh_nonterminal_child *temp = NULL;
-        if (symb_to_flatten == root_children->child->type) {
-            temp = root_children;
-            root_children = root_children->next;
-        }
-        dipsh_nonterminal_child **root_children_end = &root_children;
-        while (*root_children_end)
-            root_children_end = &((*root_children_end)->next);
-        *root_children_end = flat_children;
-        flat_children = root_children;
-        if (temp) {
-            root_children = ((dipsh_nonterminal *)temp->child)->children_list;
-            free(temp->child);
-            free(temp);
-        } else {
-            root_children = NULL; 
-        }
+    /* everything parsed so far has been reduced to strings, and the newline 
+     * after it is all that is left to shift */
+    dipshp_parser_stack_entry *stack = state->stack;
+    if (3 != state->stack_len || 
+        dipsh_symbol_strings != stack[1].node.type ||
+        dipsh_symbol_newline != stack[2].node.type) {
+        return 0;
     }
-    if (!preserve_terminals)
-        dipshp_prune_terminals(&flat_children);
-    (*(dipsh_nonterminal **)parse_tree_root)->children_list = flat_children;
-}
-
-#define DIPSHP_DEFINE_FLATTEN_FUNCTION(sn, fsn, isn, pt)                       \
-static void                                                                    \
-dipshp_flatten_##sn(                                                           \
-    dipsh_symbol **sn##_root                                                   \
-)                                                                              \
-{                                                                              \
-    dipshp_flatten_left_recursion(sn##_root, dipsh_symbol_##fsn, pt);          \
-    dipsh_nonterminal_child *children =                                        \
-        (*(dipsh_nonterminal **)sn##_root)->children_list;                     \
-    while (children) {                                                         \
-        if (dipsh_symbol_##isn == children->child->type)                       \
-            dipshp_flatten_##isn(&children->child);                            \
-        children = children->next;                                             \
-    }                                                                          \
+    int ret = dipshp_take_ast(state, &stack[1].node, arena, ast);
+    return dipsh_parser_accepted == ret ? 1 : -1;
 }
 
-static void
-dipshp_flatten_command(
-    dipsh_symbol **command_root
-)
-{
-    dipshp_flatten_left_recursion(command_root, dipsh_symbol_command, 1);
-}
-
-DIPSHP_DEFINE_FLATTEN_FUNCTION(pipe, pipe, command, 0)
-DIPSHP_DEFINE_FLATTEN_FUNCTION(and_or, and_or, pipe, 1)
-DIPSHP_DEFINE_FLATTEN_FUNCTION(seq_bg_start, seq_bg, and_or, 1)
-DIPSHP_DEFINE_FLATTEN_FUNCTION(script, strings, seq_bg_start, 0)
-
-static void
-dipshp_clean_chains_int(
-    dipsh_symbol **subtree_root
+int
+dipsh_parse_tokens(
+    dipsh_parser_state *state,
+    dipsh_token_vec *tokens,
+    dipsh_arena *arena,
+    dipsh_ast *ast
 )
 {
-    if (!((*subtree_root)->type & dipsh_symbol_nonterminal))
-        return;
-    dipsh_nonterminal_child *children;
-    do {
-        children = (*(dipsh_nonterminal **)subtree_root)->children_list;
-        int in_chain = !children->next && 
-            (children->child->type & dipsh_symbol_nonterminal);
-        if (in_chain) {
-            dipsh_nonterminal *temp = *(dipsh_nonterminal **)subtree_root;
-            *subtree_root = children->child;
-            free(children);
-            free(temp);
-        } else {
-            break;
-        }
-    } while (1);
-    children = (*(dipsh_nonterminal **)subtree_root)->children_list;
-    while (children) {
-        if (children->child->type & dipsh_symbol_nonterminal)
-            dipshp_clean_chains_int(&children->child);
-        children = children->next;
+    dipsh_parser_state_reset(state);
+    int parser_ret = dipsh_parser_accepted;
+    for (int i = 0; i < tokens->length; ++i) {
+        parser_ret = dipsh_parser_next_token(state, &tokens->tokens[i]);
+        if (dipsh_parser_accepted != parser_ret) 
+            return parser_ret; 
     }
-}
-
-static void
-dipshp_clean_chains(
-    dipsh_symbol **parse_tree_root
-)
-{
-    dipsh_nonterminal_child *children =
-        (*(dipsh_nonterminal **)parse_tree_root)->children_list;
-    while (children) {
-        dipshp_clean_chains_int(&children->child);
-        children = children->next;
-    } 
-}
-
-void
-dipsh_make_ast(
-    dipsh_symbol **parse_tree_root
-)
-{
-    if (dipsh_symbol_script != (*parse_tree_root)->type)
-        return;
-    dipshp_flatten_script(parse_tree_root);
-    dipshp_clean_chains(parse_tree_root);
+    return dipsh_parser_finish(state, arena, ast);
 }
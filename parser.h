@@ -3,6 +3,7 @@
 
 #include "token.h"
 #include "lexer.h"
+#include "arena.h"
 
 typedef enum dipsh_symbol_type_tag
 {
@@ -42,40 +43,45 @@ dipsh_symbol_type_to_string(
     dipsh_symbol_type type
 );
 
-typedef struct dipsh_symbol_tag
+/* the AST is a flat array of nodes, the root first, where the children of 
+ * a node are next to each other; the words are the interned strings the 
+ * lexer has made, which the AST holds references to */
+typedef struct dipsh_ast_node_tag
 {
     dipsh_symbol_type type;
+    union
+    {
+        int first_child;    /* an index in nodes */
+        int word;           /* for terminals, an index in words */
+    };
+    union
+    {
+        int children_len;
+        int word_len;
+    };
 }
-dipsh_symbol;
+dipsh_ast_node;
 
-typedef struct dipsh_nonterminal_child_tag
+typedef struct dipsh_ast_tag
 {
-    dipsh_symbol *child;
-    struct dipsh_nonterminal_child_tag *next;
-} 
-dipsh_nonterminal_child;
-
-typedef struct dipsh_nonterminal_tag
-{
-    dipsh_symbol symb;
-    dipsh_nonterminal_child *children_list;
+    dipsh_ast_node *nodes;
+    int nodes_len;
+    const char **words;
+    int words_len;
 }
-dipsh_nonterminal;
-
-typedef struct dipsh_terminal_tag
-{
-    dipsh_symbol symb;
-    dipsh_token token;
-}
-dipsh_terminal;
+dipsh_ast;
 
+/* releases the words; the nodes go with the arena the AST is in */
 void
-dipsh_symbol_clear(
-    dipsh_symbol *symb
+dipsh_ast_clean(
+    dipsh_ast *ast
 );
 
 typedef struct dipsh_parser_state_tag dipsh_parser_state;
 
+/* the AST is built as the rules are reduced, in memory the parser keeps 
+ * from one parse to another; once a script is parsed, its AST is copied 
+ * into an arena, so it's freed by resetting the arena */
 dipsh_parser_state *
 dipsh_parser_state_init();
 
@@ -84,6 +90,13 @@ dipsh_parser_state_destroy(
     dipsh_parser_state *state
 );
 
+/* back to the state right after init, with the error cleared and the 
+ * memory kept */
+void
+dipsh_parser_state_reset(
+    dipsh_parser_state *state
+);
+
 const char *
 dipsh_parser_state_get_error(
     const dipsh_parser_state *state
@@ -95,28 +108,43 @@ enum
     dipsh_parser_error = 1
 };
 
+/* the reference to the interned word of the token, if it has one, is taken 
+ * over as it's shifted, the token being left as a slice of the word */
 int
 dipsh_parser_next_token(
     dipsh_parser_state *state,
-    const dipsh_token *token
+    dipsh_token *token
 );
 
+/* the AST goes to arena; ast->nodes_len is 0 if there has been nothing to 
+ * parse */
 int
 dipsh_parser_finish(
     dipsh_parser_state *state,
-    dipsh_symbol **parse_tree_root
+    dipsh_arena *arena,
+    dipsh_ast *ast
 );
 
+/* takes the statement parsed so far as a script AST, if a newline has just 
+ * completed it at the top level; the parser starts over then, so that a 
+ * script can be run statement by statement. Returns 1 if there has been 
+ * such a statement, 0 otherwise, and -1 if there is no memory for it (the 
+ * error is the state's then) */
 int
-dipsh_parse_token_list(
-    dipsh_token_list *token_list,
-    dipsh_symbol **parse_tree_root,
-    char **parser_error
+dipsh_parser_take_statement(
+    dipsh_parser_state *state,
+    dipsh_arena *arena,
+    dipsh_ast *ast
 );
 
-void
-dipsh_make_ast(
-    dipsh_symbol **parse_tree_root
+/* parses all the tokens, resetting state first; the error, if any, is the 
+ * state's */
+int
+dipsh_parse_tokens(
+    dipsh_parser_state *state,
+    dipsh_token_vec *tokens,
+    dipsh_arena *arena,
+    dipsh_ast *ast
 );
 
 #endif /* _DIPSH_PARSER_H_ */
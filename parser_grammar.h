@@ -0,0 +1,150 @@
+#ifndef _DIPSH_PARSER_GRAMMAR_H_
+#define _DIPSH_PARSER_GRAMMAR_H_
+
+#include "parser.h"
+
+/* the grammar of the shell, the first rule being the start one; both the 
+ * parser and the generator of its tables (tools/parser_gen.c) include it, 
+ * and parser_tables.h has to be generated again once it is changed */
+
+/* what a reduction makes of the nodes of the right-hand symbols: the 
+ * nonterminals are lists of children, built as their rules are reduced, 
+ * and the punctuation terminals have no nodes */
+typedef enum dipshp_ast_action_tag
+{
+    /* a new list, the nodes being its children */
+    dipshp_ast_new,
+    /* the list of the first symbol, with the other nodes appended to it; 
+     * this is how left recursion turns into flat lists */
+    dipshp_ast_extend
+}
+dipshp_ast_action;
+
+typedef struct dipshp_grammar_rule_tag
+{
+    dipsh_symbol_type left_hand_symb;
+    dipshp_ast_action ast_action;
+    int right_hand_size;
+    const dipsh_symbol_type *right_hand_symb;
+}
+dipshp_grammar_rule;
+
+#define DIPSHP_DEFINE_GRAMMAR_RULE(rule_name, left_hand, action, ...)      \
+static const dipsh_symbol_type dipshp_right_hand_##rule_name[] =           \
+    { __VA_ARGS__ };                                                       \
+static const dipshp_grammar_rule rule_name = {                             \
+    left_hand,                                                             \
+    action,                                                                \
+    sizeof(dipshp_right_hand_##rule_name) / sizeof(dipsh_symbol_type),     \
+    dipshp_right_hand_##rule_name                                          \
+};
+
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    start, dipsh_symbol_script, dipshp_ast_extend, 
+    dipsh_symbol_strings
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    strings_1, dipsh_symbol_strings, dipshp_ast_new,
+    dipsh_symbol_seq_bg_start
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    strings_2, dipsh_symbol_strings, dipshp_ast_extend,
+    dipsh_symbol_strings, dipsh_symbol_newline
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    strings_3, dipsh_symbol_strings, dipshp_ast_extend,
+    dipsh_symbol_strings, dipsh_symbol_newline, dipsh_symbol_seq_bg_start
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    seq_bg_start_1, dipsh_symbol_seq_bg_start, dipshp_ast_extend,
+    dipsh_symbol_seq_bg
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    seq_bg_start_2, dipsh_symbol_seq_bg_start, dipshp_ast_extend,
+    dipsh_symbol_seq_bg, dipsh_symbol_bg
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    seq_bg_start_3, dipsh_symbol_seq_bg_start, dipshp_ast_extend,
+    dipsh_symbol_seq_bg, dipsh_symbol_seq
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    seq_bg_1, dipsh_symbol_seq_bg, dipshp_ast_new,
+    dipsh_symbol_and_or
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    seq_bg_2, dipsh_symbol_seq_bg, dipshp_ast_extend,
+    dipsh_symbol_seq_bg, dipsh_symbol_bg, dipsh_symbol_and_or
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    seq_bg_3, dipsh_symbol_seq_bg, dipshp_ast_extend,
+    dipsh_symbol_seq_bg, dipsh_symbol_seq, dipsh_symbol_and_or
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    and_or_1, dipsh_symbol_and_or, dipshp_ast_new,
+    dipsh_symbol_pipe
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    and_or_2, dipsh_symbol_and_or, dipshp_ast_extend,
+    dipsh_symbol_and_or, dipsh_symbol_and, dipsh_symbol_pipe
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    and_or_3, dipsh_symbol_and_or, dipshp_ast_extend,
+    dipsh_symbol_and_or, dipsh_symbol_or, dipsh_symbol_pipe
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    pipe_1, dipsh_symbol_pipe, dipshp_ast_new,
+    dipsh_symbol_command
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    pipe_2, dipsh_symbol_pipe, dipshp_ast_extend,
+    dipsh_symbol_pipe, dipsh_symbol_pipe_bar, dipsh_symbol_command
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    command_1, dipsh_symbol_command, dipshp_ast_new,
+    dipsh_symbol_word
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    command_2, dipsh_symbol_command, dipshp_ast_extend,
+    dipsh_symbol_command, dipsh_symbol_word
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    command_3, dipsh_symbol_command, dipshp_ast_extend,
+    dipsh_symbol_command, dipsh_symbol_redir
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    redir_1, dipsh_symbol_redir, dipshp_ast_new,
+    dipsh_symbol_redir_out, dipsh_symbol_word
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    redir_2, dipsh_symbol_redir, dipshp_ast_new,
+    dipsh_symbol_redir_in, dipsh_symbol_word
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    redir_3, dipsh_symbol_redir, dipshp_ast_new,
+    dipsh_symbol_redir_app, dipsh_symbol_word
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    redir_4, dipsh_symbol_redir, dipshp_ast_new,
+    dipsh_symbol_redir_dig_out, dipsh_symbol_word
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    redir_5, dipsh_symbol_redir, dipshp_ast_new,
+    dipsh_symbol_redir_dig_in, dipsh_symbol_word
+)
+DIPSHP_DEFINE_GRAMMAR_RULE(
+    redir_6, dipsh_symbol_redir, dipshp_ast_new,
+    dipsh_symbol_redir_dig_app, dipsh_symbol_word
+)
+
+static const dipshp_grammar_rule *dipshp_grammar_rules[] = {
+    &start,
+    &strings_1, &strings_2, &strings_3,
+    &seq_bg_start_1, &seq_bg_start_2, &seq_bg_start_3,
+    &seq_bg_1, &seq_bg_2, &seq_bg_3,
+    &and_or_1, &and_or_2, &and_or_3,
+    &pipe_1, &pipe_2,
+    &command_1, &command_2, &command_3,
+    &redir_1, &redir_2, &redir_3, &redir_4, &redir_5, &redir_6
+};
+
+#endif /* _DIPSH_PARSER_GRAMMAR_H_ */
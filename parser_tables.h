@@ -0,0 +1,159 @@
+#ifndef _DIPSH_PARSER_TABLES_H_
+#define _DIPSH_PARSER_TABLES_H_
+
+/* generated by tools/parser_gen.c from parser_grammar.h, do not edit.
+ * The terminals and the nonterminals are numbered densely, in the order of
+ * dipsh_symbol_type, end_of_stream being the last terminal. An action is
+ * 0 for an error, a positive number of the state to shift to, or -1 - n
+ * to reduce by the rule n, the start rule accepting; a goto is the state
+ * to go to after a nonterminal has been reduced */
+
+#define DIPSHP_TOTAL_STATES 34
+#define DIPSHP_TERMINALS_NUM 14
+#define DIPSHP_NONTERMINALS_NUM 8
+
+static const signed char
+dipshp_parse_actions[DIPSHP_TOTAL_STATES][DIPSHP_TERMINALS_NUM] = {
+    /* 0 */
+    { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 1 */
+    { -16, -16, -16, -16, -16, -16, -16, -16, -16, -16, -16, -16, -16, -16 },
+    /* 2 */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, -1 },
+    /* 3 */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -2, -2 },
+    /* 4 */
+    { 9, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -5, -5 },
+    /* 5 */
+    { -8, -8, 11, 12, 0, 0, 0, 0, 0, 0, 0, 0, -8, -8 },
+    /* 6 */
+    { -11, -11, -11, -11, 13, 0, 0, 0, 0, 0, 0, 0, -11, -11 },
+    /* 7 */
+    { -14, -14, -14, -14, -14, 14, 15, 16, 17, 18, 19, 20, -14, -14 },
+    /* 8 */
+    { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, -3, -3 },
+    /* 9 */
+    { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, -7, -7 },
+    /* 10 */
+    { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, -6, -6 },
+    /* 11 */
+    { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 12 */
+    { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 13 */
+    { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 14 */
+    { -17, -17, -17, -17, -17, -17, -17, -17, -17, -17, -17, -17, -17, -17 },
+    /* 15 */
+    { 0, 0, 0, 0, 0, 28, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 16 */
+    { 0, 0, 0, 0, 0, 29, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 17 */
+    { 0, 0, 0, 0, 0, 30, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 18 */
+    { 0, 0, 0, 0, 0, 31, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 19 */
+    { 0, 0, 0, 0, 0, 32, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 20 */
+    { 0, 0, 0, 0, 0, 33, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 21 */
+    { -18, -18, -18, -18, -18, -18, -18, -18, -18, -18, -18, -18, -18, -18 },
+    /* 22 */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -4, -4 },
+    /* 23 */
+    { -10, -10, 11, 12, 0, 0, 0, 0, 0, 0, 0, 0, -10, -10 },
+    /* 24 */
+    { -9, -9, 11, 12, 0, 0, 0, 0, 0, 0, 0, 0, -9, -9 },
+    /* 25 */
+    { -12, -12, -12, -12, 13, 0, 0, 0, 0, 0, 0, 0, -12, -12 },
+    /* 26 */
+    { -13, -13, -13, -13, 13, 0, 0, 0, 0, 0, 0, 0, -13, -13 },
+    /* 27 */
+    { -15, -15, -15, -15, -15, 14, 15, 16, 17, 18, 19, 20, -15, -15 },
+    /* 28 */
+    { -19, -19, -19, -19, -19, -19, -19, -19, -19, -19, -19, -19, -19, -19 },
+    /* 29 */
+    { -20, -20, -20, -20, -20, -20, -20, -20, -20, -20, -20, -20, -20, -20 },
+    /* 30 */
+    { -21, -21, -21, -21, -21, -21, -21, -21, -21, -21, -21, -21, -21, -21 },
+    /* 31 */
+    { -22, -22, -22, -22, -22, -22, -22, -22, -22, -22, -22, -22, -22, -22 },
+    /* 32 */
+    { -23, -23, -23, -23, -23, -23, -23, -23, -23, -23, -23, -23, -23, -23 },
+    /* 33 */
+    { -24, -24, -24, -24, -24, -24, -24, -24, -24, -24, -24, -24, -24, -24 },
+};
+
+static const unsigned char
+dipshp_parse_gotos[DIPSHP_TOTAL_STATES][DIPSHP_NONTERMINALS_NUM] = {
+    /* 0 */
+    { 0, 2, 3, 4, 5, 6, 7, 0 },
+    /* 1 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 2 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 3 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 4 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 5 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 6 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 7 */
+    { 0, 0, 0, 0, 0, 0, 0, 21 },
+    /* 8 */
+    { 0, 0, 22, 4, 5, 6, 7, 0 },
+    /* 9 */
+    { 0, 0, 0, 0, 23, 6, 7, 0 },
+    /* 10 */
+    { 0, 0, 0, 0, 24, 6, 7, 0 },
+    /* 11 */
+    { 0, 0, 0, 0, 0, 25, 7, 0 },
+    /* 12 */
+    { 0, 0, 0, 0, 0, 26, 7, 0 },
+    /* 13 */
+    { 0, 0, 0, 0, 0, 0, 27, 0 },
+    /* 14 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 15 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 16 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 17 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 18 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 19 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 20 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 21 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 22 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 23 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 24 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 25 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 26 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 27 */
+    { 0, 0, 0, 0, 0, 0, 0, 21 },
+    /* 28 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 29 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 30 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 31 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 32 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* 33 */
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+#endif /* _DIPSH_PARSER_TABLES_H_ */
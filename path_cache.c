@@ -0,0 +1,389 @@
+#include "path_cache.h"
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define DIPSHP_PATH_CACHE_INITIAL_BUCKETS 64
+#define DIPSHP_INOTIFY_MASK                                                    \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |         \
+     IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct dipshp_path_entry_tag
+{
+    const char *name;   /* interned */
+    char *path;         /* NULL for a negative entry */
+    unsigned hash;
+    unsigned long hits;
+    struct dipshp_path_entry_tag *next;
+}
+dipshp_path_entry;
+
+static struct
+{
+    dipshp_path_entry **buckets;
+    int buckets_len;
+    int entries_len;
+
+    /* the PATH value the entries have been resolved against */
+    char *path_var;
+    /* caching is off when PATH depends on the working directory or inotify
+     * is unavailable */
+    int enabled;
+    int inotify_fd;
+
+    char *scratch;
+    int scratch_cap;
+
+    unsigned long hits;
+    unsigned long misses;
+}
+dipshp_cache = {
+    .inotify_fd = -1
+};
+
+static void
+dipshp_free_entry(
+    dipshp_path_entry *entry
+)
+{
+    dipsh_intern_release(entry->name);
+    free(entry->path);
+    free(entry);
+}
+
+static void
+dipshp_clear_entries()
+{
+    for (int i = 0; i < dipshp_cache.buckets_len; ++i) {
+        dipshp_path_entry *entry = dipshp_cache.buckets[i];
+        while (entry) {
+            dipshp_path_entry *temp = entry;
+            entry = entry->next;
+            dipshp_free_entry(temp);
+        }
+    }
+    free(dipshp_cache.buckets);
+    dipshp_cache.buckets = NULL;
+    dipshp_cache.buckets_len = 0;
+    dipshp_cache.entries_len = 0;
+}
+
+void
+dipsh_path_cache_reset()
+{
+    dipshp_clear_entries();
+    if (-1 != dipshp_cache.inotify_fd)
+        close(dipshp_cache.inotify_fd);
+    dipshp_cache.inotify_fd = -1;
+    free(dipshp_cache.path_var);
+    dipshp_cache.path_var = NULL;
+    dipshp_cache.enabled = 0;
+}
+
+static const char *
+dipshp_get_path_var()
+{
+    const char *path_var = getenv("PATH");
+    /* the same default execvp uses */
+    return path_var ? path_var : "/bin:/usr/bin";
+}
+
+static int
+dipshp_watch_path_dirs(
+    const char *path_var
+)
+{
+    dipshp_cache.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (-1 == dipshp_cache.inotify_fd)
+        return 1;
+    const char *dir = path_var;
+    for (;;) {
+        const char *dir_end = strchrnul(dir, ':');
+        /* relative directories make the resolution depend on the cwd */
+        if (dir_end == dir || '/' != *dir)
+            return 1;
+        /* a directory that can't be watched (normally a missing one) is 
+         * assumed to stay this way till PATH changes or 'hash -r' */
+        char *dir_copy = strndup(dir, dir_end - dir);
+        inotify_add_watch(
+            dipshp_cache.inotify_fd, dir_copy, DIPSHP_INOTIFY_MASK
+        );
+        free(dir_copy);
+        if (!*dir_end)
+            break;
+        dir = dir_end + 1;
+    }
+    return 0;
+}
+
+static void
+dipshp_sync_path_var()
+{
+    const char *path_var = dipshp_get_path_var();
+    int same_path_var = 
+        dipshp_cache.path_var && 0 == strcmp(dipshp_cache.path_var, path_var);
+    if (same_path_var)
+        return;
+    dipsh_path_cache_reset();
+    dipshp_cache.path_var = strdup(path_var);
+    dipshp_cache.enabled = 0 == dipshp_watch_path_dirs(path_var);
+    if (!dipshp_cache.enabled && -1 != dipshp_cache.inotify_fd) {
+        close(dipshp_cache.inotify_fd);
+        dipshp_cache.inotify_fd = -1;
+    }
+}
+
+static dipshp_path_entry **
+dipshp_find_entry(
+    const char *name,
+    unsigned hash
+)
+{
+    if (!dipshp_cache.buckets_len)
+        return NULL;
+    dipshp_path_entry **entry =
+        &dipshp_cache.buckets[hash & (dipshp_cache.buckets_len - 1)];
+    for (; *entry; entry = &(*entry)->next) {
+        if ((*entry)->name == name)
+            return entry;
+    }
+    return entry;
+}
+
+static void
+dipshp_remove_entry(
+    const char *name
+)
+{
+    /* a name no one holds can't be in the cache */
+    const char *interned = dipsh_intern_find(name, strlen(name));
+    if (!interned)
+        return;
+    dipshp_path_entry **entry = 
+        dipshp_find_entry(interned, dipsh_intern_hash(interned));
+    if (!entry || !*entry)
+        return;
+    dipshp_path_entry *temp = *entry;
+    *entry = temp->next;
+    dipshp_free_entry(temp);
+    --dipshp_cache.entries_len;
+}
+
+static void
+dipshp_handle_inotify_events()
+{
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        int len = read(dipshp_cache.inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            return;
+        for (char *pos = buf; pos < buf + len; ) {
+            const struct inotify_event *event = (struct inotify_event *)pos;
+            if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED |
+                               IN_DELETE_SELF | IN_MOVE_SELF)) {
+                /* lost events or a directory is gone: start over */
+                dipsh_path_cache_reset();
+                return;
+            }
+            /* only the entry with this very name may resolve differently */
+            if (event->len)
+                dipshp_remove_entry(event->name);
+            pos += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+static void
+dipshp_refresh()
+{
+    dipshp_sync_path_var();
+    if (!dipshp_cache.enabled)
+        return;
+    dipshp_handle_inotify_events();
+    /* the events may have reset the cache */
+    if (!dipshp_cache.path_var)
+        dipshp_sync_path_var();
+}
+
+static void
+dipshp_grow_buckets()
+{
+    int new_len = dipshp_cache.buckets_len
+        ? 2 * dipshp_cache.buckets_len
+        : DIPSHP_PATH_CACHE_INITIAL_BUCKETS;
+    dipshp_path_entry **new_buckets =
+        calloc(sizeof(dipshp_path_entry *), new_len);
+    if (!new_buckets)
+        return;
+    for (int i = 0; i < dipshp_cache.buckets_len; ++i) {
+        dipshp_path_entry *entry = dipshp_cache.buckets[i];
+        while (entry) {
+            dipshp_path_entry *temp = entry;
+            entry = entry->next;
+            dipshp_path_entry **bucket = 
+                &new_buckets[temp->hash & (new_len - 1)];
+            temp->next = *bucket;
+            *bucket = temp;
+        }
+    }
+    free(dipshp_cache.buckets);
+    dipshp_cache.buckets = new_buckets;
+    dipshp_cache.buckets_len = new_len;
+}
+
+static const char *
+dipshp_store_scratch(
+    const char *dir,
+    int dir_len,
+    const char *name
+)
+{
+    int needed = dir_len + strlen(name) + 2;
+    if (needed > dipshp_cache.scratch_cap) {
+        char *new_scratch = realloc(dipshp_cache.scratch, needed);
+        if (!new_scratch)
+            return NULL;
+        dipshp_cache.scratch = new_scratch;
+        dipshp_cache.scratch_cap = needed;
+    }
+    memcpy(dipshp_cache.scratch, dir, dir_len);
+    dipshp_cache.scratch[dir_len] = '/';
+    strcpy(dipshp_cache.scratch + dir_len + 1, name);
+    return dipshp_cache.scratch;
+}
+
+static int
+dipshp_is_executable_file(
+    const char *path
+)
+{
+    struct stat st;
+    return 0 == stat(path, &st) && S_ISREG(st.st_mode) &&
+        0 == access(path, X_OK);
+}
+
+static const char *
+dipshp_resolve_name(
+    const char *name
+)
+{
+    const char *dir = dipshp_cache.path_var;
+    for (;;) {
+        const char *dir_end = strchrnul(dir, ':');
+        /* an empty element means the current directory */
+        const char *path = dir_end == dir
+            ? dipshp_store_scratch(".", 1, name)
+            : dipshp_store_scratch(dir, dir_end - dir, name);
+        if (path && dipshp_is_executable_file(path))
+            return path;
+        if (!*dir_end)
+            return NULL;
+        dir = dir_end + 1;
+    }
+}
+
+static dipshp_path_entry *
+dipshp_store_entry(
+    const char *name,
+    unsigned hash,
+    const char *path
+)
+{
+    if (dipshp_cache.entries_len + 1 > 3 * dipshp_cache.buckets_len / 4)
+        dipshp_grow_buckets();
+    dipshp_path_entry **place = dipshp_find_entry(name, hash);
+    if (!place)
+        return NULL;
+    if (*place) {
+        free((*place)->path);
+        (*place)->path = path ? strdup(path) : NULL;
+        return *place;
+    }
+    dipshp_path_entry *entry = calloc(sizeof(dipshp_path_entry), 1);
+    if (!entry)
+        return NULL;
+    entry->name = dipsh_intern_ref(name);
+    entry->path = path ? strdup(path) : NULL;
+    entry->hash = hash;
+    *place = entry;
+    ++dipshp_cache.entries_len;
+    return entry;
+}
+
+const char *
+dipsh_path_cache_lookup(
+    const char *name
+)
+{
+    if (strchr(name, '/'))
+        return name;
+
+    dipshp_refresh();
+
+    unsigned hash = dipsh_intern_hash(name);
+    dipshp_path_entry **entry =
+        dipshp_cache.enabled ? dipshp_find_entry(name, hash) : NULL;
+    if (entry && *entry) {
+        ++dipshp_cache.hits;
+        ++(*entry)->hits;
+        if (!(*entry)->path)
+            errno = ENOENT;
+        return (*entry)->path;
+    }
+
+    ++dipshp_cache.misses;
+    const char *path = dipshp_resolve_name(name);
+    if (dipshp_cache.enabled) {
+        dipshp_path_entry *new_entry = dipshp_store_entry(name, hash, path);
+        if (new_entry)
+            new_entry->hits = 1;
+    }
+    if (!path)
+        errno = ENOENT;
+    return path;
+}
+
+int
+dipsh_path_cache_add(
+    const char *name
+)
+{
+    if (strchr(name, '/'))
+        return !dipshp_is_executable_file(name);
+
+    dipshp_refresh();
+
+    const char *path = dipshp_resolve_name(name);
+    if (dipshp_cache.enabled)
+        dipshp_store_entry(name, dipsh_intern_hash(name), path);
+    return !path;
+}
+
+void
+dipsh_path_cache_for_each(
+    dipsh_path_cache_entry_cb cb,
+    void *ctx
+)
+{
+    dipshp_refresh();
+    for (int i = 0; i < dipshp_cache.buckets_len; ++i) {
+        const dipshp_path_entry *entry = dipshp_cache.buckets[i];
+        for (; entry; entry = entry->next)
+            cb(entry->name, entry->path, entry->hits, ctx);
+    }
+}
+
+void
+dipsh_path_cache_get_stats(
+    dipsh_path_cache_stats *stats
+)
+{
+    stats->hits = dipshp_cache.hits;
+    stats->misses = dipshp_cache.misses;
+    stats->entries = dipshp_cache.entries_len;
+}
@@ -0,0 +1,56 @@
+#ifndef _DIPSH_PATH_CACHE_H_
+#define _DIPSH_PATH_CACHE_H_
+
+/* shell-wide cache of command name -> absolute path resolutions done against
+ * PATH; names that can't be found are remembered as well (negative entries). 
+ * The entries are kept valid with inotify watches on the PATH directories. 
+ * The names given to the cache must be interned (see intern.h), so that 
+ * they are matched by their pointers */
+
+/* returns the absolute path for the command name, or NULL if it can't be 
+ * found in PATH (errno is set to ENOENT then); names containing a slash are 
+ * returned as is. The result is valid till the next call to any 
+ * dipsh_path_cache function */
+const char *
+dipsh_path_cache_lookup(
+    const char *name
+);
+
+/* resolves the name and stores the result even if it is already cached,
+ * returns 0 if the name has been found */
+int
+dipsh_path_cache_add(
+    const char *name
+);
+
+/* drops all entries and watches, the counters are preserved */
+void
+dipsh_path_cache_reset();
+
+typedef void (*dipsh_path_cache_entry_cb)(
+    const char *name,
+    const char *path,
+    unsigned long hits,
+    void *ctx
+);
+
+void
+dipsh_path_cache_for_each(
+    dipsh_path_cache_entry_cb cb,
+    void *ctx
+);
+
+typedef struct dipsh_path_cache_stats_tag
+{
+    unsigned long hits;
+    unsigned long misses;
+    int entries;
+}
+dipsh_path_cache_stats;
+
+void
+dipsh_path_cache_get_stats(
+    dipsh_path_cache_stats *stats
+);
+
+#endif /* _DIPSH_PATH_CACHE_H_ */
@@ -11,68 +11,74 @@ struct dipsh_pipeline_tag
 {
     dipsh_command **commands;
     int commands_len;
+    /* two for each pipe between the commands */
+    int *pipes_fds;
 
     int execute_blocks;
+    int takes_terminal;
+    int pgid;
+    dipsh_release_barrier barrier;
     int executed;
     dipsh_command_status last_command_status;
 };
 
 static const dipsh_command_traits dipshp_pipeline_command_traits = {
-    .suspend_after_fork = 1,
-    .run_in_separate_group = 0,
-    .will_wait_for_group_change = 0,
-    .execute_blocks = 0
+    .suspend_after_fork = 0,
+    .run_in_separate_group = 1,
+    .process_group = 0,
+    .execute_blocks = 0,
+    .fork_builtins = 1
 };
 
-static const dipsh_command_traits dipshp_pipeline_first_command_traits = {
+/* in an interactive shell the terminal must be handed over to the pipeline's
+ * group before anything runs; builtins get processes of their own in both 
+ * cases, as the rest of the pipeline runs alongside them */
+static const dipsh_command_traits dipshp_interactive_pipeline_command_traits = {
     .suspend_after_fork = 1,
     .run_in_separate_group = 1,
-    .will_wait_for_group_change = 1,
-    .execute_blocks = 0
+    .process_group = 0,
+    .execute_blocks = 0,
+    .fork_builtins = 1
 };
 
 dipsh_pipeline *
 dipsh_pipeline_init(
-    const dipsh_symbol *pipeline_tree,
-    int execute_blocks
+    const dipsh_ast *ast,
+    const dipsh_ast_node *pipeline_node
 )
 {
-    if (dipsh_symbol_pipe != pipeline_tree->type)
+    /* a plain command makes a pipeline of one command */
+    const dipsh_ast_node *children;
+    int children_len;
+    if (dipsh_symbol_pipe == pipeline_node->type) {
+        children = ast->nodes + pipeline_node->first_child;
+        children_len = pipeline_node->children_len;
+    } else if (dipsh_symbol_command == pipeline_node->type) {
+        children = pipeline_node;
+        children_len = 1;
+    } else {
         return NULL;
-
-    const dipsh_nonterminal *pipeline_nt = 
-        (const dipsh_nonterminal *)pipeline_tree;
-    const dipsh_nonterminal_child *children = pipeline_nt->children_list;
+    }
 
     dipsh_pipeline *result = calloc(sizeof(dipsh_pipeline), 1);
     if (!result)
         return NULL;
-    result->execute_blocks = execute_blocks;
-    const dipsh_nonterminal_child *curr = children;
-    while (curr) {
-        ++result->commands_len;
-        curr = curr->next;
-    }
+    dipsh_release_barrier_reset(&result->barrier);
+    result->commands_len = children_len;
     result->commands = calloc(sizeof(dipsh_command *), result->commands_len);
-    if (!result->commands) {
-        free(result);
+    result->pipes_fds = malloc(2 * sizeof(int) * children_len);
+    if (!result->commands || !result->pipes_fds) {
+        dipsh_pipeline_destroy(result);
         return NULL;
     }
-    curr = children;
-    int i = 0;
-    while (curr) {
+    for (int i = 0; i < children_len; ++i) {
         result->commands[i] = dipsh_command_init(
-            curr->child, 
-            0 == i 
-            ? &dipshp_pipeline_first_command_traits 
-            : &dipshp_pipeline_command_traits
+            ast, &children[i], &dipshp_pipeline_command_traits
         );
         if (!result->commands[i]) {
             dipsh_pipeline_destroy(result);
             return NULL;
         }
-        ++i;
-        curr = curr->next;
     }
     return result;
 }
@@ -84,26 +90,66 @@ dipsh_pipeline_destroy(
 {
     if (!pipeline)
         return;
-    for (int i = 0; i < pipeline->commands_len; ++i)
-        dipsh_command_destroy(pipeline->commands[i]);
+    dipsh_release_barrier_release(&pipeline->barrier);
+    if (pipeline->commands) {
+        for (int i = 0; i < pipeline->commands_len; ++i)
+            dipsh_command_destroy(pipeline->commands[i]);
+    }
     free(pipeline->commands);
+    free(pipeline->pipes_fds);
     free(pipeline);
 }
 
+void
+dipsh_pipeline_rewind(
+    dipsh_pipeline *pipeline,
+    int execute_blocks,
+    dipsh_shell_state *shell_state
+)
+{
+    pipeline->execute_blocks = execute_blocks;
+    /* a pipeline that isn't waited for runs in the background */
+    pipeline->takes_terminal = execute_blocks && shell_state->is_interactive;
+    pipeline->pgid = 0;
+    pipeline->executed = 0;
+    for (int i = 0; i < pipeline->commands_len; ++i) {
+        dipsh_command *command = pipeline->commands[i];
+        dipsh_command_rewind(command);
+        dipsh_command_set_traits(
+            command, 
+            pipeline->takes_terminal
+            ? &dipshp_interactive_pipeline_command_traits 
+            : &dipshp_pipeline_command_traits
+        );
+        dipsh_command_set_shell_state(command, shell_state);
+    }
+}
+
+int
+dipsh_pipeline_has_builtins(
+    const dipsh_pipeline *pipeline
+)
+{
+    for (int i = 0; i < pipeline->commands_len; ++i) {
+        if (dipsh_command_is_builtin(pipeline->commands[i]))
+            return 1;
+    }
+    return 0;
+}
+
 static int
 dipshp_pipeline_get_pipes(
     dipsh_pipeline *pipeline,
     int **pipes_fds
 )
 {
-    *pipes_fds = malloc(2 * sizeof(int) * (pipeline->commands_len - 1));
-    if (!*pipes_fds)
-        return -1;
+    *pipes_fds = pipeline->pipes_fds;
     for (int i = 0; i < pipeline->commands_len - 1; ++i) {
         int pipe_ret = pipe((*pipes_fds) + (2 * i));
         if (-1 == pipe_ret) {
             for (int j = 0; j < 2 * i; ++j)
                 close((*pipes_fds)[j]);
+            *pipes_fds = NULL;
             return -1;
         }
     }
@@ -123,7 +169,6 @@ dipshp_pipeline_close_pipes(
         close((*pipes_fds)[2 * i]);
         close((*pipes_fds)[2 * i + 1]);
     }
-    free(*pipes_fds);
     *pipes_fds = NULL;
 }
 
@@ -151,7 +196,15 @@ dipshp_pipeline_start_command(
             dipsh_command_mark_fd_for_close(command, pipes_fds[2 * i + 1]);
         }
     }
-    return dipsh_command_execute(command);
+    /* the first started process founds the group, the rest join it */
+    dipsh_command_set_process_group(command, pipeline->pgid);
+    dipsh_command_set_release_barrier(command, &pipeline->barrier);
+    int ret = dipsh_command_execute(command);
+    if (dipsh_handler_ok == ret && !pipeline->pgid && 
+        dipsh_command_get_pid(command)) {
+        pipeline->pgid = dipsh_command_get_pid(command);
+    }
+    return ret;
 }
 
 static int
@@ -168,27 +221,41 @@ dipshp_pipeline_start_all_commands(
     return ret;
 }
 
-static int
-dipshp_pipeline_change_group(
-    dipsh_pipeline *pipeline
+long
+dipsh_pipeline_get_size(
+    const dipsh_pipeline *pipeline
 )
 {
-    int new_pgid = dipsh_command_get_pid(pipeline->commands[0]);
-    int ret = dipsh_command_wait_for_group_change(pipeline->commands[0]);
-    for (int i = 1; i < pipeline->commands_len && 0 == ret; ++i)
-        ret = setpgid(dipsh_command_get_pid(pipeline->commands[i]), new_pgid);
-    return ret;
+    long size = sizeof(dipsh_pipeline) +
+        (sizeof(dipsh_command *) + 2 * sizeof(int)) * pipeline->commands_len;
+    for (int i = 0; i < pipeline->commands_len; ++i)
+        size += dipsh_command_get_size(pipeline->commands[i]);
+    return size;
 }
 
-static int
-dipshp_pipeline_run_all_commands(
-    dipsh_pipeline *pipeline
+int
+dipsh_pipeline_get_commands_len(
+    const dipsh_pipeline *pipeline
 )
 {
-    int ret = 0;
-    for (int i = 0; i < pipeline->commands_len && 0 == ret; ++i)
-        ret = dipsh_command_start_suspended(pipeline->commands[i]);
-    return ret;
+    return pipeline->commands_len;
+}
+
+dipsh_command *
+dipsh_pipeline_get_command(
+    dipsh_pipeline *pipeline,
+    int idx
+)
+{
+    return pipeline->commands[idx];
+}
+
+int
+dipsh_pipeline_get_pgid(
+    const dipsh_pipeline *pipeline
+)
+{
+    return pipeline->pgid;
 }
 
 int
@@ -222,17 +289,24 @@ dipsh_pipeline_get_last_command_status(
 
 int
 dipsh_pipeline_execute(
-    dipsh_pipeline *pipeline,
-    int is_interactive_shell
+    dipsh_pipeline *pipeline
 )
 {
     int *pipes_fds;
     int old_group;
+    int group_changed = 0;
     int ret = dipshp_pipeline_get_pipes(pipeline, &pipes_fds);
     if (0 != ret) {
         warn("pipeline failure: can't create enough pipes");
         return dipsh_handler_system_error;
     }
+    if (pipeline->takes_terminal) {
+        ret = dipsh_release_barrier_init(&pipeline->barrier);
+        if (0 != ret) {
+            warn("pipeline failure: can't create the release barrier");
+            goto cleanup;
+        }
+    }
     ret = dipshp_pipeline_start_all_commands(
         pipeline, pipes_fds
     );
@@ -241,25 +315,15 @@ dipsh_pipeline_execute(
         goto cleanup;
     }
     dipshp_pipeline_close_pipes(pipeline, &pipes_fds);
-    ret = dipshp_pipeline_change_group(pipeline);
-    if (0 != ret) {
-        warn("pipeline failure: can't change the group for all commands");
-        goto cleanup;
-    }
-    if (is_interactive_shell) {
-        ret = dipsh_change_current_group(
-            dipsh_command_get_pid(pipeline->commands[0]), &old_group
-        );
+    if (pipeline->takes_terminal && pipeline->pgid) {
+        ret = dipsh_change_current_group(pipeline->pgid, &old_group);
         if (0 != ret) {
             warn("pipeline failure: can't change current group");
             goto cleanup;
         }
+        group_changed = 1;
     }
-    ret = dipshp_pipeline_run_all_commands(pipeline);
-    if (0 != ret) {
-        warn("pipeline failure: can't run all commands");
-        goto cleanup;
-    }
+    dipsh_release_barrier_release(&pipeline->barrier);
     if (pipeline->execute_blocks) {
         ret = dipsh_pipeline_wait(pipeline);
         if (0 != ret) {
@@ -267,7 +331,7 @@ dipsh_pipeline_execute(
             goto cleanup;
         }
     }
-    if (is_interactive_shell) {
+    if (group_changed) {
         ret = dipsh_change_current_group(old_group, NULL);
         if (0 != ret) {
             warn("pipeline failure: can't restore current group");
@@ -276,6 +340,7 @@ dipsh_pipeline_execute(
     }
 
 cleanup:
+    dipsh_release_barrier_release(&pipeline->barrier);
     dipshp_pipeline_close_pipes(pipeline, &pipes_fds);
     return ret;
 }
@@ -3,13 +3,16 @@
 
 #include "parser.h"
 #include "command.h"
+#include "shell_state.h"
 
 typedef struct dipsh_pipeline_tag dipsh_pipeline;
 
+/* the node is either a pipe or a single command; the pipeline must be 
+ * rewound before it's executed */
 dipsh_pipeline *
 dipsh_pipeline_init(
-    const dipsh_symbol *pipeline_tree,
-    int execute_blocks
+    const dipsh_ast *ast,
+    const dipsh_ast_node *pipeline_node
 );
 
 void
@@ -17,6 +20,38 @@ dipsh_pipeline_destroy(
     dipsh_pipeline *pipeline
 );
 
+/* makes the pipeline ready to be executed (once again); a pipeline that 
+ * doesn't block runs in the background and never takes the terminal */
+void
+dipsh_pipeline_rewind(
+    dipsh_pipeline *pipeline,
+    int execute_blocks,
+    dipsh_shell_state *shell_state
+);
+
+int
+dipsh_pipeline_has_builtins(
+    const dipsh_pipeline *pipeline
+);
+
+/* the memory the pipeline and its commands hold (see
+ * dipsh_command_get_size) */
+long
+dipsh_pipeline_get_size(
+    const dipsh_pipeline *pipeline
+);
+
+int
+dipsh_pipeline_get_commands_len(
+    const dipsh_pipeline *pipeline
+);
+
+dipsh_command *
+dipsh_pipeline_get_command(
+    dipsh_pipeline *pipeline,
+    int idx
+);
+
 int
 dipsh_pipeline_get_pgid(
     const dipsh_pipeline *pipeline
@@ -34,8 +69,7 @@ dipsh_pipeline_get_last_command_status(
 
 int
 dipsh_pipeline_execute(
-    dipsh_pipeline *pipeline,
-    int is_interactive_shell
+    dipsh_pipeline *pipeline
 );
 
 #endif /* _DIPSH_PIPELINE_H_ */
@@ -0,0 +1,239 @@
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define DIPSHP_CACHE_LINE 64
+#define DIPSHP_YIELDS_BEFORE_SLEEP 64
+
+/* the counters only grow, a slot is at a counter masked; each side keeps
+ * what it writes, and what it has last seen of the other side, on a cache
+ * line of its own, so that the sides don't take the lines from each other
+ * on every item */
+struct dipsh_ring_tag
+{
+    /* the consumer's */
+    _Alignas(DIPSHP_CACHE_LINE) atomic_long head;   /* released up to */
+    long tail_seen;
+
+    /* the producer's */
+    _Alignas(DIPSHP_CACHE_LINE) atomic_long tail;   /* published up to */
+    long claimed;
+    long head_seen;
+
+    /* a side about to sleep says so, then looks at the other side's counter
+     * once again, while the other side moves its counter, then looks if
+     * anyone sleeps; as both are sequentially consistent, at least one of
+     * them sees the other */
+    _Alignas(DIPSHP_CACHE_LINE) pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    atomic_int is_consumer_waiting;
+    atomic_int is_producer_waiting;
+    atomic_int is_closed;
+    atomic_int is_cancelled;
+
+    char *slots;
+    int item_size;
+    long capacity;
+};
+
+dipsh_ring *
+dipsh_ring_init(
+    int item_size,
+    int capacity
+)
+{
+    dipsh_ring *ring = aligned_alloc(DIPSHP_CACHE_LINE, sizeof(dipsh_ring));
+    if (!ring)
+        return NULL;
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = calloc(item_size, capacity);
+    if (!ring->slots) {
+        free(ring);
+        return NULL;
+    }
+    ring->item_size = item_size;
+    ring->capacity = capacity;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+    return ring;
+}
+
+void
+dipsh_ring_destroy(
+    dipsh_ring *ring
+)
+{
+    if (!ring)
+        return;
+    pthread_cond_destroy(&ring->not_full);
+    pthread_cond_destroy(&ring->not_empty);
+    pthread_mutex_destroy(&ring->lock);
+    free(ring->slots);
+    free(ring);
+}
+
+void *
+dipsh_ring_get_slot(
+    dipsh_ring *ring,
+    int idx
+)
+{
+    return ring->slots + (long)idx * ring->item_size;
+}
+
+static void *
+dipshp_slot_at(
+    dipsh_ring *ring,
+    long counter
+)
+{
+    return ring->slots + (counter & (ring->capacity - 1)) * ring->item_size;
+}
+
+/* sleeps while the other side's counter is still value; the other side is
+ * given the CPU a few times first, as it's likely to be just about to move
+ * on, and waking a sleeping thread for every item costs far more than the
+ * item itself */
+static void
+dipshp_wait(
+    dipsh_ring *ring,
+    atomic_long *counter,
+    long value,
+    atomic_int *is_waiting,
+    pthread_cond_t *cond
+)
+{
+    for (int i = 0; i < DIPSHP_YIELDS_BEFORE_SLEEP; ++i) {
+        if (value != atomic_load_explicit(counter, memory_order_relaxed))
+            return;
+        sched_yield();
+    }
+    pthread_mutex_lock(&ring->lock);
+    atomic_store(is_waiting, 1);
+    while (value == atomic_load(counter) &&
+           !atomic_load(&ring->is_closed) &&
+           !atomic_load(&ring->is_cancelled)) {
+        pthread_cond_wait(cond, &ring->lock);
+    }
+    atomic_store(is_waiting, 0);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/* to be called once this side's counter has moved */
+static void
+dipshp_wake(
+    dipsh_ring *ring,
+    atomic_int *is_waiting,
+    pthread_cond_t *cond
+)
+{
+    if (!atomic_load(is_waiting))
+        return;
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/* sets a flag the other side's sleep ends with */
+static void
+dipshp_set_flag(
+    dipsh_ring *ring,
+    atomic_int *flag,
+    pthread_cond_t *cond
+)
+{
+    pthread_mutex_lock(&ring->lock);
+    atomic_store(flag, 1);
+    pthread_cond_broadcast(cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void *
+dipsh_ring_claim(
+    dipsh_ring *ring
+)
+{
+    while (ring->claimed - ring->head_seen == ring->capacity) {
+        ring->head_seen =
+            atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (ring->claimed - ring->head_seen < ring->capacity)
+            break;
+        if (atomic_load(&ring->is_cancelled))
+            return NULL;
+        dipsh_ring_publish(ring);
+        dipshp_wait(
+            ring, &ring->head, ring->head_seen,
+            &ring->is_producer_waiting, &ring->not_full
+        );
+    }
+    if (atomic_load_explicit(&ring->is_cancelled, memory_order_relaxed))
+        return NULL;
+    return dipshp_slot_at(ring, ring->claimed++);
+}
+
+void
+dipsh_ring_publish(
+    dipsh_ring *ring
+)
+{
+    long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (ring->claimed == tail)
+        return;
+    atomic_store(&ring->tail, ring->claimed);
+    dipshp_wake(ring, &ring->is_consumer_waiting, &ring->not_empty);
+}
+
+void
+dipsh_ring_close(
+    dipsh_ring *ring
+)
+{
+    dipsh_ring_publish(ring);
+    dipshp_set_flag(ring, &ring->is_closed, &ring->not_empty);
+}
+
+void *
+dipsh_ring_peek(
+    dipsh_ring *ring
+)
+{
+    long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head == ring->tail_seen) {
+        /* the items are all published by the time the ring is closed */
+        int is_closed = atomic_load(&ring->is_closed);
+        ring->tail_seen =
+            atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head != ring->tail_seen)
+            break;
+        if (is_closed)
+            return NULL;
+        dipshp_wait(
+            ring, &ring->tail, head,
+            &ring->is_consumer_waiting, &ring->not_empty
+        );
+    }
+    return dipshp_slot_at(ring, head);
+}
+
+void
+dipsh_ring_release(
+    dipsh_ring *ring
+)
+{
+    long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store(&ring->head, head + 1);
+    dipshp_wake(ring, &ring->is_producer_waiting, &ring->not_full);
+}
+
+void
+dipsh_ring_cancel(
+    dipsh_ring *ring
+)
+{
+    dipshp_set_flag(ring, &ring->is_cancelled, &ring->not_full);
+}
@@ -0,0 +1,76 @@
+#ifndef _DIPSH_RING_H_
+#define _DIPSH_RING_H_
+
+/* bounded queue between two threads, one of which puts items in and the
+ * other takes them out, with no locks while it's neither full nor empty;
+ * either side sleeps only when it has to wait for the other. An item is
+ * written and read in place, in its slot: the producer claims slots and
+ * publishes them, the consumer peeks at the items and releases them */
+
+typedef struct dipsh_ring_tag dipsh_ring;
+
+/* the slots are item_size bytes each and zeroed; capacity must be a power
+ * of two. NULL if there is no memory */
+dipsh_ring *
+dipsh_ring_init(
+    int item_size,
+    int capacity
+);
+
+void
+dipsh_ring_destroy(
+    dipsh_ring *ring
+);
+
+/* the slot idx, for things kept in the slots from one item to another,
+ * which only the side the slot is with at the moment may touch */
+void *
+dipsh_ring_get_slot(
+    dipsh_ring *ring,
+    int idx
+);
+
+/* the producer's side */
+
+/* the next free slot past the ones claimed so far, waited for if there is
+ * none (the claimed ones are published first then); NULL once the consumer
+ * has cancelled the ring */
+void *
+dipsh_ring_claim(
+    dipsh_ring *ring
+);
+
+/* makes the claimed slots items, to be seen by the consumer */
+void
+dipsh_ring_publish(
+    dipsh_ring *ring
+);
+
+/* publishes the claimed slots, with no items to come after them */
+void
+dipsh_ring_close(
+    dipsh_ring *ring
+);
+
+/* the consumer's side */
+
+/* the item at the head, waited for if there is none; NULL once the ring is
+ * closed and all the items are released */
+void *
+dipsh_ring_peek(
+    dipsh_ring *ring
+);
+
+/* gives the slot of the item at the head back to the producer */
+void
+dipsh_ring_release(
+    dipsh_ring *ring
+);
+
+/* no more items are taken: the producer's claims fail from now on */
+void
+dipsh_ring_cancel(
+    dipsh_ring *ring
+);
+
+#endif /* _DIPSH_RING_H_ */
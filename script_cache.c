@@ -0,0 +1,636 @@
+#include "script_cache.h"
+#include "intern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DIPSHP_CACHE_MAGIC "dipshc\n"
+#define DIPSHP_CACHE_VERSION 1
+#define DIPSHP_CACHE_INITIAL_CAP 64
+
+/* what a cache is made from */
+typedef struct dipshp_script_key_tag
+{
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t hash;
+}
+dipshp_script_key;
+
+/* the file is the header, the real path of the script (padded to 8 bytes),
+ * the statements, the nodes, the words, and the chars of the words; it's
+ * all in the layout and the byte order of the machine that has written it,
+ * and a file from another one doesn't get past the version and node_size */
+typedef struct dipshp_cache_header_tag
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    dipshp_script_key key;
+    uint64_t payload_hash;  /* of everything after the header */
+    uint32_t path_len;
+    uint32_t statements_len;
+    uint32_t nodes_len;
+    uint32_t words_len;
+    uint32_t chars_len;
+    uint32_t unused;
+}
+dipshp_cache_header;
+
+/* the nodes and the words of a statement are indexed from its first ones */
+typedef struct dipshp_cache_statement_tag
+{
+    uint32_t first_node;
+    uint32_t nodes_len;
+    uint32_t first_word;
+    uint32_t words_len;
+}
+dipshp_cache_statement;
+
+typedef struct dipshp_cache_word_tag
+{
+    uint32_t offset;    /* in the chars */
+    uint32_t len;
+}
+dipshp_cache_word;
+
+struct dipsh_script_cache_writer_tag
+{
+    char *real_path;
+    dipshp_script_key key;
+    dipshp_cache_statement *statements;
+    int statements_len;
+    int statements_cap;
+    dipsh_ast_node *nodes;
+    int nodes_len;
+    int nodes_cap;
+    dipshp_cache_word *words;
+    int words_len;
+    int words_cap;
+    char *chars;
+    int chars_len;
+    int chars_cap;
+};
+
+struct dipsh_script_cache_tag
+{
+    char *map;
+    long map_len;
+    const dipshp_cache_statement *statements;
+    int statements_len;
+    const dipsh_ast_node *nodes;
+    const dipshp_cache_word *words;
+    const char *chars;
+};
+
+/* eight bytes a step, as the script and the cache are hashed on every run */
+static uint64_t
+dipshp_hash_bytes(
+    uint64_t hash,
+    const void *data,
+    long len
+)
+{
+    const unsigned char *bytes = data;
+    long i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15u;
+        hash ^= hash >> 32;
+    }
+    for (; i < len; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    return hash;
+}
+
+#define DIPSHP_HASH_START 14695981039346656037u
+
+/* the parts of the file after the header, in their order, which are hashed
+ * one by one the same way when they are written and when they are read */
+typedef struct dipshp_cache_piece_tag
+{
+    const void *data;
+    long len;
+}
+dipshp_cache_piece;
+
+#define DIPSHP_CACHE_PIECES_LEN 6
+
+static uint64_t
+dipshp_hash_pieces(
+    const dipshp_cache_piece *pieces
+)
+{
+    uint64_t hash = DIPSHP_HASH_START;
+    for (int i = 0; i < DIPSHP_CACHE_PIECES_LEN; ++i)
+        hash = dipshp_hash_bytes(hash, pieces[i].data, pieces[i].len);
+    return hash;
+}
+
+static long
+dipshp_padded(
+    long len
+)
+{
+    return (len + 7) & ~7L;
+}
+
+char *
+dipsh_script_cache_path(
+    const char *script_name
+)
+{
+    char *real_path = realpath(script_name, NULL);
+    if (!real_path)
+        return NULL;
+    uint64_t hash =
+        dipshp_hash_bytes(DIPSHP_HASH_START, real_path, strlen(real_path));
+    free(real_path);
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "";
+    /* the spec has relative paths ignored */
+    if (!base || '/' != *base) {
+        base = getenv("HOME");
+        suffix = "/.cache";
+        if (!base || !*base)
+            return NULL;
+    }
+    char *result;
+    int ret = asprintf(
+        &result, "%s%s/dipsh/%016llx.dipshc",
+        base, suffix, (unsigned long long)hash
+    );
+    return -1 == ret ? NULL : result;
+}
+
+/* the key of a regular file; returns 1 if the script isn't one, or can't
+ * be read */
+static int
+dipshp_get_script_key(
+    int script_fd,
+    dipshp_script_key *key
+)
+{
+    struct stat st;
+    if (0 != fstat(script_fd, &st) || !S_ISREG(st.st_mode))
+        return 1;
+    key->size = st.st_size;
+    key->mtime_sec = st.st_mtim.tv_sec;
+    key->mtime_nsec = st.st_mtim.tv_nsec;
+    key->hash = DIPSHP_HASH_START;
+    if (!st.st_size)
+        return 0;
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, script_fd, 0);
+    if (MAP_FAILED == map)
+        return 1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    key->hash = dipshp_hash_bytes(key->hash, map, st.st_size);
+    munmap(map, st.st_size);
+    return 0;
+}
+
+/* makes room for more items of size bytes in *array; returns 1 if there is
+ * no memory */
+static int
+dipshp_reserve(
+    void **array,
+    int *cap,
+    int len,
+    int more,
+    int size
+)
+{
+    if (len + more <= *cap)
+        return 0;
+    int new_cap = *cap ? *cap : DIPSHP_CACHE_INITIAL_CAP;
+    while (new_cap < len + more)
+        new_cap *= 2;
+    void *new_array = realloc(*array, (long)new_cap * size);
+    if (!new_array)
+        return 1;
+    *array = new_array;
+    *cap = new_cap;
+    return 0;
+}
+
+#define DIPSHP_RESERVE(writer, name, more)                                     \
+    dipshp_reserve(                                                            \
+        (void **)&(writer)->name, &(writer)->name##_cap, (writer)->name##_len, \
+        more, sizeof(*(writer)->name)                                          \
+    )
+
+/* a writer taking real_path over, whatever the result */
+static dipsh_script_cache_writer *
+dipshp_writer_init(
+    char *real_path,
+    const dipshp_script_key *key
+)
+{
+    dipsh_script_cache_writer *result =
+        calloc(sizeof(dipsh_script_cache_writer), 1);
+    if (!result) {
+        free(real_path);
+        return NULL;
+    }
+    result->real_path = real_path;
+    result->key = *key;
+    return result;
+}
+
+dipsh_script_cache_writer *
+dipsh_script_cache_writer_init(
+    const char *script_name,
+    int script_fd
+)
+{
+    char *real_path = realpath(script_name, NULL);
+    dipshp_script_key key;
+    if (!real_path || 0 != dipshp_get_script_key(script_fd, &key)) {
+        free(real_path);
+        return NULL;
+    }
+    return dipshp_writer_init(real_path, &key);
+}
+
+void
+dipsh_script_cache_writer_destroy(
+    dipsh_script_cache_writer *writer
+)
+{
+    if (!writer)
+        return;
+    free(writer->real_path);
+    free(writer->statements);
+    free(writer->nodes);
+    free(writer->words);
+    free(writer->chars);
+    free(writer);
+}
+
+int
+dipsh_script_cache_writer_add(
+    dipsh_script_cache_writer *writer,
+    const dipsh_ast *statement
+)
+{
+    int chars_len = 0;
+    for (int i = 0; i < statement->words_len; ++i)
+        chars_len += dipsh_intern_length(statement->words[i]);
+    if (0 != DIPSHP_RESERVE(writer, statements, 1) ||
+        0 != DIPSHP_RESERVE(writer, nodes, statement->nodes_len) ||
+        0 != DIPSHP_RESERVE(writer, words, statement->words_len) ||
+        0 != DIPSHP_RESERVE(writer, chars, chars_len)) {
+        return 1;
+    }
+    dipshp_cache_statement *added = &writer->statements[writer->statements_len];
+    added->first_node = writer->nodes_len;
+    added->nodes_len = statement->nodes_len;
+    added->first_word = writer->words_len;
+    added->words_len = statement->words_len;
+    ++writer->statements_len;
+    memcpy(
+        writer->nodes + writer->nodes_len, statement->nodes,
+        statement->nodes_len * sizeof(dipsh_ast_node)
+    );
+    writer->nodes_len += statement->nodes_len;
+    for (int i = 0; i < statement->words_len; ++i) {
+        dipshp_cache_word *word = &writer->words[writer->words_len++];
+        word->offset = writer->chars_len;
+        word->len = dipsh_intern_length(statement->words[i]);
+        memcpy(
+            writer->chars + writer->chars_len, statement->words[i], word->len
+        );
+        writer->chars_len += word->len;
+    }
+    return 0;
+}
+
+/* makes the directories the file at path is to be in */
+static int
+dipshp_make_dirs(
+    char *path
+)
+{
+    for (char *slash = strchr(path + 1, '/'); slash;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        int ret = mkdir(path, 0700);
+        *slash = '/';
+        if (-1 == ret && EEXIST != errno)
+            return 1;
+    }
+    return 0;
+}
+
+static int
+dipshp_write_all(
+    int fd,
+    const void *data,
+    long len
+)
+{
+    const char *pos = data;
+    while (len > 0) {
+        long written = write(fd, pos, len);
+        if (-1 == written && EINTR == errno)
+            continue;
+        if (-1 == written)
+            return 1;
+        pos += written;
+        len -= written;
+    }
+    return 0;
+}
+
+int
+dipsh_script_cache_writer_save(
+    dipsh_script_cache_writer *writer,
+    const char *cache_path
+)
+{
+    static const char padding[8];
+    long path_len = strlen(writer->real_path);
+    const dipshp_cache_piece pieces[DIPSHP_CACHE_PIECES_LEN] = {
+        { writer->real_path, path_len },
+        { padding, dipshp_padded(path_len) - path_len },
+        {
+            writer->statements,
+            writer->statements_len * sizeof(dipshp_cache_statement)
+        },
+        { writer->nodes, writer->nodes_len * sizeof(dipsh_ast_node) },
+        { writer->words, writer->words_len * sizeof(dipshp_cache_word) },
+        { writer->chars, writer->chars_len }
+    };
+
+    dipshp_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DIPSHP_CACHE_MAGIC, sizeof(header.magic));
+    header.version = DIPSHP_CACHE_VERSION;
+    header.node_size = sizeof(dipsh_ast_node);
+    header.key = writer->key;
+    header.payload_hash = dipshp_hash_pieces(pieces);
+    header.path_len = path_len;
+    header.statements_len = writer->statements_len;
+    header.nodes_len = writer->nodes_len;
+    header.words_len = writer->words_len;
+    header.chars_len = writer->chars_len;
+
+    /* written aside and renamed, so that nobody maps half a file */
+    char *temp_path;
+    if (-1 == asprintf(&temp_path, "%s.%d.tmp", cache_path, (int)getpid())) {
+        warnx("no memory to save the cache");
+        return 1;
+    }
+    int fd = -1;
+    int ret = dipshp_make_dirs(temp_path);
+    if (0 == ret) {
+        fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        ret = -1 == fd;
+    }
+    if (0 == ret)
+        ret = dipshp_write_all(fd, &header, sizeof(header));
+    for (int i = 0; 0 == ret && i < DIPSHP_CACHE_PIECES_LEN; ++i)
+        ret = dipshp_write_all(fd, pieces[i].data, pieces[i].len);
+    if (-1 != fd && 0 != close(fd))
+        ret = 1;
+    if (0 == ret)
+        ret = 0 != rename(temp_path, cache_path);
+    if (0 != ret) {
+        warn("can't save the cache '%s'", cache_path);
+        if (-1 != fd)
+            unlink(temp_path);
+    }
+    free(temp_path);
+    return ret;
+}
+
+/* the statements must be what the parser makes: the root first, the
+ * children of the other nodes before them (so that there are no cycles),
+ * and the words where they are said to be */
+static int
+dipshp_check_statement(
+    const dipsh_script_cache *cache,
+    const dipshp_cache_statement *statement
+)
+{
+    const dipsh_ast_node *nodes = cache->nodes + statement->first_node;
+    const dipshp_cache_word *words = cache->words + statement->first_word;
+    if (!statement->nodes_len || dipsh_symbol_script != nodes[0].type)
+        return 1;
+    for (int i = 0; i < (int)statement->nodes_len; ++i) {
+        const dipsh_ast_node *node = &nodes[i];
+        if (node->type > dipsh_symbol_nonterminal &&
+            node->type <= dipsh_symbol_redir) {
+            int end = i ? i : (int)statement->nodes_len;
+            if (node->first_child < 1 || node->children_len < 0 ||
+                node->children_len > end - node->first_child) {
+                return 1;
+            }
+            if (dipsh_symbol_redir == node->type &&
+                (2 != node->children_len ||
+                 !(nodes[node->first_child].type & dipsh_symbol_terminal) ||
+                 !(nodes[node->first_child + 1].type &
+                    dipsh_symbol_terminal))) {
+                return 1;
+            }
+        } else if (node->type > dipsh_symbol_terminal &&
+                   node->type <= dipsh_symbol_newline) {
+            if (node->word < 0 || node->word >= (int)statement->words_len ||
+                node->word_len != (int)words[node->word].len) {
+                return 1;
+            }
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* everything the header says must be inside the file, and must be sane */
+static int
+dipshp_check_cache(
+    const dipsh_script_cache *cache,
+    const dipshp_cache_header *header
+)
+{
+    const char *path = (const char *)(header + 1);
+    const dipshp_cache_piece pieces[DIPSHP_CACHE_PIECES_LEN] = {
+        { path, header->path_len },
+        {
+            path + header->path_len,
+            dipshp_padded(header->path_len) - header->path_len
+        },
+        {
+            cache->statements,
+            cache->statements_len * sizeof(dipshp_cache_statement)
+        },
+        { cache->nodes, header->nodes_len * sizeof(dipsh_ast_node) },
+        { cache->words, header->words_len * sizeof(dipshp_cache_word) },
+        { cache->chars, header->chars_len }
+    };
+    if (dipshp_hash_pieces(pieces) != header->payload_hash)
+        return 1;
+    for (uint32_t i = 0; i < header->words_len; ++i) {
+        if ((uint64_t)cache->words[i].offset + cache->words[i].len >
+            header->chars_len) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < cache->statements_len; ++i) {
+        const dipshp_cache_statement *statement = &cache->statements[i];
+        if ((uint64_t)statement->first_node + statement->nodes_len >
+                header->nodes_len ||
+            (uint64_t)statement->first_word + statement->words_len >
+                header->words_len ||
+            0 != dipshp_check_statement(cache, statement)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* sets the parts of the cache; returns 1 if the header doesn't fit the file
+ * or the script */
+static int
+dipshp_read_header(
+    dipsh_script_cache *cache,
+    const char *real_path,
+    const dipshp_script_key *key
+)
+{
+    const dipshp_cache_header *header = (const dipshp_cache_header *)cache->map;
+    if (0 != memcmp(header->magic, DIPSHP_CACHE_MAGIC, sizeof(header->magic)) ||
+        DIPSHP_CACHE_VERSION != header->version ||
+        sizeof(dipsh_ast_node) != header->node_size ||
+        0 != memcmp(&header->key, key, sizeof(*key))) {
+        return 1;
+    }
+    uint64_t path_len = dipshp_padded(header->path_len);
+    uint64_t len = sizeof(*header) + path_len +
+        (uint64_t)header->statements_len * sizeof(dipshp_cache_statement) +
+        (uint64_t)header->nodes_len * sizeof(dipsh_ast_node) +
+        (uint64_t)header->words_len * sizeof(dipshp_cache_word) +
+        header->chars_len;
+    const char *path = (const char *)(header + 1);
+    if (len != (uint64_t)cache->map_len ||
+        strlen(real_path) != header->path_len ||
+        0 != memcmp(path, real_path, header->path_len)) {
+        return 1;
+    }
+    cache->statements =
+        (const dipshp_cache_statement *)(path + path_len);
+    cache->statements_len = header->statements_len;
+    cache->nodes =
+        (const dipsh_ast_node *)(cache->statements + cache->statements_len);
+    cache->words =
+        (const dipshp_cache_word *)(cache->nodes + header->nodes_len);
+    cache->chars = (const char *)(cache->words + header->words_len);
+    return dipshp_check_cache(cache, header);
+}
+
+int
+dipsh_script_cache_open(
+    const char *script_name,
+    int script_fd,
+    const char *cache_path,
+    dipsh_script_cache **cache,
+    dipsh_script_cache_writer **writer
+)
+{
+    int cache_fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (-1 == cache_fd)
+        return dipsh_script_cache_missing;
+    dipshp_script_key key;
+    char *real_path = realpath(script_name, NULL);
+    /* a script that can't be cached now, whatever has been */
+    if (!real_path || 0 != dipshp_get_script_key(script_fd, &key)) {
+        free(real_path);
+        close(cache_fd);
+        return dipsh_script_cache_missing;
+    }
+    dipsh_script_cache *result = calloc(sizeof(dipsh_script_cache), 1);
+    struct stat st;
+    if (!result || 0 != fstat(cache_fd, &st) ||
+        st.st_size < (off_t)sizeof(dipshp_cache_header)) {
+        goto stale;
+    }
+    result->map_len = st.st_size;
+    result->map =
+        mmap(NULL, result->map_len, PROT_READ, MAP_PRIVATE, cache_fd, 0);
+    if (MAP_FAILED == result->map) {
+        result->map = NULL;
+        goto stale;
+    }
+    if (0 != dipshp_read_header(result, real_path, &key))
+        goto stale;
+    free(real_path);
+    close(cache_fd);
+    *cache = result;
+    return dipsh_script_cache_ok;
+
+stale:
+    close(cache_fd);
+    dipsh_script_cache_close(result);
+    /* the script has been hashed already, the new cache is bound to that */
+    *writer = dipshp_writer_init(real_path, &key);
+    return dipsh_script_cache_stale;
+}
+
+void
+dipsh_script_cache_close(
+    dipsh_script_cache *cache
+)
+{
+    if (!cache)
+        return;
+    if (cache->map)
+        munmap(cache->map, cache->map_len);
+    free(cache);
+}
+
+int
+dipsh_script_cache_get_statements_len(
+    const dipsh_script_cache *cache
+)
+{
+    return cache->statements_len;
+}
+
+int
+dipsh_script_cache_get_statement(
+    const dipsh_script_cache *cache,
+    int idx,
+    dipsh_arena *arena,
+    dipsh_ast *ast
+)
+{
+    const dipshp_cache_statement *statement = &cache->statements[idx];
+    /* mapped read-only, but nothing writes to the nodes of a parsed AST */
+    ast->nodes = (dipsh_ast_node *)(cache->nodes + statement->first_node);
+    ast->nodes_len = statement->nodes_len;
+    ast->words_len = 0;
+    ast->words =
+        dipsh_arena_alloc(arena, statement->words_len * sizeof(const char *));
+    if (!ast->words)
+        return 1;
+    const dipshp_cache_word *words = cache->words + statement->first_word;
+    for (int i = 0; i < (int)statement->words_len; ++i) {
+        const char *word =
+            dipsh_intern(cache->chars + words[i].offset, words[i].len);
+        if (!word) {
+            dipsh_ast_clean(ast);
+            return 1;
+        }
+        ast->words[ast->words_len++] = word;
+    }
+    return 0;
+}
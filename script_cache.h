@@ -0,0 +1,96 @@
+#ifndef _DIPSH_SCRIPT_CACHE_H_
+#define _DIPSH_SCRIPT_CACHE_H_
+
+#include "parser.h"
+#include "arena.h"
+
+/* the statements of a script parsed once and kept in a .dipshc file, as
+ * flat ASTs the nodes of which are used right from the mapped file; a cache
+ * is bound to the real path of its script, and to the size, the mtime and
+ * a hash of the script's contents */
+
+typedef struct dipsh_script_cache_tag dipsh_script_cache;
+
+/* $XDG_CACHE_HOME/dipsh (or ~/.cache/dipsh), then a name made of a hash of
+ * the real path of the script; NULL if the script isn't there or there is
+ * no place for caches. The result is to be freed */
+char *
+dipsh_script_cache_path(
+    const char *script_name
+);
+
+/* collects the statements of a script as they are parsed, to be saved as
+ * its cache once the whole script has been */
+typedef struct dipsh_script_cache_writer_tag dipsh_script_cache_writer;
+
+/* the script at script_fd must be a regular file, and must be read after
+ * this (so that a change made meanwhile makes the cache stale); NULL if it
+ * isn't one, or there is no memory */
+dipsh_script_cache_writer *
+dipsh_script_cache_writer_init(
+    const char *script_name,
+    int script_fd
+);
+
+void
+dipsh_script_cache_writer_destroy(
+    dipsh_script_cache_writer *writer
+);
+
+/* copies the statement; returns 1 if there is no memory */
+int
+dipsh_script_cache_writer_add(
+    dipsh_script_cache_writer *writer,
+    const dipsh_ast *statement
+);
+
+/* writes the cache, replacing the old one at once; returns 0, or 1 with a
+ * warning */
+int
+dipsh_script_cache_writer_save(
+    dipsh_script_cache_writer *writer,
+    const char *cache_path
+);
+
+enum
+{
+    dipsh_script_cache_ok,
+    dipsh_script_cache_missing,
+    dipsh_script_cache_stale    /* or broken */
+};
+
+/* maps the cache if it's there and made from the very script at script_fd;
+ * *cache is set only if the result is dipsh_script_cache_ok, and *writer,
+ * to make the cache anew with (NULL if there is no memory), only if it is
+ * dipsh_script_cache_stale */
+int
+dipsh_script_cache_open(
+    const char *script_name,
+    int script_fd,
+    const char *cache_path,
+    dipsh_script_cache **cache,
+    dipsh_script_cache_writer **writer
+);
+
+void
+dipsh_script_cache_close(
+    dipsh_script_cache *cache
+);
+
+int
+dipsh_script_cache_get_statements_len(
+    const dipsh_script_cache *cache
+);
+
+/* the statement idx, with its words interned and the AST holding
+ * references to them (see dipsh_ast_clean); the nodes stay in the cache,
+ * so the AST must not outlive it. Returns 1 if there is no memory */
+int
+dipsh_script_cache_get_statement(
+    const dipsh_script_cache *cache,
+    int idx,
+    dipsh_arena *arena,
+    dipsh_ast *ast
+);
+
+#endif /* _DIPSH_SCRIPT_CACHE_H_ */
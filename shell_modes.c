@@ -3,84 +3,38 @@
 #include "lexer.h"
 #include "parser.h"
 #include "execute.h"
+#include "script_cache.h"
+#include "statement_cache.h"
+#include "event_loop.h"
+#include "intern.h"
+#include "ring.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define DIPSHP_BUF_SIZE 128
-
-static void
-dipshp_append_buffer(
-    char **read_str, 
-    const char *buffer
-)
-{
-    if (!*buffer)
-        return;
-    *read_str = realloc(*read_str, strlen(*read_str) + strlen(buffer) + 1);
-    strcat(*read_str, buffer);
-}
-
-static int
-dipshp_is_escaped_by_bs(
-    const char *str,
-    const char *char_pos
-)
-{
-    --char_pos;
-    int backslashes = 0;
-    for (; *char_pos == '\\' && char_pos >= str; --char_pos)
-        ++backslashes;
-    return 1 == backslashes % 2;
-}
-
-static int
-dipshp_num_non_escaped_quotes(
-    const char *str
-)
-{
-    int result = 0;
-    const char *pos = str;
-    while (NULL != (pos = strchr(pos, '"'))) {
-        if (!dipshp_is_escaped_by_bs(str, pos))
-            ++result;
-        ++pos;
-    }
-    return result;
-}
+#define DIPSHP_BUF_SIZE 4096
+#define DIPSHP_SCRIPT_BUF_SIZE 65536
+#define DIPSHP_TOKENS_RING_LEN 4096
+#define DIPSHP_STATEMENTS_RING_LEN 64
 
 static char *
-dipshp_read_next_line_from_stdin()
-{
-    int non_escaped_nl_found = 0, non_escaped_quotes = 0;
-    char *read_str = calloc(1, 1), read_buf[DIPSHP_BUF_SIZE] = {0};
-    while (!non_escaped_nl_found) {
-        char *fgets_ret = fgets(read_buf, DIPSHP_BUF_SIZE, stdin);
-        if (!fgets_ret) { /* normally meaning EOF */
-            free(read_str);
-            return NULL;
-        }
-        dipshp_append_buffer(&read_str, read_buf);
-        non_escaped_quotes += dipshp_num_non_escaped_quotes(read_buf);
-        char *nl_pos = strrchr(read_buf, '\n');
-        if (nl_pos) {
-            non_escaped_nl_found = 0 == non_escaped_quotes % 2 &&
-                !dipshp_is_escaped_by_bs(read_buf, nl_pos);
-        }
-    }
-    return read_str;
-}
-
-static char *
-dipshp_escape_non_printables(
-    const char *str
+dipshp_escape_non_printables_len(
+    const char *str,
+    int len
 )
 {
-    char *result = malloc(4 * strlen(str) + 1), *res_pos = result;
-    for (; *str; ++str) {
+    char *result = malloc(4 * len + 1), *res_pos = result;
+    for (const char *end = str + len; str != end; ++str) {
         if (isprint(*str)) {
             *res_pos = *str;
             ++res_pos;
@@ -108,26 +62,33 @@ dipshp_escape_non_printables(
     return result;
 }
 
+static char *
+dipshp_escape_non_printables(
+    const char *str
+)
+{
+    return dipshp_escape_non_printables_len(str, strlen(str));
+}
+
 static void
-dipshp_print_parse_subtree(
-    const dipsh_symbol *root,
+dipshp_print_ast_subtree(
+    const dipsh_ast *ast,
+    const dipsh_ast_node *node,
     int tabs
 )
 {
     for (int i = 0; i < tabs; ++i)
         printf("  ");
-    printf("%s", dipsh_symbol_type_to_string(root->type));
-    if (root->type & dipsh_symbol_nonterminal) {
+    printf("%s", dipsh_symbol_type_to_string(node->type));
+    if (node->type & dipsh_symbol_nonterminal) {
         putchar('\n');
-        dipsh_nonterminal_child *child = 
-            ((const dipsh_nonterminal *)root)->children_list;
-        while (child) {
-            dipshp_print_parse_subtree(child->child, tabs + 1);
-            child = child->next;
-        }
-    } else if (root->type & dipsh_symbol_terminal) {
-        const dipsh_terminal *term_root = (const dipsh_terminal *)root;
-        char *esc_val = dipshp_escape_non_printables(term_root->token.value);
+        const dipsh_ast_node *child = ast->nodes + node->first_child;
+        for (int i = 0; i < node->children_len; ++i)
+            dipshp_print_ast_subtree(ast, &child[i], tabs + 1);
+    } else if (node->type & dipsh_symbol_terminal) {
+        char *esc_val = dipshp_escape_non_printables_len(
+            ast->words[node->word], node->word_len
+        );
         printf(": %s\n", esc_val);
         free(esc_val);
     } else {
@@ -135,12 +96,32 @@ dipshp_print_parse_subtree(
     }
 }
 
+/* arena is the one the AST is in */
 static void
-dipshp_print_parse_tree(
-    const dipsh_symbol *root
+dipshp_print_ast(
+    const dipsh_ast *ast,
+    const dipsh_arena *arena
 )
 {
-    dipshp_print_parse_subtree(root, 0);
+    dipshp_print_ast_subtree(ast, ast->nodes, 0);
+    printf(
+        "ast memory: %d nodes, %ld bytes\n", ast->nodes_len, 
+        (long)(ast->nodes_len * sizeof(dipsh_ast_node) + 
+            ast->words_len * sizeof(const char *))
+    );
+    dipsh_arena_stats arena_stats;
+    dipsh_arena_get_stats(arena, &arena_stats);
+    printf(
+        "ast arena: %ld bytes, high-water mark %ld bytes, %ld reserved\n",
+        arena_stats.used, arena_stats.high_water, arena_stats.reserved
+    );
+    /* the words are shared by all the statements read so far */
+    dipsh_intern_stats stats;
+    dipsh_intern_get_stats(&stats);
+    printf(
+        "interned words: %d strings, %ld bytes, %lu of %lu lookups hit\n",
+        stats.strings, stats.bytes, stats.hits, stats.lookups
+    );
 }
 
 static void
@@ -159,112 +140,1105 @@ dipshp_handle_bg_finished_cb(
     putchar('\n');
 }
 
+#define DIPSHP_PROMPT "> "
+
+static void
+dipshp_print_prompt()
+{
+    fputs(DIPSHP_PROMPT, stdout);
+    fflush(stdout);
+}
+
+/* waits till stdin has something to read, reporting background commands as 
+ * soon as they finish */
+static int
+dipshp_wait_for_stdin(
+    dipsh_shell_state *state
+)
+{
+    for (;;) {
+        int ret = dipsh_event_loop_wait_for_fd(0);
+        if (dipsh_event_loop_fd_ready == ret)
+            return 0;
+        if (dipsh_event_loop_failure == ret)
+            return 1;
+        if (!dipsh_shell_state_has_finished_bg_commands(state))
+            continue;
+        putchar('\n');
+        dipsh_shell_state_clear_finished_bg_commands(
+            state, dipshp_handle_bg_finished_cb
+        );
+        dipshp_print_prompt();
+    }
+}
+
+enum
+{
+    dipshp_input_ok,
+    dipshp_input_error,
+    dipshp_input_eof,
+    dipshp_input_partial,
+    dipshp_input_cached     /* the statements are in the cache, compiled */
+};
+
+/* the raw text of the input being read, which the statements compiled
+ * from it are cached by; len is -1 if it couldn't be kept */
+typedef struct dipshp_input_text_tag
+{
+    char *chars;
+    int len;
+    int capacity;
+}
+dipshp_input_text;
+
+static void
+dipshp_append_input_text(
+    dipshp_input_text *text,
+    const char *buf,
+    int len
+)
+{
+    if (text->len < 0)
+        return;
+    if (text->len + len > text->capacity) {
+        int new_capacity = text->capacity ? 2 * text->capacity : len;
+        while (new_capacity < text->len + len)
+            new_capacity *= 2;
+        char *new_chars = realloc(text->chars, new_capacity);
+        if (!new_chars) {
+            text->len = -1;
+            return;
+        }
+        text->chars = new_chars;
+        text->capacity = new_capacity;
+    }
+    memcpy(text->chars + text->len, buf, len);
+    text->len += len;
+}
+
+/* lexes a piece of a line, tells if it has completed the line. After an 
+ * error (err is set then, and *failed) the tokens are dropped, and the 
+ * lexer goes on, skipping the wrong chars, only to find where the line 
+ * ends: it's the line that is wrong, the next one is lexed afresh */
+static int
+dipshp_lex_input_piece(
+    dipsh_lexer_state *lexer,
+    const char *buf,
+    int len,
+    dipsh_token_vec *tokens,
+    dipsh_tokenize_error *err,
+    int *failed
+)
+{
+    int first_new = tokens->length;
+    int pos = 0;
+    while (pos < len) {
+        if (!*failed && 0 != dipsh_token_vec_reserve(tokens, 1)) {
+            dipsh_tokenize_error_set(err, 0, "can't store the tokens");
+            *failed = 1;
+        }
+        dipsh_token dropped;
+        dipsh_token *token = *failed
+            ? &dropped
+            : &tokens->tokens[tokens->length];
+        int ret = dipsh_lexer_scan(lexer, buf, len, &pos, token);
+        if (dipsh_lexer_new_token == ret && *failed) {
+            dipsh_token_clean(&dropped);
+        } else if (dipsh_lexer_new_token == ret) {
+            ++tokens->length;
+        } else if (dipsh_lexer_error == ret && !*failed) {
+            dipsh_tokenize_error_set(
+                err, dipsh_lexer_state_get_line(lexer), 
+                "%s", dipsh_lexer_state_get_error(lexer)
+            );
+            *failed = 1;
+        }
+    }
+    /* buf is going to be reused */
+    if (!*failed && 0 != dipsh_token_vec_unslice(tokens, first_new)) {
+        dipsh_tokenize_error_set(err, 0, "can't store the tokens");
+        *failed = 1;
+    }
+    if (!dipsh_lexer_state_is_line_end(lexer))
+        return dipshp_input_partial;
+    if (*failed)
+        return dipshp_input_error;
+    /* the newline's token comes out at the end of the input */
+    dipsh_lexer_feed(lexer, NULL, 0, tokens);
+    return dipshp_input_ok;
+}
+
+/* what has been read from stdin and not taken yet: a read may return
+ * several lines, which are taken one at a time */
+typedef struct dipshp_stdin_buf_tag
+{
+    char chars[DIPSHP_BUF_SIZE];
+    int pos;
+    int len;
+}
+dipshp_stdin_buf;
+
+/* reads stdin till what has been taken makes a complete line (a read may 
+ * return several lines, or a part of one; the rest stays in buf), lexing it 
+ * on the way, so every char is looked at once. The tokens are appended to 
+ * tokens, or err is set if the line is lexically wrong. Unless text is NULL, 
+ * the line is kept there too, and whenever it ends with a newline it's 
+ * looked up in the statement cache first: the lexer would make the same of 
+ * it as the last time, so if it's there, the code compiled from it is set 
+ * to *code instead */
+static int
+dipshp_read_next_input(
+    dipsh_shell_state *state,
+    dipshp_stdin_buf *buf,
+    dipsh_lexer_state *lexer,
+    dipsh_token_vec *tokens,
+    dipsh_tokenize_error *err,
+    dipshp_input_text *text,
+    dipsh_bytecode **code
+)
+{
+    int failed = 0;
+    dipsh_lexer_state_reset(lexer);
+    if (text)
+        text->len = 0;
+    for (;;) {
+        if (buf->pos == buf->len) {
+            int read_len = -1;
+            if (0 == dipshp_wait_for_stdin(state))
+                read_len = read(0, buf->chars, sizeof(buf->chars));
+            if (read_len <= 0) { /* normally meaning EOF */
+                if (failed)
+                    dipsh_tokenize_error_clean(err);
+                return dipshp_input_eof;
+            }
+            buf->pos = 0;
+            buf->len = read_len;
+        }
+        /* the line can only end after a newline, so a piece goes up to one */
+        const char *piece = buf->chars + buf->pos;
+        const char *newline = memchr(piece, '\n', buf->len - buf->pos);
+        int piece_len = newline ? newline - piece + 1 : buf->len - buf->pos;
+        buf->pos += piece_len;
+        int is_looked_up = 0;
+        if (text && !failed) {
+            dipshp_append_input_text(text, piece, piece_len);
+            is_looked_up = newline && text->len > 0;
+            if (is_looked_up)
+                *code = dipsh_statement_cache_find(text->chars, text->len);
+            if (*code) {
+                dipsh_token_vec_clear(tokens);
+                return dipshp_input_cached;
+            }
+        }
+        int ret = dipshp_lex_input_piece(
+            lexer, piece, piece_len, tokens, err, &failed
+        );
+        if (dipshp_input_partial == ret)
+            continue;
+        if (is_looked_up)
+            dipsh_statement_cache_count_miss();
+        return ret;
+    }
+}
+
+static void
+dipshp_print_token(
+    int idx,
+    const dipsh_token *token
+)
+{
+    char *esc_val = 
+        dipshp_escape_non_printables_len(token->value, token->length);
+    printf(
+        "token %d: type %s, value [%s]\n", 
+        idx, dipsh_type_to_str(token->type), esc_val 
+    );
+    free(esc_val);
+}
+
+static void
+dipshp_run_ast(
+    const dipsh_ast *ast,
+    dipsh_shell_state *state,
+    int is_final
+)
+{
+    int ret = is_final 
+        ? dipsh_execute_final_ast(ast, ast->nodes, state) 
+        : dipsh_execute_ast(ast, ast->nodes, state);
+    if (ret)
+        warnx("can't execute the command till the end");
+}
+
+/* runs the statements as final, then keeps their code in the statement 
+ * cache by text */
+static void
+dipshp_run_and_cache_ast(
+    const dipsh_ast *ast,
+    const dipshp_input_text *text,
+    dipsh_shell_state *state
+)
+{
+    dipsh_bytecode *code = dipsh_bytecode_compile(ast, ast->nodes);
+    if (!code || 0 != dipsh_execute_final_bytecode(code, state))
+        warnx("can't execute the command till the end");
+    if (code && 0 != dipsh_statement_cache_add(text->chars, text->len, code))
+        dipsh_bytecode_destroy(code);
+}
+
+/* err is NULL if the tokenizing has gone well; the AST is allocated in 
+ * ast_arena, which is left for the caller to reset. The statements are 
+ * cached by text, unless it's NULL or hasn't been kept */
 static int
-dipshp_handle_parsed_list(
-    dipsh_token_list *list,
+dipshp_handle_parsed_tokens(
+    dipsh_token_vec *tokens,
+    dipsh_parser_state *parser,
+    dipsh_arena *ast_arena,
     dipsh_tokenize_error *err,
+    const dipshp_input_text *text,
     dipsh_shell_state *state,
     int show_parsing_info
 )
 {
     if (show_parsing_info)
         puts("lexical analysis results:");
-    if (list) {
-        int idx = 0;
-        if (show_parsing_info) {
-            for (const dipsh_token_list *curr = list; 
-                 curr; curr = curr->next, ++idx) {
-                char *esc_val = dipshp_escape_non_printables(curr->token.value);
-                printf(
-                    "token %d: type %s, value [%s]\n", 
-                    idx, dipsh_type_to_str(curr->token.type), esc_val 
-                );
-                free(esc_val);
-            }
-        }
-        if (!list->next && dipsh_token_newline == list->token.type)
-            return 0;
-    } else {
+    if (err) {
         char *esc_msg = dipshp_escape_non_printables(err->message);
         warnx("line %d: %s", err->line, esc_msg);
         free(esc_msg);
         dipsh_tokenize_error_clean(err);
         return 1;
     }
+    if (show_parsing_info) {
+        for (int i = 0; i < tokens->length; ++i)
+            dipshp_print_token(i, &tokens->tokens[i]);
+    }
+    if (1 == tokens->length && 
+        dipsh_token_newline == tokens->tokens[0].type) {
+        return 0;
+    }
 
-    dipsh_symbol *root = NULL;
-    char *parser_err = NULL;
-    int parser_ret = dipsh_parse_token_list(list, &root, &parser_err);
+    dipsh_ast ast;
+    int parser_ret = dipsh_parse_tokens(parser, tokens, ast_arena, &ast);
     if (show_parsing_info)
         puts("parsing results:");
-    if (dipsh_parser_accepted == parser_ret) {
-        dipsh_make_ast(&root);
-        if (show_parsing_info)
-            dipshp_print_parse_tree(root);
-    } else {
-        char *esc_msg = dipshp_escape_non_printables(parser_err);
+    if (dipsh_parser_accepted != parser_ret) {
+        char *esc_msg = dipshp_escape_non_printables(
+            dipsh_parser_state_get_error(parser)
+        );
         warnx(esc_msg);
         free(esc_msg);
-        free(parser_err);
-        dipsh_clean_token_list(list);
         return 1;
     }
-    if (root) {
-        int ret = dipsh_execute_ast(root, state);
-        if (ret)
-            warnx("can't execute the command till the end");
-        dipsh_symbol_clear(root); 
-    }
-    dipsh_clean_token_list(list);
+    if (!ast.nodes_len)
+        return 0;
+    if (show_parsing_info)
+        dipshp_print_ast(&ast, ast_arena);
+    if (text && text->len > 0)
+        dipshp_run_and_cache_ast(&ast, text, state);
+    else
+        dipshp_run_ast(&ast, state, 1);
+    dipsh_ast_clean(&ast);
     return 0;
 }
 
+static void
+dipshp_print_cache_info()
+{
+    dipsh_statement_cache_stats stats;
+    dipsh_statement_cache_get_stats(&stats);
+    printf(
+        "statement cache: %lu hits, %lu misses, %lu evictions, "
+        "%d kept in %ld of %ld bytes\n",
+        stats.hits, stats.misses, stats.evictions,
+        stats.statements, stats.bytes, stats.budget
+    );
+}
+
 int
 dipsh_interactive_shell(
-    int show_parsing_info
+    int show_parsing_info,
+    int show_cache_info
 )
 {
-    dipsh_shell_state state = {
-        .is_interactive = 1
-    };
+    dipsh_shell_state state;
+    int ret = dipsh_shell_state_init(&state, 1);
+    if (0 != ret)
+        warnx("can't start the event loop, children are waited one by one");
     signal(SIGTTOU, SIG_IGN);
+    dipsh_lexer_state *lexer = dipsh_lexer_state_init();
+    dipsh_token_vec tokens;
+    dipsh_token_vec_init(&tokens);
+    dipsh_arena *ast_arena = dipsh_arena_init();
+    dipsh_parser_state *parser = dipsh_parser_state_init();
+    /* the parsing info is shown for every statement, so none is cached */
+    dipshp_input_text text = { NULL, 0, 0 };
+    dipshp_input_text *cache_text = show_parsing_info ? NULL : &text;
+    dipshp_stdin_buf stdin_buf;
+    stdin_buf.pos = stdin_buf.len = 0;
     for (;;) {
-        printf("> ");
-        char *read_str = dipshp_read_next_line_from_stdin();
-        if (!read_str) {
-            putchar('\n');
-            goto out;
-        }
-        dipsh_tokenize_error err;
-        dipsh_token_list *list = dipsh_tokenize_string(read_str, &err);
-        dipshp_handle_parsed_list(list, &err, &state, show_parsing_info);
-        free(read_str);
         dipsh_shell_state_clear_finished_bg_commands(
             &state, dipshp_handle_bg_finished_cb
         );
-        if (feof(stdin))
+        dipshp_print_prompt();
+        dipsh_tokenize_error err;
+        dipsh_bytecode *code = NULL;
+        int input_ret = dipshp_read_next_input(
+            &state, &stdin_buf, lexer, &tokens, &err, cache_text, &code
+        );
+        if (dipshp_input_eof == input_ret) {
+            putchar('\n');
             break;
+        }
+        if (dipshp_input_cached == input_ret) {
+            if (0 != dipsh_execute_final_bytecode(code, &state))
+                warnx("can't execute the command till the end");
+            continue;
+        }
+        dipshp_handle_parsed_tokens(
+            &tokens, parser, ast_arena, 
+            dipshp_input_error == input_ret ? &err : NULL, 
+            cache_text, &state, show_parsing_info
+        );
+        dipsh_token_vec_clear(&tokens);
+        dipsh_arena_reset(ast_arena);
+    }
+    if (show_cache_info)
+        dipshp_print_cache_info();
+    dipsh_statement_cache_reset();
+    free(text.chars);
+    dipsh_parser_state_destroy(parser);
+    dipsh_arena_destroy(ast_arena);
+    dipsh_token_vec_destroy(&tokens);
+    dipsh_lexer_state_destroy(lexer);
+    dipsh_shell_state_destroy(&state);
+    return 0;
+}
+
+/* a statement on its way from the parser thread to the main one, or a
+ * warning to be shown where the statement would be */
+typedef struct dipshp_statement_item_tag
+{
+    dipsh_ast ast;
+    /* the item's own, which it swaps for the reader's pending one as the
+     * statement is handed over, and which is reset once it has run */
+    dipsh_arena *arena;
+    char *message;
+    int is_final;
+}
+dipshp_statement_item;
+
+/* the lexer and the parser of a script in threads of their own: the tokens
+ * go to the parser through one ring, the statements to the main thread,
+ * which runs them, through another. An error of the lexer's goes along as
+ * an error token, with the message for its value */
+typedef struct dipshp_front_end_tag
+{
+    dipsh_ring *tokens;
+    dipsh_ring *statements;
+    int script_fd;
+    pthread_t lexer_thread;
+    pthread_t parser_thread;
+    int has_lexer_thread;
+    int ret;    /* the parser thread's */
+}
+dipshp_front_end;
+
+/* where a script is in its way from characters to statements run */
+typedef struct dipshp_script_reader_tag
+{
+    dipsh_lexer_state *lexer;
+    /* what the lexer has made of the last piece of the script */
+    dipsh_token_vec tokens;
+    dipsh_parser_state *parser;
+    /* parsed, but not run till it's known whether it's the last one; it has 
+     * an arena of its own, so that it goes at once when it's been run */
+    dipsh_ast pending;
+    int has_pending;
+    dipsh_arena *pending_arena;
+    int tokens_read;
+    int show_parsing_info;
+    /* the statements are kept for the cache as well, if there is a writer;
+     * when compiling, that's all that is done with them */
+    dipsh_script_cache_writer *cache_writer;
+    const char *cache_path;
+    int compile_only;
+    /* set if the script is read by the threads: the lexer's part of the
+     * reader is used by one, the rest by the other */
+    dipshp_front_end *front_end;
+}
+dipshp_script_reader;
+
+/* a warning of the lexer's, which goes to the parser thread if there is
+ * one, for it to stop there */
+static void
+dipshp_lexer_warn(
+    dipshp_script_reader *reader,
+    const char *format,
+    ...
+)
+{
+    va_list args;
+    va_start(args, format);
+    if (!reader->front_end) {
+        vwarnx(format, args);
+        va_end(args);
+        return;
+    }
+    char *message;
+    if (-1 == vasprintf(&message, format, args))
+        message = NULL;
+    va_end(args);
+    dipsh_token *token = dipsh_ring_claim(reader->front_end->tokens);
+    if (!token) {
+        free(message);
+        return;
+    }
+    memset(token, 0, sizeof(*token));
+    token->type = dipsh_token_error;
+    token->value = message;
+    dipsh_ring_publish(reader->front_end->tokens);
+}
+
+/* takes message over */
+static void
+dipshp_put_message(
+    dipshp_script_reader *reader,
+    char *message
+)
+{
+    if (!message)
+        return;
+    dipshp_statement_item *item =
+        dipsh_ring_claim(reader->front_end->statements);
+    /* the main thread has stopped taking the statements */
+    if (!item) {
+        free(message);
+        return;
+    }
+    item->message = message;
+    dipsh_ring_publish(reader->front_end->statements);
+}
+
+/* a warning of the parser's, which goes to the main thread along with the
+ * statements if there are threads, so that it comes out in the same place
+ * as with none */
+static void
+dipshp_parser_warn(
+    dipshp_script_reader *reader,
+    const char *format,
+    ...
+)
+{
+    va_list args;
+    va_start(args, format);
+    if (!reader->front_end) {
+        vwarnx(format, args);
+    } else {
+        char *message;
+        if (-1 == vasprintf(&message, format, args))
+            message = NULL;
+        dipshp_put_message(reader, message);
+    }
+    va_end(args);
+}
+
+/* the pending arena goes along with the statement, and the item's one,
+ * reset by now, becomes the pending one; the statement is dropped if the
+ * main thread has stopped taking them */
+static void
+dipshp_hand_pending_over(
+    dipshp_script_reader *reader,
+    int is_final
+)
+{
+    dipshp_statement_item *item =
+        dipsh_ring_claim(reader->front_end->statements);
+    if (!item) {
+        dipsh_ast_clean(&reader->pending);
+        dipsh_arena_reset(reader->pending_arena);
+        return;
+    }
+    dipsh_arena *arena = item->arena;
+    item->ast = reader->pending;
+    item->arena = reader->pending_arena;
+    item->message = NULL;
+    item->is_final = is_final;
+    reader->pending_arena = arena;
+    dipsh_ring_publish(reader->front_end->statements);
+}
+
+/* the pending statement has just been parsed into the pending arena, which 
+ * the previous one, run by now, has left free */
+static void
+dipshp_set_pending_statement(
+    dipshp_script_reader *reader
+)
+{
+    if (reader->cache_writer &&
+        0 != dipsh_script_cache_writer_add(
+            reader->cache_writer, &reader->pending)) {
+        dipshp_parser_warn(
+            reader, "no memory to cache the script, it goes uncached"
+        );
+        dipsh_script_cache_writer_destroy(reader->cache_writer);
+        reader->cache_writer = NULL;
+    }
+    if (reader->compile_only) {
+        dipsh_ast_clean(&reader->pending);
+        dipsh_arena_reset(reader->pending_arena);
+        return;
+    }
+    reader->has_pending = 1;
+    if (reader->show_parsing_info) {
+        puts("parsing results:");
+        dipshp_print_ast(&reader->pending, reader->pending_arena);
+    }
+}
+
+static void
+dipshp_run_pending_statement(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state,
+    int is_final
+)
+{
+    if (!reader->has_pending)
+        return;
+    reader->has_pending = 0;
+    if (reader->front_end) {
+        dipshp_hand_pending_over(reader, is_final);
+        return;
+    }
+    dipshp_run_ast(&reader->pending, state, is_final);
+    dipsh_ast_clean(&reader->pending);
+    dipsh_arena_reset(reader->pending_arena);
+}
+
+static int
+dipshp_read_script_token(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state,
+    dipsh_token *token
+)
+{
+    if (reader->show_parsing_info)
+        dipshp_print_token(reader->tokens_read, token);
+    ++reader->tokens_read;
+    /* anything but a blank line means the pending statement isn't the last */
+    if (dipsh_token_newline != token->type)
+        dipshp_run_pending_statement(reader, state, 0);
+
+    int ret = dipsh_parser_next_token(reader->parser, token);
+    if (dipsh_parser_accepted != ret) {
+        char *esc_msg = dipshp_escape_non_printables(
+            dipsh_parser_state_get_error(reader->parser)
+        );
+        dipshp_parser_warn(reader, "%s", esc_msg);
+        free(esc_msg);
+        return 1;
+    }
+    ret = dipsh_parser_take_statement(
+        reader->parser, reader->pending_arena, &reader->pending
+    );
+    if (-1 == ret) {
+        dipshp_parser_warn(
+            reader, "%s", dipsh_parser_state_get_error(reader->parser)
+        );
+        return 1;
+    }
+    if (ret)
+        dipshp_set_pending_statement(reader);
+    return 0;
+}
+
+/* hands the tokens over to the parser thread, made to outlive the piece of
+ * the script they are from; returns 1 if the parser has stopped */
+static int
+dipshp_pass_tokens(
+    dipshp_script_reader *reader
+)
+{
+    if (0 != dipsh_token_vec_unslice(&reader->tokens, 0)) {
+        dipshp_lexer_warn(reader, "no memory to read the script");
+        return 1;
+    }
+    for (int i = 0; i < reader->tokens.length; ++i) {
+        dipsh_token *token = dipsh_ring_claim(reader->front_end->tokens);
+        if (!token)
+            return 1;
+        /* the value is the slot's now, the token owning nothing */
+        *token = reader->tokens.tokens[i];
+        reader->tokens.tokens[i].is_slice = 1;
+        reader->tokens.tokens[i].is_interned = 0;
+    }
+    dipsh_ring_publish(reader->front_end->tokens);
+    return 0;
+}
+
+/* lexes a piece of the script, then runs the statements that get complete
+ * (or passes the tokens on to the parser thread); buf NULL means the end of
+ * the script */
+static int
+dipshp_read_script_buf(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state,
+    const char *buf,
+    int len
+)
+{
+    dipsh_token_vec_clear(&reader->tokens);
+    int lexer_ret = 
+        dipsh_lexer_feed(reader->lexer, buf, len, &reader->tokens);
+    /* the statements before a lexical error still go */
+    if (reader->front_end) {
+        if (0 != dipshp_pass_tokens(reader))
+            return 1;
+    } else {
+        for (int i = 0; i < reader->tokens.length; ++i) {
+            dipsh_token *token = &reader->tokens.tokens[i];
+            int ret = dipshp_read_script_token(reader, state, token);
+            if (0 != ret)
+                return ret;
+        }
+    }
+    if (-1 == lexer_ret) {
+        char *esc_msg = dipshp_escape_non_printables(
+            dipsh_lexer_state_get_error(reader->lexer)
+        );
+        dipshp_lexer_warn(
+            reader, "line %d: %s",
+            dipsh_lexer_state_get_line(reader->lexer), esc_msg
+        );
+        free(esc_msg);
+        return 1;
+    }
+    return 0;
+}
+
+static int
+dipshp_read_script_by_chunks(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state,
+    int script_fd
+)
+{
+    char buf[DIPSHP_SCRIPT_BUF_SIZE];
+    for (;;) {
+        int buf_len;
+        do {
+            buf_len = read(script_fd, buf, sizeof(buf));
+        } while (-1 == buf_len && EINTR == errno);
+        if (-1 == buf_len) {
+            dipshp_lexer_warn(
+                reader, "can't read the script: %s", strerror(errno)
+            );
+            return 1;
+        }
+        if (0 == buf_len)
+            return 0;
+        int ret = dipshp_read_script_buf(reader, state, buf, buf_len);
+        if (0 != ret)
+            return ret;
+    }
+}
+
+/* a regular file is mapped, so that most of its words are never copied */
+static int
+dipshp_read_script_mapped(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state,
+    int script_fd,
+    int *is_mapped
+)
+{
+    struct stat st;
+    *is_mapped = 0;
+    if (0 != fstat(script_fd, &st) || !S_ISREG(st.st_mode) || !st.st_size)
+        return 0;
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, script_fd, 0);
+    if (MAP_FAILED == map)
+        return 0;
+    *is_mapped = 1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    int ret = 0;
+    /* fed piece by piece, so that no more than a piece's tokens are kept; 
+     * nothing refers to a piece once its statements are parsed (the parser 
+     * copies the words), so its pages are given back */
+    for (off_t pos = 0; pos < st.st_size && 0 == ret; ) {
+        off_t piece_len = st.st_size - pos;
+        if (piece_len > DIPSHP_SCRIPT_BUF_SIZE)
+            piece_len = DIPSHP_SCRIPT_BUF_SIZE;
+        ret = dipshp_read_script_buf(reader, state, map + pos, piece_len);
+        madvise(map + pos, piece_len, MADV_DONTNEED);
+        pos += piece_len;
+    }
+    munmap(map, st.st_size);
+    return ret;
+}
+
+/* all the script's characters, to its end, through the lexer */
+static int
+dipshp_lex_script(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state,
+    int script_fd
+)
+{
+    int is_mapped;
+    int ret = dipshp_read_script_mapped(reader, state, script_fd, &is_mapped);
+    if (0 == ret && !is_mapped)
+        ret = dipshp_read_script_by_chunks(reader, state, script_fd);
+    if (0 == ret)
+        ret = dipshp_read_script_buf(reader, state, NULL, 0);
+    return ret;
+}
+
+/* the parser's part once the tokens are over */
+static int
+dipshp_finish_script(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state
+)
+{
+    /* a statement with no newline after it, if any; the first token of it 
+     * has run the pending one, so the pending arena is free then */
+    dipsh_ast ast;
+    int ret = dipsh_parser_finish(reader->parser, reader->pending_arena, &ast);
+    if (dipsh_parser_accepted != ret) {
+        dipshp_parser_warn(
+            reader, "%s", dipsh_parser_state_get_error(reader->parser)
+        );
+        return 1;
     }
-out:
+    if (ast.nodes_len) {
+        reader->pending = ast;
+        dipshp_set_pending_statement(reader);
+    }
+    /* before the last statement, which may replace the shell */
+    if (reader->cache_writer) {
+        ret = dipsh_script_cache_writer_save(
+            reader->cache_writer, reader->cache_path
+        );
+        if (0 != ret && reader->compile_only)
+            return ret;
+    }
+    dipshp_run_pending_statement(reader, state, 1);
     return 0;
 }
 
+/* runs every statement as soon as it's parsed, so neither the time before 
+ * the first command nor the memory depends on the length of the script */
+static int
+dipshp_read_script(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state,
+    int script_fd
+)
+{
+    int ret = dipshp_lex_script(reader, state, script_fd);
+    return 0 == ret ? dipshp_finish_script(reader, state) : ret;
+}
+
+static void *
+dipshp_lexer_thread(
+    void *arg
+)
+{
+    dipshp_script_reader *reader = arg;
+    dipshp_lex_script(reader, NULL, reader->front_end->script_fd);
+    dipsh_ring_close(reader->front_end->tokens);
+    return NULL;
+}
+
+static void *
+dipshp_parser_thread(
+    void *arg
+)
+{
+    dipshp_script_reader *reader = arg;
+    dipshp_front_end *front_end = reader->front_end;
+    int ret = 0;
+    dipsh_token *token;
+    while (0 == ret && (token = dipsh_ring_peek(front_end->tokens))) {
+        if (dipsh_token_error == token->type) {
+            dipshp_put_message(reader, token->value);
+            token->value = NULL;
+            ret = 1;
+        } else {
+            ret = dipshp_read_script_token(reader, NULL, token);
+        }
+        dipsh_token_clean(token);
+        dipsh_ring_release(front_end->tokens);
+    }
+    if (0 == ret)
+        ret = dipshp_finish_script(reader, NULL);
+    else
+        dipsh_ring_cancel(front_end->tokens);
+    /* whatever has been parsed before an error still runs */
+    dipshp_run_pending_statement(reader, NULL, 0);
+    front_end->ret = ret;
+    dipsh_ring_close(front_end->statements);
+    return NULL;
+}
+
+static void
+dipshp_destroy_front_end(
+    dipshp_front_end *front_end
+)
+{
+    for (int i = 0; front_end->statements &&
+         i < DIPSHP_STATEMENTS_RING_LEN; ++i) {
+        dipshp_statement_item *item =
+            dipsh_ring_get_slot(front_end->statements, i);
+        dipsh_arena_destroy(item->arena);
+    }
+    dipsh_ring_destroy(front_end->statements);
+    dipsh_ring_destroy(front_end->tokens);
+}
+
+/* returns 1, with nothing read, if the threads can't be started */
+static int
+dipshp_start_front_end(
+    dipshp_script_reader *reader,
+    dipshp_front_end *front_end,
+    int script_fd
+)
+{
+    memset(front_end, 0, sizeof(*front_end));
+    front_end->script_fd = script_fd;
+    front_end->tokens =
+        dipsh_ring_init(sizeof(dipsh_token), DIPSHP_TOKENS_RING_LEN);
+    front_end->statements = dipsh_ring_init(
+        sizeof(dipshp_statement_item), DIPSHP_STATEMENTS_RING_LEN
+    );
+    int ret = !front_end->tokens || !front_end->statements;
+    for (int i = 0; 0 == ret && i < DIPSHP_STATEMENTS_RING_LEN; ++i) {
+        dipshp_statement_item *item =
+            dipsh_ring_get_slot(front_end->statements, i);
+        item->arena = dipsh_arena_init();
+        ret = !item->arena;
+    }
+    if (0 != ret) {
+        dipshp_destroy_front_end(front_end);
+        return 1;
+    }
+
+    reader->front_end = front_end;
+    dipsh_intern_set_shared(1);
+    /* the signals, SIGCHLD above all, are left to the main thread */
+    sigset_t all_signals, old_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    ret = pthread_create(
+        &front_end->parser_thread, NULL, dipshp_parser_thread, reader
+    );
+    if (0 == ret) {
+        ret = pthread_create(
+            &front_end->lexer_thread, NULL, dipshp_lexer_thread, reader
+        );
+        front_end->has_lexer_thread = 0 == ret;
+        /* the parser thread is waiting for the tokens, so it's stopped
+         * the way a lexer's error stops it */
+        if (0 != ret) {
+            dipshp_lexer_warn(reader, "can't start the lexer thread");
+            dipsh_ring_close(front_end->tokens);
+        }
+        ret = 0;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    if (0 != ret) {
+        dipsh_intern_set_shared(0);
+        reader->front_end = NULL;
+        dipshp_destroy_front_end(front_end);
+    }
+    return ret;
+}
+
+/* runs the statements as the threads hand them over, till the threads are
+ * done; returns what reading the script has ended with */
+static int
+dipshp_run_front_end(
+    dipshp_script_reader *reader,
+    dipsh_shell_state *state
+)
+{
+    dipshp_front_end *front_end = reader->front_end;
+    dipshp_statement_item *item;
+    while ((item = dipsh_ring_peek(front_end->statements))) {
+        if (item->message) {
+            warnx("%s", item->message);
+            free(item->message);
+            item->message = NULL;
+        } else {
+            dipshp_run_ast(&item->ast, state, item->is_final);
+            dipsh_ast_clean(&item->ast);
+            dipsh_arena_reset(item->arena);
+        }
+        dipsh_ring_release(front_end->statements);
+    }
+
+    if (front_end->has_lexer_thread)
+        pthread_join(front_end->lexer_thread, NULL);
+    pthread_join(front_end->parser_thread, NULL);
+    dipsh_intern_set_shared(0);
+    /* the tokens the parser has left after an error */
+    dipsh_token *token;
+    while ((token = dipsh_ring_peek(front_end->tokens))) {
+        dipsh_token_clean(token);
+        dipsh_ring_release(front_end->tokens);
+    }
+    reader->front_end = NULL;
+    dipshp_destroy_front_end(front_end);
+    return front_end->ret;
+}
+
+static void
+dipshp_script_reader_init(
+    dipshp_script_reader *reader,
+    int show_parsing_info
+)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->lexer = dipsh_lexer_state_init();
+    reader->parser = dipsh_parser_state_init();
+    reader->pending_arena = dipsh_arena_init();
+    reader->show_parsing_info = show_parsing_info;
+    dipsh_token_vec_init(&reader->tokens);
+}
+
+static void
+dipshp_script_reader_destroy(
+    dipshp_script_reader *reader
+)
+{
+    dipsh_script_cache_writer_destroy(reader->cache_writer);
+    dipsh_parser_state_destroy(reader->parser);
+    dipsh_arena_destroy(reader->pending_arena);
+    dipsh_token_vec_destroy(&reader->tokens);
+    dipsh_lexer_state_destroy(reader->lexer);
+}
+
+/* the statements are run as the reader runs them, the last one as final */
+static void
+dipshp_run_script_cache(
+    const dipsh_script_cache *cache,
+    dipsh_shell_state *state
+)
+{
+    dipsh_arena *arena = dipsh_arena_init();
+    if (!arena) {
+        warnx("no memory to run the script");
+        return;
+    }
+    int statements_len = dipsh_script_cache_get_statements_len(cache);
+    for (int i = 0; i < statements_len; ++i) {
+        dipsh_ast ast;
+        int ret = dipsh_script_cache_get_statement(cache, i, arena, &ast);
+        if (0 != ret) {
+            warnx("no memory to run the script");
+            break;
+        }
+        dipshp_run_ast(&ast, state, statements_len - 1 == i);
+        dipsh_ast_clean(&ast);
+        dipsh_arena_reset(arena);
+    }
+    dipsh_arena_destroy(arena);
+}
+
 int
 dipsh_execute_script(
     const char *script_name,
-    int show_parsing_info
+    int show_parsing_info,
+    int is_threaded
 )
 {
-    dipsh_shell_state state = {
-        .is_interactive = 0
-    };
-    FILE *script = fopen(script_name, "r");
-    if (!script)
+    dipsh_shell_state state;
+    int ret = dipsh_shell_state_init(&state, 0);
+    if (0 != ret)
+        warnx("can't start the event loop, children are waited one by one");
+    /* not a FILE: a forked subshell leaving with exit() would move the 
+     * shared offset back to where its copy of the stream has stopped */
+    int script_fd = open(script_name, O_RDONLY | O_CLOEXEC);
+    if (-1 == script_fd)
         err(1, "can't open file '%s'", script_name);
-    dipsh_tokenize_error err;
-    dipsh_token_list *list = dipsh_tokenize_stream(script, &err);
-    int ret = dipshp_handle_parsed_list(list, &err, &state, show_parsing_info);
-    fclose(script);
+
+    /* a script that has a cache, having been compiled, is run from it; a
+     * stale cache is made anew as the script is read */
+    char *cache_path = show_parsing_info
+        ? NULL
+        : dipsh_script_cache_path(script_name);
+    dipsh_script_cache *cache = NULL;
+    dipsh_script_cache_writer *cache_writer = NULL;
+    int cache_ret = cache_path
+        ? dipsh_script_cache_open(
+            script_name, script_fd, cache_path, &cache, &cache_writer
+        )
+        : dipsh_script_cache_missing;
+    if (dipsh_script_cache_ok == cache_ret) {
+        dipshp_run_script_cache(cache, &state);
+        dipsh_script_cache_close(cache);
+        free(cache_path);
+        close(script_fd);
+        dipsh_shell_state_destroy(&state);
+        return 0;
+    }
+
+    dipshp_script_reader reader;
+    dipshp_script_reader_init(&reader, show_parsing_info);
+    if (dipsh_script_cache_stale == cache_ret) {
+        reader.cache_writer = cache_writer;
+        reader.cache_path = cache_path;
+    }
+    if (show_parsing_info)
+        puts("lexical analysis results:");
+    dipshp_front_end front_end;
+    if (is_threaded &&
+        0 != dipshp_start_front_end(&reader, &front_end, script_fd)) {
+        warnx("can't start the threads, the script is read in this one");
+        is_threaded = 0;
+    }
+    if (is_threaded) {
+        ret = dipshp_run_front_end(&reader, &state);
+    } else {
+        ret = dipshp_read_script(&reader, &state, script_fd);
+        /* whatever has been parsed before an error still runs */
+        dipshp_run_pending_statement(&reader, &state, 0);
+    }
+    dipshp_script_reader_destroy(&reader);
+    free(cache_path);
+    close(script_fd);
+    dipsh_shell_state_destroy(&state);
     return ret;
 }
 
+int
+dipsh_compile_script(
+    const char *script_name
+)
+{
+    int script_fd = open(script_name, O_RDONLY | O_CLOEXEC);
+    if (-1 == script_fd)
+        err(1, "can't open file '%s'", script_name);
+    char *cache_path = dipsh_script_cache_path(script_name);
+    if (!cache_path) {
+        warnx("no place for the cache: neither XDG_CACHE_HOME nor HOME is set");
+        close(script_fd);
+        return 1;
+    }
+    dipshp_script_reader reader;
+    dipshp_script_reader_init(&reader, 0);
+    reader.compile_only = 1;
+    reader.cache_path = cache_path;
+    reader.cache_writer =
+        dipsh_script_cache_writer_init(script_name, script_fd);
+    int ret = 1;
+    if (!reader.cache_writer)
+        warnx("'%s' can't be cached, it must be a regular file", script_name);
+    else
+        ret = dipshp_read_script(&reader, NULL, script_fd);
+    dipshp_script_reader_destroy(&reader);
+    free(cache_path);
+    close(script_fd);
+    return ret;
+}
@@ -1,15 +1,28 @@
 #ifndef _DIPSH_SHELL_MODES_H_
 #define _DIPSH_SHELL_MODES_H_
 
+/* with is_threaded, the script is lexed and parsed in threads of their
+ * own while the statements run */
 int
 dipsh_execute_script(
     const char *script_name,
-    int show_parsing_info
+    int show_parsing_info,
+    int is_threaded
 );
 
+/* parses the script and saves it as a cache (see script_cache.h), which
+ * is used from then on whenever the script is run; nothing is run */
+int
+dipsh_compile_script(
+    const char *script_name
+);
+
+/* with show_cache_info, the counters of the cache of the statements typed
+ * in (see statement_cache.h) are shown once stdin is over */
 int
 dipsh_interactive_shell(
-    int show_parsing_info
+    int show_parsing_info,
+    int show_cache_info
 );
 
 #endif /* _DIPSH_SHELL_MODES_H_ */
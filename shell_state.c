@@ -1,98 +1,174 @@
 #include "shell_state.h"
-#include "execute.h"
+#include "path_cache.h"
+#include "event_loop.h"
+#include "pipeline.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <errno.h>
-#include <sys/wait.h>
+
+static int
+dipshp_shell_state_child_reaped_cb(
+    int pid,
+    int wait_status,
+    void *ctx
+)
+{
+    dipsh_shell_state *state = ctx;
+    return 0 == dipsh_shell_state_mark_finished_command(
+        state, pid, wait_status
+    );
+}
+
+int
+dipsh_shell_state_init(
+    dipsh_shell_state *state,
+    int is_interactive
+)
+{
+    state->is_interactive = is_interactive;
+    dipsh_job_table_init(&state->jobs);
+    int ret = dipsh_event_loop_init();
+    if (0 != ret)
+        return 1;
+    dipsh_event_loop_set_reaped_cb(dipshp_shell_state_child_reaped_cb, state);
+    return 0;
+}
+
+void
+dipsh_shell_state_destroy(
+    dipsh_shell_state *state
+)
+{
+    dipsh_event_loop_set_reaped_cb(NULL, NULL);
+    dipsh_job_table_destroy(&state->jobs);
+}
 
 static int
 dipshp_shell_state_bg_do_fork(
     dipsh_shell_state *state,
-    const dipsh_symbol *ast,
-    dipsh_shell_bg_command *bg_command
+    dipsh_subshell_body body,
+    void *ctx,
+    dipsh_job *job
 )
 {
-    bg_command->bg_pipe[0] = -1;
-    bg_command->bg_pipe[1] = -1;
-    int ret = pipe(bg_command->bg_pipe);
-    if (-1 == ret)
-        goto fail_exit;
+    /* or the subshell would print whatever is buffered once again */
+    fflush(stdout);
     int pid = fork();
     if (0 == pid) {
         setpgid(0, 0);
-        close(bg_command->bg_pipe[0]);
+        dipsh_job_status_slot *slot = 
+            dipsh_job_table_get_status_slot(&state->jobs, job);
+        /* the table is the parent's, the subshell starts its own; the 
+         * inherited one is left alone as the slot lives there */
+        dipsh_job_table_init(&state->jobs);
+        /* the inotify fd is shared with the parent, which needs its events */
+        dipsh_path_cache_reset();
+        /* so is the event loop, the subshell just waits for its children */
+        dipsh_event_loop_reset_after_fork();
         state->is_interactive = 0;
-        ret = dipsh_execute_ast(ast, state);
-        write(
-            bg_command->bg_pipe[1], &state->last_status, 
-            sizeof(dipsh_command_status)
-        );
+        int ret = body(state, ctx);
+        dipsh_job_status_slot_write(slot, &state->last_status);
         exit(ret);
     } else if (0 < pid) {
-        close(bg_command->bg_pipe[1]);
-        bg_command->bg_pid = pid;
-        return 0;
+        return dipsh_job_table_add_pid(&state->jobs, job, pid);
     } else {
-        goto fail_exit;
+        return 1;
     }
+}
 
-fail_exit:
-    if (-1 != bg_command->bg_pipe[0]) {
-        close(bg_command->bg_pipe[0]);
-        close(bg_command->bg_pipe[1]);
+/* hands the started processes over to the job */
+static int
+dipshp_shell_state_adopt_pipeline(
+    dipsh_shell_state *state,
+    dipsh_pipeline *pipeline,
+    dipsh_job *job
+)
+{
+    int ret = 0;
+    int commands_len = dipsh_pipeline_get_commands_len(pipeline);
+    for (int i = 0; i < commands_len; ++i) {
+        dipsh_command *command = dipsh_pipeline_get_command(pipeline, i);
+        int pid = dipsh_command_get_pid(command);
+        if (pid) {
+            ret |= dipsh_job_table_add_pid(&state->jobs, job, pid);
+        } else if (commands_len - 1 == i) {
+            dipsh_job_table_set_failed_last(
+                job, dipsh_wait_for_command(command)
+            );
+        }
+        dipsh_command_detach(command);
     }
-    return 1; 
+    return ret;
 }
 
-int
-dipsh_shell_state_spawn_bg_command(
+/* nothing to wait for if no process could be started, which has been 
+ * reported already */
+static void
+dipshp_shell_state_bg_started(
     dipsh_shell_state *state,
-    const dipsh_symbol *ast,
+    dipsh_job *job,
     dipsh_spawned_bg_command_cb bg_cb
 )
 {
-    dipsh_shell_bg_command_list *list_item = 
-        calloc(sizeof(dipsh_shell_bg_command_list), 1);
-    if (!list_item)
-        goto fail;
-
-    list_item->next = state->bg_commands;
-    state->bg_commands = list_item;
+    if (!job->pid)
+        dipsh_job_table_remove(&state->jobs, job);
+    else if (bg_cb)
+        bg_cb(job->pid);
+}
 
-    int ret = dipshp_shell_state_bg_do_fork(state, ast, &list_item->bg_command);
-    if (0 != ret)
-        goto fail;
-    else {
-        if (bg_cb)
-            bg_cb(list_item->bg_command.bg_pid);
-        return 0;
-    }
+int
+dipsh_shell_state_spawn_bg_pipeline(
+    dipsh_shell_state *state,
+    dipsh_pipeline *pipeline,
+    dipsh_spawned_bg_command_cb bg_cb
+)
+{
+    dipsh_job *job = dipsh_job_table_new_job(&state->jobs);
+    if (!job)
+        return 1;
+    dipsh_pipeline_rewind(pipeline, 0, state);
+    int ret = dipsh_pipeline_execute(pipeline);
+    /* whatever has been started must be reaped by the job anyway */
+    ret |= dipshp_shell_state_adopt_pipeline(state, pipeline, job);
+    dipshp_shell_state_bg_started(state, job, bg_cb);
+    return 0 != ret;
+}
 
-fail:
-    if (list_item && state->bg_commands == list_item) 
-        state->bg_commands = list_item->next;
-    free(list_item);
-    return 1;
+int
+dipsh_shell_state_spawn_bg_subshell(
+    dipsh_shell_state *state,
+    dipsh_subshell_body body,
+    void *ctx,
+    dipsh_spawned_bg_command_cb bg_cb
+)
+{
+    dipsh_job *job = dipsh_job_table_new_job(&state->jobs);
+    if (!job)
+        return 1;
+    int ret = dipshp_shell_state_bg_do_fork(state, body, ctx, job);
+    dipshp_shell_state_bg_started(state, job, bg_cb);
+    return ret;
 }
 
 int
 dipsh_shell_state_mark_finished_command(
     dipsh_shell_state *state,
-    int bg_pid
+    int bg_pid,
+    int wait_status
 )
 {
-    dipsh_shell_bg_command_list *bg_commands = state->bg_commands;
-    while (bg_commands) {
-        if (bg_commands->bg_command.bg_pid == bg_pid) {
-            bg_commands->bg_command.finished = 1;
-            return 0;
-        }
-        bg_commands = bg_commands->next;
-    }
-    return 1;
+    dipsh_job *job = 
+        dipsh_job_table_mark_reaped(&state->jobs, bg_pid, wait_status);
+    return job ? 0 : 1;
 }
 
+int
+dipsh_shell_state_has_finished_bg_commands(
+    const dipsh_shell_state *state
+)
+{
+    return NULL != dipsh_job_table_first_finished(&state->jobs);
+}
 
 void
 dipsh_shell_state_clear_finished_bg_commands(
@@ -100,29 +176,39 @@ dipsh_shell_state_clear_finished_bg_commands(
     dipsh_finished_bg_command_cb bg_cb
 )
 {
-    dipsh_shell_bg_command_list **bg_commands = &state->bg_commands;
-    dipsh_command_status status;
-    while (*bg_commands) {
-        int wait_status;
-        int wait_ret = waitpid(
-            (*bg_commands)->bg_command.bg_pid, &wait_status, WNOHANG
-        );
-        if (0 == wait_ret) {
-            bg_commands = &((*bg_commands)->next);
-        } else {
-            int read_ret = read(
-                (*bg_commands)->bg_command.bg_pipe[0], &status, sizeof(status)
-            );
-            close((*bg_commands)->bg_command.bg_pipe[0]);
-            if (bg_cb) {
-                bg_cb(
-                    (*bg_commands)->bg_command.bg_pid, 
-                    sizeof(status) == read_ret ? &status : NULL
-                ); 
-            }
-            dipsh_shell_bg_command_list *temp = *bg_commands;
-            *bg_commands = (*bg_commands)->next;
-            free(temp);
+    dipsh_job *job;
+    while (NULL != (job = dipsh_job_table_first_finished(&state->jobs))) {
+        if (bg_cb)
+            bg_cb(job->pid, &job->status);
+        dipsh_job_table_remove(&state->jobs, job);
+    }
+}
+
+int
+dipsh_shell_state_wait_bg_command(
+    dipsh_shell_state *state,
+    int pid,
+    dipsh_command_status *status
+)
+{
+    for (;;) {
+        dipsh_job *job = -1 == pid
+            ? dipsh_job_table_first_finished(&state->jobs)
+            : dipsh_job_table_find_by_pid(&state->jobs, pid);
+        if (job && job->finished) {
+            int result = job->pid;
+            if (status)
+                *status = job->status;
+            dipsh_job_table_remove(&state->jobs, job);
+            return result;
         }
+        int is_running = -1 == pid
+            ? 0 < dipsh_job_table_get_running_count(&state->jobs)
+            : NULL != job;
+        if (!is_running)
+            return -1;
+        int ret = dipsh_event_loop_wait_for_children();
+        if (dipsh_event_loop_failure == ret)
+            return -1;
     }
 }
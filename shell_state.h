@@ -3,33 +3,25 @@
 
 #include "command.h"
 #include "parser.h"
-#include <signal.h>
-
-typedef struct dipsh_shell_bg_command_tag
-{
-    int bg_pid;
-    int finished;
-    int bg_pipe[2];   
-}
-dipsh_shell_bg_command;
-
-typedef struct dipsh_shell_bg_command_list_tag
-{
-    dipsh_shell_bg_command bg_command;
-    struct dipsh_shell_bg_command_list_tag *next;
-}
-dipsh_shell_bg_command_list;
+#include "job_table.h"
 
 typedef struct dipsh_shell_state_tag
 {
     int is_interactive;
     dipsh_command_status last_status;
-    dipsh_shell_bg_command_list *bg_commands;
+    dipsh_job_table jobs;
 }
 dipsh_shell_state;
 
-sighandler_t
-dipsh_init_chld_handler(
+/* initializes the state and starts reaping children with the event loop */
+int
+dipsh_shell_state_init(
+    dipsh_shell_state *state,
+    int is_interactive
+);
+
+void
+dipsh_shell_state_destroy(
     dipsh_shell_state *state
 );
 
@@ -37,17 +29,42 @@ typedef void (*dipsh_spawned_bg_command_cb)(
     int pid
 );
 
+struct dipsh_pipeline_tag;
+
+/* starts the pipeline in the background, in a group of its own; its 
+ * commands must be external ones, builtins would run in the shell itself */
 int
-dipsh_shell_state_spawn_bg_command(
+dipsh_shell_state_spawn_bg_pipeline(
     dipsh_shell_state *state,
-    const dipsh_symbol *ast,
+    struct dipsh_pipeline_tag *pipeline,
+    dipsh_spawned_bg_command_cb bg_cb
+);
+
+/* what a subshell runs, its result being the exit code of the subshell */
+typedef int (*dipsh_subshell_body)(
+    dipsh_shell_state *state,
+    void *ctx
+);
+
+/* runs body in a subshell in the background */
+int
+dipsh_shell_state_spawn_bg_subshell(
+    dipsh_shell_state *state,
+    dipsh_subshell_body body,
+    void *ctx,
     dipsh_spawned_bg_command_cb bg_cb
 );
 
 int
 dipsh_shell_state_mark_finished_command(
     dipsh_shell_state *state,
-    int bg_pid
+    int bg_pid,
+    int wait_status
+);
+
+int
+dipsh_shell_state_has_finished_bg_commands(
+    const dipsh_shell_state *state
 );
 
 typedef void (*dipsh_finished_bg_command_cb)(
@@ -61,4 +78,13 @@ dipsh_shell_state_clear_finished_bg_commands(
     dipsh_finished_bg_command_cb bg_cb
 );
 
+/* waits for the background command with the pid (any of them if pid is -1)
+ * to finish; returns its pid and status, or -1 if there is no such command */
+int
+dipsh_shell_state_wait_bg_command(
+    dipsh_shell_state *state,
+    int pid,
+    dipsh_command_status *status
+);
+
 #endif /* _DIPSH_SHELL_STATE_H_ */
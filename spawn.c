@@ -0,0 +1,176 @@
+#include "spawn.h"
+#include "event_loop.h"
+#include <spawn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int
+dipshp_spawn_is_expressible(
+    const dipsh_command_traits *traits
+)
+{
+    /* the child can't block waiting for the parent before exec: the parent 
+     * itself is suspended until the child execs */
+    return !traits->suspend_after_fork;
+}
+
+static int
+dipshp_add_redir_actions(
+    posix_spawn_file_actions_t *actions,
+    const dipsh_redirect_list *redirs
+)
+{
+    int ret = 0;
+    for (; redirs && 0 == ret; redirs = redirs->next) {
+        const dipsh_redirect *redir = &redirs->redir;
+        if (dipsh_redir_close == redir->type) {
+            ret = posix_spawn_file_actions_addclose(
+                actions, redir->inherited_fd
+            );
+        } else if (redir->need_open_file) {
+            int open_flags = dipsh_redirect_get_open_flags(redir);
+            if (-1 == open_flags)
+                return EINVAL;
+            ret = posix_spawn_file_actions_addopen(
+                actions, redir->fd, redir->file_name, open_flags, 0666
+            );
+        } else {
+            ret = posix_spawn_file_actions_adddup2(
+                actions, redir->inherited_fd, redir->fd
+            );
+            if (0 == ret) {
+                ret = posix_spawn_file_actions_addclose(
+                    actions, redir->inherited_fd
+                );
+            }
+        }
+    }
+    return ret;
+}
+
+static int
+dipshp_set_spawn_attrs(
+    posix_spawnattr_t *attrs,
+    const dipsh_command_traits *traits
+)
+{
+    short flags = 0;
+    int ret = 0;
+    sigset_t child_mask;
+    /* SIGCHLD is blocked in the shell for the event loop */
+    if (0 == dipsh_event_loop_get_child_sigmask(&child_mask)) {
+        flags |= POSIX_SPAWN_SETSIGMASK;
+        ret = posix_spawnattr_setsigmask(attrs, &child_mask);
+    }
+    if (0 == ret && traits->run_in_separate_group) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        ret = posix_spawnattr_setpgroup(attrs, traits->process_group);
+    }
+    if (0 == ret)
+        ret = posix_spawnattr_setflags(attrs, flags);
+    return ret;
+}
+
+#define DIPSHP_FALLBACK_SHELL "/bin/sh"
+
+static char **
+dipshp_make_shell_argv(
+    const char *path,
+    char **argv
+)
+{
+    int argc = 0;
+    while (argv[argc])
+        ++argc;
+    /* /bin/sh, the script path, then the rest of the arguments */
+    char **sh_argv = calloc(sizeof(char *), argc + 2);
+    if (!sh_argv)
+        return NULL;
+    sh_argv[0] = DIPSHP_FALLBACK_SHELL;
+    sh_argv[1] = (char *)path;
+    for (int i = 1; i <= argc; ++i)
+        sh_argv[i + 1] = argv[i];
+    return sh_argv;
+}
+
+void
+dipsh_exec_command(
+    const char *path,
+    char **argv
+)
+{
+    execv(path, argv);
+    if (ENOEXEC != errno)
+        return;
+    char **sh_argv = dipshp_make_shell_argv(path, argv);
+    if (!sh_argv)
+        return;
+    execv(DIPSHP_FALLBACK_SHELL, sh_argv);
+    free(sh_argv);
+}
+
+static int
+dipshp_spawn_with_fallback(
+    int *pid,
+    const char *path,
+    const posix_spawn_file_actions_t *actions,
+    const posix_spawnattr_t *attrs,
+    char **argv
+)
+{
+    int ret = posix_spawn(pid, path, actions, attrs, argv, environ);
+    if (ENOEXEC != ret)
+        return ret;
+    char **sh_argv = dipshp_make_shell_argv(path, argv);
+    if (!sh_argv)
+        return ENOMEM;
+    ret = posix_spawn(
+        pid, DIPSHP_FALLBACK_SHELL, actions, attrs, sh_argv, environ
+    );
+    free(sh_argv);
+    return ret;
+}
+
+int
+dipsh_spawn_command(
+    dipsh_command *command,
+    const char *path,
+    int *pid
+)
+{
+    const dipsh_command_traits *traits = dipsh_command_get_traits(command);
+    if (!dipshp_spawn_is_expressible(traits))
+        return dipsh_spawn_unsupported;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attrs;
+    int ret = posix_spawn_file_actions_init(&actions);
+    if (0 != ret)
+        goto fail;
+    ret = posix_spawnattr_init(&attrs);
+    if (0 != ret)
+        goto fail_destroy_actions;
+
+    ret = dipshp_add_redir_actions(
+        &actions, dipsh_command_get_all_redirects(command)
+    );
+    if (0 == ret)
+        ret = dipshp_set_spawn_attrs(&attrs, traits);
+    if (0 == ret) {
+        char **argv = dipsh_command_get_argv(command);
+        ret = dipshp_spawn_with_fallback(pid, path, &actions, &attrs, argv);
+    }
+
+    posix_spawnattr_destroy(&attrs);
+fail_destroy_actions:
+    posix_spawn_file_actions_destroy(&actions);
+fail:
+    if (0 != ret) {
+        errno = ret;
+        return dipsh_spawn_failed;
+    }
+    return dipsh_spawn_ok;
+}
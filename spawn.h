@@ -0,0 +1,43 @@
+#ifndef _DIPSH_SPAWN_H_
+#define _DIPSH_SPAWN_H_
+
+#include "command.h"
+
+enum
+{
+    dipsh_spawn_ok,
+    dipsh_spawn_unsupported,
+    dipsh_spawn_failed
+};
+
+/* starts an external command via posix_spawn(3) without copying the shell's
+ * address space
+ * parameters:
+ *     command - the command to start; its redirects become spawn file 
+ *         actions, its traits become spawn attributes
+ *     path    - the already resolved path of the executable
+ *     pid     - where to store the pid of the started process
+ * return values:
+ *     dipsh_spawn_ok          - the command was started
+ *     dipsh_spawn_unsupported - some trait can't be expressed with spawn 
+ *         attributes, so the caller should fall back to fork()
+ *     dipsh_spawn_failed      - the command couldn't be started (errno is 
+ *         set accordingly) */
+
+int
+dipsh_spawn_command(
+    dipsh_command *command,
+    const char *path,
+    int *pid
+);
+
+/* replaces the current process with the executable at path; files without a 
+ * known executable format are run by /bin/sh, the way execvp does it. Returns 
+ * only on failure */
+void
+dipsh_exec_command(
+    const char *path,
+    char **argv
+);
+
+#endif /* _DIPSH_SPAWN_H_ */
@@ -0,0 +1,228 @@
+#include "statement_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DIPSHP_STATEMENT_CACHE_INITIAL_BUCKETS 64
+#define DIPSHP_STATEMENT_CACHE_BUDGET (1 << 20)
+
+typedef struct dipshp_statement_entry_tag
+{
+    struct dipshp_statement_entry_tag *next;
+    /* the entries in the order of their use, the most recent first */
+    struct dipshp_statement_entry_tag *newer;
+    struct dipshp_statement_entry_tag *older;
+    dipsh_bytecode *code;
+    long size;          /* of the entry and the code */
+    unsigned hash;
+    int len;
+    char text[];
+}
+dipshp_statement_entry;
+
+static struct
+{
+    dipshp_statement_entry **buckets;
+    int buckets_len;
+    int entries_len;
+    dipshp_statement_entry *newest;
+    dipshp_statement_entry *oldest;
+    long bytes;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+}
+dipshp_cache;
+
+static unsigned
+dipshp_hash_text(
+    const char *text,
+    int len
+)
+{
+    unsigned hash = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* the place of the entry for the text in its bucket, or the end of the
+ * bucket if there is none */
+static dipshp_statement_entry **
+dipshp_find_entry(
+    const char *text,
+    int len,
+    unsigned hash
+)
+{
+    dipshp_statement_entry **entry =
+        &dipshp_cache.buckets[hash & (dipshp_cache.buckets_len - 1)];
+    for (; *entry; entry = &(*entry)->next) {
+        if ((*entry)->hash == hash && (*entry)->len == len &&
+            0 == memcmp((*entry)->text, text, len)) {
+            return entry;
+        }
+    }
+    return entry;
+}
+
+static void
+dipshp_unlink_entry(
+    dipshp_statement_entry *entry
+)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        dipshp_cache.newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        dipshp_cache.oldest = entry->newer;
+}
+
+static void
+dipshp_link_newest(
+    dipshp_statement_entry *entry
+)
+{
+    entry->newer = NULL;
+    entry->older = dipshp_cache.newest;
+    if (dipshp_cache.newest)
+        dipshp_cache.newest->newer = entry;
+    else
+        dipshp_cache.oldest = entry;
+    dipshp_cache.newest = entry;
+}
+
+static void
+dipshp_remove_entry(
+    dipshp_statement_entry *entry
+)
+{
+    dipshp_statement_entry **place =
+        dipshp_find_entry(entry->text, entry->len, entry->hash);
+    *place = entry->next;
+    dipshp_unlink_entry(entry);
+    --dipshp_cache.entries_len;
+    dipshp_cache.bytes -= entry->size;
+    dipsh_bytecode_destroy(entry->code);
+    free(entry);
+}
+
+static int
+dipshp_grow_buckets()
+{
+    int new_len = dipshp_cache.buckets_len
+        ? 2 * dipshp_cache.buckets_len
+        : DIPSHP_STATEMENT_CACHE_INITIAL_BUCKETS;
+    dipshp_statement_entry **new_buckets =
+        calloc(sizeof(dipshp_statement_entry *), new_len);
+    if (!new_buckets)
+        return 1;
+    for (int i = 0; i < dipshp_cache.buckets_len; ++i) {
+        dipshp_statement_entry *entry = dipshp_cache.buckets[i];
+        while (entry) {
+            dipshp_statement_entry *temp = entry;
+            entry = entry->next;
+            dipshp_statement_entry **bucket =
+                &new_buckets[temp->hash & (new_len - 1)];
+            temp->next = *bucket;
+            *bucket = temp;
+        }
+    }
+    free(dipshp_cache.buckets);
+    dipshp_cache.buckets = new_buckets;
+    dipshp_cache.buckets_len = new_len;
+    return 0;
+}
+
+dipsh_bytecode *
+dipsh_statement_cache_find(
+    const char *text,
+    int len
+)
+{
+    if (!dipshp_cache.buckets_len)
+        return NULL;
+    dipshp_statement_entry *entry =
+        *dipshp_find_entry(text, len, dipshp_hash_text(text, len));
+    if (!entry)
+        return NULL;
+    ++dipshp_cache.hits;
+    dipshp_unlink_entry(entry);
+    dipshp_link_newest(entry);
+    return entry->code;
+}
+
+void
+dipsh_statement_cache_count_miss()
+{
+    ++dipshp_cache.misses;
+}
+
+int
+dipsh_statement_cache_add(
+    const char *text,
+    int len,
+    dipsh_bytecode *code
+)
+{
+    long size = sizeof(dipshp_statement_entry) + len +
+        dipsh_bytecode_get_size(code);
+    if (size > DIPSHP_STATEMENT_CACHE_BUDGET)
+        return 1;
+    if (dipshp_cache.entries_len + 1 > 3 * dipshp_cache.buckets_len / 4 &&
+        0 != dipshp_grow_buckets() && !dipshp_cache.buckets_len) {
+        return 1;
+    }
+    unsigned hash = dipshp_hash_text(text, len);
+    dipshp_statement_entry **place = dipshp_find_entry(text, len, hash);
+    /* the text could only be there already if it has been added twice */
+    if (*place)
+        return 1;
+    dipshp_statement_entry *entry = malloc(sizeof(*entry) + len);
+    if (!entry)
+        return 1;
+    entry->next = NULL;
+    entry->code = code;
+    entry->size = size;
+    entry->hash = hash;
+    entry->len = len;
+    memcpy(entry->text, text, len);
+    *place = entry;
+    dipshp_link_newest(entry);
+    ++dipshp_cache.entries_len;
+    dipshp_cache.bytes += size;
+
+    while (dipshp_cache.bytes > DIPSHP_STATEMENT_CACHE_BUDGET) {
+        dipshp_remove_entry(dipshp_cache.oldest);
+        ++dipshp_cache.evictions;
+    }
+    return 0;
+}
+
+void
+dipsh_statement_cache_reset()
+{
+    while (dipshp_cache.oldest)
+        dipshp_remove_entry(dipshp_cache.oldest);
+    free(dipshp_cache.buckets);
+    dipshp_cache.buckets = NULL;
+    dipshp_cache.buckets_len = 0;
+}
+
+void
+dipsh_statement_cache_get_stats(
+    dipsh_statement_cache_stats *stats
+)
+{
+    stats->hits = dipshp_cache.hits;
+    stats->misses = dipshp_cache.misses;
+    stats->evictions = dipshp_cache.evictions;
+    stats->statements = dipshp_cache.entries_len;
+    stats->bytes = dipshp_cache.bytes;
+    stats->budget = DIPSHP_STATEMENT_CACHE_BUDGET;
+}
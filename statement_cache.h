@@ -0,0 +1,57 @@
+#ifndef _DIPSH_STATEMENT_CACHE_H_
+#define _DIPSH_STATEMENT_CACHE_H_
+
+#include "bytecode.h"
+
+/* shell-wide cache of the statements typed in, compiled (see bytecode.h),
+ * by the exact text of the input they have been read from: the same input
+ * sent again is run with no lexing, parsing or compiling. The least
+ * recently used statements go once the memory they hold is over the
+ * budget */
+
+/* the code compiled from the len chars at text, which is the most recently
+ * used one from then on; NULL if there is none. It belongs to the cache, and
+ * stays valid till the next dipsh_statement_cache_add or reset */
+dipsh_bytecode *
+dipsh_statement_cache_find(
+    const char *text,
+    int len
+);
+
+/* a lookup doesn't count a miss, as the text looked for may be a part of a
+ * line yet; this one does, once it has turned out to be a complete line */
+void
+dipsh_statement_cache_count_miss();
+
+/* keeps code, compiled from the len chars at text, taking it over; the
+ * least recently used statements are dropped to make room for it. Returns
+ * 0, or 1 if it can't be kept (code is the caller's then): there is no
+ * memory, or the code alone is over the budget */
+int
+dipsh_statement_cache_add(
+    const char *text,
+    int len,
+    dipsh_bytecode *code
+);
+
+/* drops all statements, the counters are preserved */
+void
+dipsh_statement_cache_reset();
+
+typedef struct dipsh_statement_cache_stats_tag
+{
+    unsigned long hits;
+    unsigned long misses;       /* of complete lines */
+    unsigned long evictions;
+    int statements;
+    long bytes;
+    long budget;
+}
+dipsh_statement_cache_stats;
+
+void
+dipsh_statement_cache_get_stats(
+    dipsh_statement_cache_stats *stats
+);
+
+#endif /* _DIPSH_STATEMENT_CACHE_H_ */
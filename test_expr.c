@@ -0,0 +1,363 @@
+#include "test_expr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct dipshp_test_state_tag
+{
+    int argc;
+    char **argv;
+    int pos;
+    char *error;
+}
+dipshp_test_state;
+
+static void
+dipshp_set_error(
+    dipshp_test_state *state,
+    const char *fmt, ...
+)
+{
+    if (state->error)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vasprintf(&state->error, fmt, ap);
+    va_end(ap);
+    if (-1 == ret)
+        state->error = strdup("can't evaluate the expression");
+}
+
+static int
+dipshp_is_unary_op(
+    const char *str
+)
+{
+    return '-' == str[0] && str[1] && !str[2] &&
+        strchr("bcdefghknprstuwxzLS", str[1]);
+}
+
+static const char *const dipshp_binary_ops[] = {
+    "=", "==", "!=", "-eq", "-ne", "-gt", "-ge", "-lt", "-le",
+    "-nt", "-ot", "-ef", NULL
+};
+
+static int
+dipshp_is_binary_op(
+    const char *str
+)
+{
+    for (const char *const *op = dipshp_binary_ops; *op; ++op) {
+        if (0 == strcmp(*op, str))
+            return 1;
+    }
+    return 0;
+}
+
+static int
+dipshp_file_has_mode(
+    const char *path,
+    mode_t type
+)
+{
+    struct stat st;
+    return 0 == stat(path, &st) && type == (st.st_mode & S_IFMT);
+}
+
+static int
+dipshp_file_has_bits(
+    const char *path,
+    mode_t bits
+)
+{
+    struct stat st;
+    return 0 == stat(path, &st) && 0 != (st.st_mode & bits);
+}
+
+static int
+dipshp_parse_integer(
+    dipshp_test_state *state,
+    const char *str,
+    long long *value
+)
+{
+    const char *pos = str;
+    while (isspace((unsigned char)*pos))
+        ++pos;
+    char *endptr;
+    errno = 0;
+    *value = strtoll(pos, &endptr, 10);
+    int is_ok = endptr != pos && 0 == errno;
+    for (pos = endptr; is_ok && *pos; ++pos)
+        is_ok = isspace((unsigned char)*pos);
+    if (!is_ok)
+        dipshp_set_error(state, "%s: integer expression expected", str);
+    return is_ok;
+}
+
+static int
+dipshp_eval_unary(
+    dipshp_test_state *state,
+    const char *op,
+    const char *arg
+)
+{
+    struct stat st;
+    long long fd;
+    switch (op[1]) {
+    case 'b': return dipshp_file_has_mode(arg, S_IFBLK);
+    case 'c': return dipshp_file_has_mode(arg, S_IFCHR);
+    case 'd': return dipshp_file_has_mode(arg, S_IFDIR);
+    case 'e': return 0 == stat(arg, &st);
+    case 'f': return dipshp_file_has_mode(arg, S_IFREG);
+    case 'g': return dipshp_file_has_bits(arg, S_ISGID);
+    case 'k': return dipshp_file_has_bits(arg, S_ISVTX);
+    case 'p': return dipshp_file_has_mode(arg, S_IFIFO);
+    case 'S': return dipshp_file_has_mode(arg, S_IFSOCK);
+    case 'u': return dipshp_file_has_bits(arg, S_ISUID);
+    case 'h':
+    case 'L': return 0 == lstat(arg, &st) && S_ISLNK(st.st_mode);
+    case 's': return 0 == stat(arg, &st) && st.st_size > 0;
+    case 'r': return 0 == faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS);
+    case 'w': return 0 == faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS);
+    case 'x': return 0 == faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS);
+    case 'n': return '\0' != *arg;
+    case 'z': return '\0' == *arg;
+    case 't':
+        return dipshp_parse_integer(state, arg, &fd) &&
+            fd >= 0 && fd <= 0x7fffffff && isatty(fd);
+    default:  return 0;
+    }
+}
+
+static int
+dipshp_compare_mtimes(
+    const char *lhs,
+    const char *rhs
+)
+{
+    struct stat lhs_st, rhs_st;
+    int lhs_exists = 0 == stat(lhs, &lhs_st);
+    int rhs_exists = 0 == stat(rhs, &rhs_st);
+    /* a missing file is older than any existing one */
+    if (!lhs_exists || !rhs_exists)
+        return lhs_exists - rhs_exists;
+    if (lhs_st.st_mtim.tv_sec != rhs_st.st_mtim.tv_sec)
+        return lhs_st.st_mtim.tv_sec < rhs_st.st_mtim.tv_sec ? -1 : 1;
+    if (lhs_st.st_mtim.tv_nsec != rhs_st.st_mtim.tv_nsec)
+        return lhs_st.st_mtim.tv_nsec < rhs_st.st_mtim.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+static int
+dipshp_eval_binary(
+    dipshp_test_state *state,
+    const char *lhs,
+    const char *op,
+    const char *rhs
+)
+{
+    if (0 == strcmp(op, "=") || 0 == strcmp(op, "=="))
+        return 0 == strcmp(lhs, rhs);
+    if (0 == strcmp(op, "!="))
+        return 0 != strcmp(lhs, rhs);
+    if (0 == strcmp(op, "-nt"))
+        return dipshp_compare_mtimes(lhs, rhs) > 0;
+    if (0 == strcmp(op, "-ot"))
+        return dipshp_compare_mtimes(lhs, rhs) < 0;
+    if (0 == strcmp(op, "-ef")) {
+        struct stat lhs_st, rhs_st;
+        return 0 == stat(lhs, &lhs_st) && 0 == stat(rhs, &rhs_st) &&
+            lhs_st.st_dev == rhs_st.st_dev && lhs_st.st_ino == rhs_st.st_ino;
+    }
+
+    long long lhs_num, rhs_num;
+    if (!dipshp_parse_integer(state, lhs, &lhs_num) ||
+        !dipshp_parse_integer(state, rhs, &rhs_num)) {
+        return 0;
+    }
+    switch (op[1] << 8 | op[2]) {
+    case 'e' << 8 | 'q': return lhs_num == rhs_num;
+    case 'n' << 8 | 'e': return lhs_num != rhs_num;
+    case 'g' << 8 | 't': return lhs_num > rhs_num;
+    case 'g' << 8 | 'e': return lhs_num >= rhs_num;
+    case 'l' << 8 | 't': return lhs_num < rhs_num;
+    case 'l' << 8 | 'e': return lhs_num <= rhs_num;
+    default:             return 0;
+    }
+}
+
+static int
+dipshp_parse_or(
+    dipshp_test_state *state
+);
+
+static const char *
+dipshp_peek(
+    const dipshp_test_state *state,
+    int offset
+)
+{
+    int pos = state->pos + offset;
+    return pos < state->argc ? state->argv[pos] : NULL;
+}
+
+static int
+dipshp_parse_primary(
+    dipshp_test_state *state
+)
+{
+    const char *curr = dipshp_peek(state, 0);
+    const char *next = dipshp_peek(state, 1);
+    if (!curr) {
+        dipshp_set_error(state, "argument expected");
+        return 0;
+    }
+    const char *rhs = dipshp_peek(state, 2);
+    if (next && rhs && dipshp_is_binary_op(next)) {
+        state->pos += 3;
+        return dipshp_eval_binary(state, curr, next, rhs);
+    }
+    if (0 == strcmp(curr, "(")) {
+        ++state->pos;
+        int result = dipshp_parse_or(state);
+        const char *closing = dipshp_peek(state, 0);
+        if (!closing || 0 != strcmp(closing, ")"))
+            dipshp_set_error(state, "')' expected");
+        ++state->pos;
+        return result;
+    }
+    if (dipshp_is_unary_op(curr) && next) {
+        state->pos += 2;
+        return dipshp_eval_unary(state, curr, next);
+    }
+    ++state->pos;
+    return '\0' != *curr;
+}
+
+static int
+dipshp_parse_not(
+    dipshp_test_state *state
+)
+{
+    const char *curr = dipshp_peek(state, 0);
+    if (curr && 0 == strcmp(curr, "!")) {
+        ++state->pos;
+        return !dipshp_parse_not(state);
+    }
+    return dipshp_parse_primary(state);
+}
+
+static int
+dipshp_parse_and(
+    dipshp_test_state *state
+)
+{
+    int result = dipshp_parse_not(state);
+    const char *curr;
+    while ((curr = dipshp_peek(state, 0)) && 0 == strcmp(curr, "-a")) {
+        ++state->pos;
+        result = dipshp_parse_not(state) && result;
+    }
+    return result;
+}
+
+static int
+dipshp_parse_or(
+    dipshp_test_state *state
+)
+{
+    int result = dipshp_parse_and(state);
+    const char *curr;
+    while ((curr = dipshp_peek(state, 0)) && 0 == strcmp(curr, "-o")) {
+        ++state->pos;
+        result = dipshp_parse_and(state) || result;
+    }
+    return result;
+}
+
+static int
+dipshp_parse_all(
+    dipshp_test_state *state,
+    int first
+)
+{
+    state->pos = first;
+    int result = dipshp_parse_or(state);
+    if (state->pos < state->argc) {
+        dipshp_set_error(
+            state, "%s: unexpected argument", state->argv[state->pos]
+        );
+    }
+    return result;
+}
+
+/* the rules POSIX gives for up to four arguments, the general grammar is
+ * used for the rest */
+static int
+dipshp_eval_by_count(
+    dipshp_test_state *state,
+    int first,
+    int count
+)
+{
+    char **argv = state->argv + first;
+    switch (count) {
+    case 0:
+        return 0;
+    case 1:
+        return '\0' != *argv[0];
+    case 2:
+        if (0 == strcmp(argv[0], "!"))
+            return !dipshp_eval_by_count(state, first + 1, 1);
+        if (dipshp_is_unary_op(argv[0]))
+            return dipshp_eval_unary(state, argv[0], argv[1]);
+        dipshp_set_error(state, "%s: unary operator expected", argv[0]);
+        return 0;
+    case 3:
+        if (dipshp_is_binary_op(argv[1]))
+            return dipshp_eval_binary(state, argv[0], argv[1], argv[2]);
+        if (0 == strcmp(argv[0], "!"))
+            return !dipshp_eval_by_count(state, first + 1, 2);
+        if (0 == strcmp(argv[0], "(") && 0 == strcmp(argv[2], ")"))
+            return dipshp_eval_by_count(state, first + 1, 1);
+        if (0 == strcmp(argv[1], "-a") || 0 == strcmp(argv[1], "-o"))
+            return dipshp_parse_all(state, first);
+        dipshp_set_error(state, "%s: binary operator expected", argv[1]);
+        return 0;
+    case 4:
+        if (0 == strcmp(argv[0], "!"))
+            return !dipshp_eval_by_count(state, first + 1, 3);
+        if (0 == strcmp(argv[0], "(") && 0 == strcmp(argv[3], ")"))
+            return dipshp_eval_by_count(state, first + 1, 2);
+        return dipshp_parse_all(state, first);
+    default:
+        return dipshp_parse_all(state, first);
+    }
+}
+
+int
+dipsh_test_evaluate(
+    int argc,
+    char **argv,
+    char **error
+)
+{
+    dipshp_test_state state = {
+        .argc = argc,
+        .argv = argv,
+        .pos = 0,
+        .error = NULL
+    };
+    int result = dipshp_eval_by_count(&state, 0, argc);
+    *error = state.error;
+    if (state.error)
+        return dipsh_test_error;
+    return result ? dipsh_test_true : dipsh_test_false;
+}
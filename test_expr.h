@@ -0,0 +1,23 @@
+#ifndef _DIPSH_TEST_EXPR_H_
+#define _DIPSH_TEST_EXPR_H_
+
+/* expressions of test(1) aka [, evaluated without leaving the shell */
+
+enum
+{
+    dipsh_test_true = 0,
+    dipsh_test_false = 1,
+    dipsh_test_error = 2
+};
+
+/* evaluates the expression made of argv (the command name and the closing
+ * bracket not included); on dipsh_test_error, *error is set to a message
+ * that has to be freed */
+int
+dipsh_test_evaluate(
+    int argc,
+    char **argv,
+    char **error
+);
+
+#endif /* _DIPSH_TEST_EXPR_H_ */
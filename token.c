@@ -1,4 +1,5 @@
 #include "token.h"
+#include "intern.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -53,17 +54,15 @@ dipsh_delim_to_type(
 
 dipsh_token_type
 dipsh_dbl_delim_to_type(
-    const char *delim
+    char delim
 )
 {
-    if (0 == strcmp(token_traits[dipsh_token_dbl_amp].value, delim))
-        return dipsh_token_dbl_amp;
-    else if (0 == strcmp(token_traits[dipsh_token_dbl_bar].value, delim))
-        return dipsh_token_dbl_bar;
-    else if (0 == strcmp(token_traits[dipsh_token_dbl_gt].value, delim))
-        return dipsh_token_dbl_gt;
-    else
-        return dipsh_token_error;
+    switch (delim) {
+    case '&': return dipsh_token_dbl_amp;
+    case '|': return dipsh_token_dbl_bar;
+    case '>': return dipsh_token_dbl_gt;
+    default:  return dipsh_token_error;
+    }
 }
 
 int
@@ -79,13 +78,155 @@ dipsh_token_init(
     token->type = type;
     token->line = token_line;
     token->value = strdup(token_value);
+    token->length = strlen(token_value);
+    token->is_slice = 0;
+    token->is_interned = 0;
     return 0;
 }
 
+void
+dipsh_token_init_slice(
+    dipsh_token *token,
+    dipsh_token_type type,
+    int token_line,
+    const char *value,
+    int length
+)
+{
+    token->type = type;
+    token->line = token_line;
+    token->value = (char *)value;
+    token->length = length;
+    token->is_slice = 1;
+    token->is_interned = 0;
+}
+
+void
+dipsh_token_init_interned(
+    dipsh_token *token,
+    dipsh_token_type type,
+    int token_line,
+    const char *interned
+)
+{
+    token->type = type;
+    token->line = token_line;
+    token->value = (char *)interned;
+    token->length = dipsh_intern_length(interned);
+    token->is_slice = 0;
+    token->is_interned = 1;
+}
+
+int
+dipsh_token_copy(
+    dipsh_token *token,
+    const dipsh_token *src
+)
+{
+    token->type = src->type;
+    token->line = src->line;
+    token->length = src->length;
+    token->is_slice = 0;
+    token->is_interned = src->is_interned;
+    if (src->is_interned) {
+        token->value = (char *)dipsh_intern_ref(src->value);
+        return 0;
+    }
+    token->value = strndup(src->value, src->length);
+    return token->value ? 0 : 1;
+}
+
+const char *
+dipsh_token_take_interned(
+    dipsh_token *token
+)
+{
+    const char *interned = token->value;
+    if (!token->is_interned) {
+        interned = dipsh_intern(token->value, token->length);
+        if (!interned)
+            return NULL;
+        if (!token->is_slice)
+            free(token->value);
+    }
+    token->value = (char *)interned;
+    token->is_slice = 1;
+    token->is_interned = 0;
+    return interned;
+}
+
 void
 dipsh_token_clean(
     dipsh_token *token
 )
 {
-    free(token->value);
+    if (token->is_interned)
+        dipsh_intern_release(token->value);
+    else if (!token->is_slice)
+        free(token->value);
+}
+
+void
+dipsh_token_vec_init(
+    dipsh_token_vec *vec
+)
+{
+    vec->tokens = NULL;
+    vec->length = 0;
+    vec->capacity = 0;
+}
+
+int
+dipsh_token_vec_reserve(
+    dipsh_token_vec *vec,
+    int count
+)
+{
+    if (vec->length + count <= vec->capacity)
+        return 0;
+    int new_capacity = vec->capacity ? vec->capacity : 16;
+    while (vec->length + count > new_capacity)
+        new_capacity *= 2;
+    dipsh_token *new_tokens = 
+        realloc(vec->tokens, new_capacity * sizeof(dipsh_token));
+    if (!new_tokens)
+        return 1;
+    vec->tokens = new_tokens;
+    vec->capacity = new_capacity;
+    return 0;
+}
+
+int
+dipsh_token_vec_unslice(
+    dipsh_token_vec *vec,
+    int first
+)
+{
+    for (int i = first; i < vec->length; ++i) {
+        dipsh_token *token = &vec->tokens[i];
+        if (token->is_slice && 0 != dipsh_token_copy(token, token))
+            return 1;
+    }
+    return 0;
+}
+
+void
+dipsh_token_vec_clear(
+    dipsh_token_vec *vec
+)
+{
+    for (int i = 0; i < vec->length; ++i)
+        dipsh_token_clean(&vec->tokens[i]);
+    vec->length = 0;
+}
+
+void
+dipsh_token_vec_destroy(
+    dipsh_token_vec *vec
+)
+{
+    dipsh_token_vec_clear(vec);
+    free(vec->tokens);
+    vec->tokens = NULL;
+    vec->capacity = 0;
 }
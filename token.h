@@ -28,7 +28,13 @@ typedef struct dipsh_token_tag
 {
     dipsh_token_type type;
     int line;
+    /* a slice of the lexer's input is not NUL-terminated and lives as long 
+     * as the input does; an interned value holds a reference to the string 
+     * in the intern table (see intern.h) */
     char *value;
+    int length;
+    int is_slice;
+    int is_interned;
 }
 dipsh_token;
 
@@ -42,9 +48,10 @@ dipsh_delim_to_type(
     char delim
 );
 
+/* the type of delim written twice */
 dipsh_token_type
 dipsh_dbl_delim_to_type(
-    const char *delim
+    char delim
 );
 
 int
@@ -55,9 +62,85 @@ dipsh_token_init(
     const char *token_value
 );
 
+/* makes token refer to length chars at value, with no copy made */
+void
+dipsh_token_init_slice(
+    dipsh_token *token,
+    dipsh_token_type type,
+    int token_line,
+    const char *value,
+    int length
+);
+
+/* makes token hold the reference to interned taken by the caller */
+void
+dipsh_token_init_interned(
+    dipsh_token *token,
+    dipsh_token_type type,
+    int token_line,
+    const char *interned
+);
+
+/* the same as dipsh_token_init, but the value is copied from a token of 
+ * any kind (an interned one gets one more reference instead) */
+int
+dipsh_token_copy(
+    dipsh_token *token,
+    const dipsh_token *src
+);
+
+/* hands the reference to the interned value of token over to the caller, 
+ * interning the value first if it's not interned; the token is left as a 
+ * slice of the string then, owning nothing. NULL if there is no memory */
+const char *
+dipsh_token_take_interned(
+    dipsh_token *token
+);
+
 void
 dipsh_token_clean(
     dipsh_token *token
 );
 
+/* a growable array of tokens, kept around to be refilled */
+typedef struct dipsh_token_vec_tag
+{
+    dipsh_token *tokens;
+    int length;
+    int capacity;
+}
+dipsh_token_vec;
+
+void
+dipsh_token_vec_init(
+    dipsh_token_vec *vec
+);
+
+/* makes room for count more tokens past length; returns 0, or 1 if there 
+ * is no memory */
+int
+dipsh_token_vec_reserve(
+    dipsh_token_vec *vec,
+    int count
+);
+
+/* makes the tokens from first on own their values, so that they outlive 
+ * the buffer they are slices of; returns 0, or 1 if there is no memory */
+int
+dipsh_token_vec_unslice(
+    dipsh_token_vec *vec,
+    int first
+);
+
+/* cleans the tokens, keeping the memory for the next ones */
+void
+dipsh_token_vec_clear(
+    dipsh_token_vec *vec
+);
+
+void
+dipsh_token_vec_destroy(
+    dipsh_token_vec *vec
+);
+
 #endif /* _DIPSH_TOKEN_H_ */
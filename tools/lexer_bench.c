@@ -0,0 +1,442 @@
+/* measures the lexer and checks its indexed scan against the char by char
+ * state machine:
+ *
+ *     cc -O2 -I. -o lexer_bench tools/lexer_bench.c lexer.c token.c \
+ *         intern.c -pthread
+ *     ./lexer_bench -g dense|paths MEGABYTES > FILE
+ *     ./lexer_bench FILE...
+ *     ./lexer_bench -f [INPUTS [SEED]]
+ *
+ * run from the top of the tree. -g writes a script of token-dense lines or
+ * of long paths and quoted words. Given files, tokens per second are shown
+ * for dipsh_lexer_next_token fed char by char and for dipsh_lexer_scan over
+ * the whole file, the best of 3 runs each. -f lexes random inputs, split at
+ * random places, with dipsh_lexer_scan using every classifier the CPU has,
+ * and compares the tokens, their lines and the errors with those of
+ * dipsh_lexer_next_token; it also compares the classifiers' masks of random
+ * blocks. lexer_index.c is included rather than linked, for the classifiers
+ * to be picked here */
+
+#include "lexer_index.c"
+#include "lexer.h"
+#include "intern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DIPSHP_LBENCH_RUNS 3
+#define DIPSHP_LBENCH_MAX_INPUT 512
+#define DIPSHP_LBENCH_BLOCKS 100000
+
+/* xorshift64, for the inputs to be the same for the same seed */
+static uint64_t dipshp_lbench_seed = 88172645463325252ULL;
+
+static unsigned
+dipshp_lbench_random(
+    unsigned bound
+)
+{
+    dipshp_lbench_seed ^= dipshp_lbench_seed << 13;
+    dipshp_lbench_seed ^= dipshp_lbench_seed >> 7;
+    dipshp_lbench_seed ^= dipshp_lbench_seed << 17;
+    return dipshp_lbench_seed % bound;
+}
+
+static double
+dipshp_lbench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+dipshp_lbench_generate(
+    const char *kind,
+    long size
+)
+{
+    static const char *words[] = {
+        "echo", "ls", "-l", "cat", "file", "grep", "x", "wc", "-c", "true"
+    };
+    static const char *delims[] = {
+        " | ", " && ", " || ", "; ", " > out", " 2>> err", " < in", " &"
+    };
+    int is_dense = 0 == strcmp(kind, "dense");
+    for (long written = 0; written < size;) {
+        if (is_dense) {
+            int commands = 1 + dipshp_lbench_random(4);
+            for (int c = 0; c < commands; ++c) {
+                int words_len = 1 + dipshp_lbench_random(4);
+                for (int w = 0; w < words_len; ++w) {
+                    written += printf(
+                        w ? " %s" : "%s", words[dipshp_lbench_random(10)]
+                    );
+                }
+                if (c + 1 < commands)
+                    written += printf("%s", delims[dipshp_lbench_random(8)]);
+            }
+        } else {
+            written += printf("cp");
+            for (int w = 0; w < 3; ++w) {
+                written += printf(
+                    dipshp_lbench_random(2)
+                        ? " \"/usr/share/doc/some package %u/README file\""
+                        : " /var/lib/very/long/directory/name/number/%u.conf",
+                    dipshp_lbench_random(100000)
+                );
+            }
+        }
+        written += printf("\n");
+    }
+}
+
+/* tokens in the whole buf, or -1 if the lexer has found an error */
+static long
+dipshp_lbench_lex_chars(
+    const char *buf,
+    long len
+)
+{
+    dipsh_lexer_state *lexer = dipsh_lexer_state_init();
+    long tokens = 0;
+    for (long i = 0; i <= len; ++i) {
+        dipsh_token token;
+        int ret = dipsh_lexer_next_token(
+            lexer, i < len ? (unsigned char)buf[i] : EOF, &token
+        );
+        if (dipsh_lexer_error == ret) {
+            tokens = -1;
+            break;
+        }
+        if (dipsh_lexer_new_token == ret) {
+            dipsh_token_clean(&token);
+            ++tokens;
+        }
+    }
+    dipsh_lexer_state_destroy(lexer);
+    return tokens;
+}
+
+static long
+dipshp_lbench_lex_scan(
+    const char *buf,
+    long len
+)
+{
+    dipsh_lexer_state *lexer = dipsh_lexer_state_init();
+    long tokens = 0;
+    /* one more scan with no buffer, for the end of the input */
+    for (int pos = 0, is_end = 0; !is_end;) {
+        dipsh_token token;
+        is_end = pos == len;
+        int ret = dipsh_lexer_scan(
+            lexer, is_end ? NULL : buf, len, &pos, &token
+        );
+        if (dipsh_lexer_error == ret) {
+            tokens = -1;
+            break;
+        }
+        if (dipsh_lexer_new_token == ret) {
+            dipsh_token_clean(&token);
+            ++tokens;
+        }
+    }
+    dipsh_lexer_state_destroy(lexer);
+    return tokens;
+}
+
+static void
+dipshp_lbench_measure(
+    const char *name,
+    const char *buf,
+    long len,
+    long (*lex)(const char *, long)
+)
+{
+    double best = 0;
+    long tokens = 0;
+    for (int i = 0; i < DIPSHP_LBENCH_RUNS; ++i) {
+        double start = dipshp_lbench_now();
+        tokens = lex(buf, len);
+        double time = dipshp_lbench_now() - start;
+        if (!i || time < best)
+            best = time;
+    }
+    if (-1 == tokens) {
+        printf("  %-6s lexical error\n", name);
+        return;
+    }
+    printf(
+        "  %-6s %ld tokens in %.3f s, %.1fM tok/s\n",
+        name, tokens, best, tokens / best / 1e6
+    );
+}
+
+static int
+dipshp_lbench_file(
+    const char *path
+)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (-1 == fd || -1 == fstat(fd, &st)) {
+        perror(path);
+        return 1;
+    }
+    if (st.st_size > 0x7fffffff) {
+        fprintf(stderr, "%s: too large for dipsh_lexer_scan\n", path);
+        close(fd);
+        return 1;
+    }
+    char *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == buf) {
+        perror(path);
+        return 1;
+    }
+    printf("%s: %.1f MB\n", path, st.st_size / 1e6);
+    dipshp_lbench_measure("chars", buf, st.st_size, dipshp_lbench_lex_chars);
+    dipshp_lbench_measure("scan", buf, st.st_size, dipshp_lbench_lex_scan);
+    munmap(buf, st.st_size);
+    return 0;
+}
+
+/* what the lexer has made of an input: the tokens and the errors, one
+ * after another, printed */
+typedef struct dipshp_lbench_output_tag
+{
+    char *text;
+    size_t len;
+    FILE *stream;
+}
+dipshp_lbench_output;
+
+static void
+dipshp_lbench_output_start(
+    dipshp_lbench_output *out
+)
+{
+    out->text = NULL;
+    out->stream = open_memstream(&out->text, &out->len);
+}
+
+static void
+dipshp_lbench_output_add(
+    dipshp_lbench_output *out,
+    dipsh_lexer_state *lexer,
+    int ret,
+    dipsh_token *token
+)
+{
+    if (dipsh_lexer_error == ret) {
+        fprintf(
+            out->stream, "error, line %d: %s\n",
+            dipsh_lexer_state_get_line(lexer),
+            dipsh_lexer_state_get_error(lexer)
+        );
+    } else if (dipsh_lexer_new_token == ret) {
+        fprintf(
+            out->stream, "%s, line %d: [%.*s]\n",
+            dipsh_type_to_str(token->type), token->line,
+            token->length, token->value ? token->value : ""
+        );
+        dipsh_token_clean(token);
+    }
+}
+
+static void
+dipshp_lbench_lex_reference(
+    const char *buf,
+    int len,
+    dipshp_lbench_output *out
+)
+{
+    dipsh_lexer_state *lexer = dipsh_lexer_state_init();
+    dipshp_lbench_output_start(out);
+    for (int i = 0; i <= len; ++i) {
+        dipsh_token token;
+        int ret = dipsh_lexer_next_token(
+            lexer, i < len ? (unsigned char)buf[i] : EOF, &token
+        );
+        dipshp_lbench_output_add(out, lexer, ret, &token);
+    }
+    fprintf(out->stream, "line %d\n", dipsh_lexer_state_get_line(lexer));
+    fclose(out->stream);
+    dipsh_lexer_state_destroy(lexer);
+}
+
+/* scans buf in pieces, each copied to a buffer of its own, the way the
+ * interactive shell reads them */
+static void
+dipshp_lbench_lex_pieces(
+    const char *buf,
+    int len,
+    dipshp_lbench_output *out
+)
+{
+    dipsh_lexer_state *lexer = dipsh_lexer_state_init();
+    dipshp_lbench_output_start(out);
+    char piece[DIPSHP_LBENCH_MAX_INPUT];
+    for (int start = 0; start < len;) {
+        int piece_len = 1 + dipshp_lbench_random(len - start);
+        memcpy(piece, buf + start, piece_len);
+        for (int pos = 0; pos < piece_len;) {
+            dipsh_token token;
+            int ret = dipsh_lexer_scan(lexer, piece, piece_len, &pos, &token);
+            dipshp_lbench_output_add(out, lexer, ret, &token);
+        }
+        /* the slices must not outlive the piece */
+        memset(piece, 0, piece_len);
+        start += piece_len;
+    }
+    int pos = 0;
+    dipsh_token token;
+    int ret = dipsh_lexer_scan(lexer, NULL, 0, &pos, &token);
+    dipshp_lbench_output_add(out, lexer, ret, &token);
+    fprintf(out->stream, "line %d\n", dipsh_lexer_state_get_line(lexer));
+    fclose(out->stream);
+    dipsh_lexer_state_destroy(lexer);
+}
+
+static void
+dipshp_lbench_classify_full_scalar(
+    const char *buf,
+    dipsh_lexer_block *block
+)
+{
+    dipshp_classify_scalar(buf, DIPSH_LEXER_BLOCK_SIZE, block);
+}
+
+typedef struct dipshp_lbench_classifier_tag
+{
+    const char *name;
+    dipshp_classifier classify;
+}
+dipshp_lbench_classifier;
+
+static int
+dipshp_lbench_get_classifiers(
+    dipshp_lbench_classifier *classifiers
+)
+{
+    int len = 0;
+    classifiers[len++] = (dipshp_lbench_classifier){
+        "scalar", dipshp_lbench_classify_full_scalar
+    };
+#ifdef DIPSHP_X86
+    __builtin_cpu_init();
+    classifiers[len++] = (dipshp_lbench_classifier){
+        "sse2", dipshp_classify_sse2
+    };
+    if (__builtin_cpu_supports("avx2")) {
+        classifiers[len++] = (dipshp_lbench_classifier){
+            "avx2", dipshp_classify_avx2
+        };
+    }
+#endif
+    return len;
+}
+
+/* mostly the chars the lexer treats in some special way */
+static char
+dipshp_lbench_random_char()
+{
+    static const char specials[] = " \t\v\n\"\\&|;<>(){}0123456789";
+    unsigned kind = dipshp_lbench_random(8);
+    if (kind < 3)
+        return specials[dipshp_lbench_random(sizeof(specials) - 1)];
+    if (kind < 7)
+        return 'a' + dipshp_lbench_random(26);
+    return 1 + dipshp_lbench_random(255);
+}
+
+static int
+dipshp_lbench_fuzz(
+    long inputs
+)
+{
+    dipshp_lbench_classifier classifiers[3];
+    int classifiers_len = dipshp_lbench_get_classifiers(classifiers);
+    long mismatches = 0;
+
+    for (long i = 0; i < DIPSHP_LBENCH_BLOCKS; ++i) {
+        char buf[DIPSH_LEXER_BLOCK_SIZE];
+        for (int j = 0; j < DIPSH_LEXER_BLOCK_SIZE; ++j)
+            buf[j] = dipshp_lbench_random_char();
+        dipsh_lexer_block expected, block;
+        memset(&expected, 0, sizeof(expected));
+        classifiers[0].classify(buf, &expected);
+        for (int c = 1; c < classifiers_len; ++c) {
+            memset(&block, 0, sizeof(block));
+            classifiers[c].classify(buf, &block);
+            if (0 != memcmp(&expected, &block, sizeof(block))) {
+                printf("block %ld: %s differs\n", i, classifiers[c].name);
+                ++mismatches;
+            }
+        }
+    }
+
+    for (long i = 0; i < inputs; ++i) {
+        char buf[DIPSHP_LBENCH_MAX_INPUT];
+        int len = 1 + dipshp_lbench_random(DIPSHP_LBENCH_MAX_INPUT);
+        for (int j = 0; j < len; ++j)
+            buf[j] = dipshp_lbench_random_char();
+        dipshp_lbench_output expected;
+        dipshp_lbench_lex_reference(buf, len, &expected);
+        for (int c = 0; c < classifiers_len; ++c) {
+            dipshp_classify = classifiers[c].classify;
+            dipshp_lbench_output out;
+            dipshp_lbench_lex_pieces(buf, len, &out);
+            if (out.len != expected.len ||
+                0 != memcmp(out.text, expected.text, out.len)) {
+                printf("input %ld: %s differs\n", i, classifiers[c].name);
+                ++mismatches;
+            }
+            free(out.text);
+        }
+        free(expected.text);
+    }
+    printf(
+        "%d blocks and %ld inputs, classifiers:", DIPSHP_LBENCH_BLOCKS, inputs
+    );
+    for (int c = 0; c < classifiers_len; ++c)
+        printf(" %s", classifiers[c].name);
+    printf("; %ld mismatches\n", mismatches);
+    return mismatches ? 1 : 0;
+}
+
+int
+main(
+    int argc,
+    char **argv
+)
+{
+    if (argc == 4 && 0 == strcmp(argv[1], "-g")) {
+        dipshp_lbench_generate(argv[2], atol(argv[3]) * 1000000);
+        return 0;
+    }
+    if (argc >= 2 && argc <= 4 && 0 == strcmp(argv[1], "-f")) {
+        if (argc == 4)
+            dipshp_lbench_seed = strtoull(argv[3], NULL, 10) | 1;
+        return dipshp_lbench_fuzz(argc >= 3 ? atol(argv[2]) : 200000);
+    }
+    if (argc < 2 || '-' == argv[1][0]) {
+        fprintf(
+            stderr,
+            "usage: lexer_bench -g dense|paths MEGABYTES\n"
+            "       lexer_bench FILE...\n"
+            "       lexer_bench -f [INPUTS [SEED]]\n"
+        );
+        return 1;
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+        ret |= dipshp_lbench_file(argv[i]);
+    return ret;
+}
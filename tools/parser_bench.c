@@ -0,0 +1,231 @@
+/* measures the parser on tokens lexed beforehand:
+ *
+ *     cc -O2 -I. -o parser_bench tools/parser_bench.c parser.c lexer.c \
+ *         lexer_index.c token.c intern.c arena.c -pthread
+ *     ./parser_bench -g line|lines COMMANDS > FILE
+ *     ./parser_bench FILE...
+ *
+ * run from the top of the tree. -g writes a script of COMMANDS commands of
+ * 3 words each, on one line separated by ';' or 12 to a line joined by
+ * '&&' and '|'. Given files, each is lexed at once, then parsed as a whole
+ * with dipsh_parse_tokens; the best time of 5 runs is shown, the arena the
+ * AST goes to having its chunks reserved by the runs before. So are the
+ * allocations made by the first run and by the last one, counted by the
+ * malloc, calloc and realloc below, which stand in for libc's */
+
+#include "parser.h"
+#include "lexer.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DIPSHP_PBENCH_RUNS 5
+#define DIPSHP_PBENCH_COMMANDS_PER_LINE 12
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static long dipshp_pbench_allocs;
+
+void *
+malloc(
+    size_t size
+)
+{
+    ++dipshp_pbench_allocs;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(
+    size_t nmemb,
+    size_t size
+)
+{
+    ++dipshp_pbench_allocs;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(
+    void *ptr,
+    size_t size
+)
+{
+    ++dipshp_pbench_allocs;
+    return __libc_realloc(ptr, size);
+}
+
+static double
+dipshp_pbench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+dipshp_pbench_generate(
+    const char *kind,
+    long commands
+)
+{
+    int is_one_line = 0 == strcmp(kind, "line");
+    for (long i = 0; i < commands; ++i) {
+        int in_line = i % DIPSHP_PBENCH_COMMANDS_PER_LINE;
+        if (is_one_line)
+            printf(i ? "; " : "");
+        else if (in_line)
+            printf(in_line % 3 ? " | " : " && ");
+        printf("echo some_argument /usr/share/file");
+        if (!is_one_line && DIPSHP_PBENCH_COMMANDS_PER_LINE - 1 == in_line)
+            putchar('\n');
+    }
+    putchar('\n');
+}
+
+/* the tokens of the whole file, which stays mapped as they may be slices of
+ * it; 1 if it can't be lexed */
+static int
+dipshp_pbench_lex_file(
+    const char *path,
+    dipsh_token_vec *tokens
+)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (-1 == fd || -1 == fstat(fd, &st)) {
+        perror(path);
+        return 1;
+    }
+    char *buf = st.st_size
+        ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+        : NULL;
+    close(fd);
+    if (MAP_FAILED == buf) {
+        perror(path);
+        return 1;
+    }
+    dipsh_lexer_state *lexer = dipsh_lexer_state_init();
+    int ret = 0;
+    if (-1 == dipsh_lexer_feed(lexer, buf, st.st_size, tokens) ||
+        -1 == dipsh_lexer_feed(lexer, NULL, 0, tokens)) {
+        fprintf(
+            stderr, "%s: line %d: %s\n", path,
+            dipsh_lexer_state_get_line(lexer),
+            dipsh_lexer_state_get_error(lexer)
+        );
+        ret = 1;
+    }
+    dipsh_lexer_state_destroy(lexer);
+    return ret;
+}
+
+/* the parser takes the words over from the tokens, so each run parses a
+ * copy of them */
+static int
+dipshp_pbench_copy_tokens(
+    const dipsh_token_vec *tokens,
+    dipsh_token_vec *copy
+)
+{
+    dipsh_token_vec_clear(copy);
+    if (0 != dipsh_token_vec_reserve(copy, tokens->length))
+        return 1;
+    for (int i = 0; i < tokens->length; ++i) {
+        if (0 != dipsh_token_copy(&copy->tokens[i], &tokens->tokens[i]))
+            return 1;
+        ++copy->length;
+    }
+    return 0;
+}
+
+static int
+dipshp_pbench_file(
+    const char *path
+)
+{
+    dipsh_token_vec tokens, copy;
+    dipsh_token_vec_init(&tokens);
+    dipsh_token_vec_init(&copy);
+    if (0 != dipshp_pbench_lex_file(path, &tokens)) {
+        dipsh_token_vec_destroy(&tokens);
+        return 1;
+    }
+    dipsh_parser_state *parser = dipsh_parser_state_init();
+    dipsh_arena *arena = dipsh_arena_init();
+    double best = 0;
+    long first_allocs = 0, last_allocs = 0;
+    int ret = 0;
+    for (int i = 0; i < DIPSHP_PBENCH_RUNS && !ret; ++i) {
+        if (0 != dipshp_pbench_copy_tokens(&tokens, &copy)) {
+            fprintf(stderr, "%s: no memory for the tokens\n", path);
+            ret = 1;
+            break;
+        }
+        dipsh_ast ast;
+        long allocs = dipshp_pbench_allocs;
+        double start = dipshp_pbench_now();
+        int parser_ret = dipsh_parse_tokens(parser, &copy, arena, &ast);
+        double time = dipshp_pbench_now() - start;
+        last_allocs = dipshp_pbench_allocs - allocs;
+        if (!i)
+            first_allocs = last_allocs;
+        if (dipsh_parser_accepted != parser_ret) {
+            fprintf(
+                stderr, "%s: %s\n", path,
+                dipsh_parser_state_get_error(parser)
+            );
+            ret = 1;
+            break;
+        }
+        if (!i || time < best)
+            best = time;
+        dipsh_ast_clean(&ast);
+        dipsh_arena_reset(arena);
+    }
+    if (!ret) {
+        printf(
+            "%s: %d tokens in %.1f ms, %.2fM tok/s; "
+            "%ld allocations in the first run, %ld in the last\n",
+            path, tokens.length, best * 1e3, tokens.length / best / 1e6,
+            first_allocs, last_allocs
+        );
+    }
+    dipsh_arena_destroy(arena);
+    dipsh_parser_state_destroy(parser);
+    dipsh_token_vec_destroy(&copy);
+    dipsh_token_vec_destroy(&tokens);
+    return ret;
+}
+
+int
+main(
+    int argc,
+    char **argv
+)
+{
+    if (argc == 4 && 0 == strcmp(argv[1], "-g")) {
+        dipshp_pbench_generate(argv[2], atol(argv[3]));
+        return 0;
+    }
+    if (argc < 2 || '-' == argv[1][0]) {
+        fprintf(
+            stderr,
+            "usage: parser_bench -g line|lines COMMANDS\n"
+            "       parser_bench FILE...\n"
+        );
+        return 1;
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+        ret |= dipshp_pbench_file(argv[i]);
+    return ret;
+}
@@ -0,0 +1,404 @@
+/* generates the LALR(1) tables of the parser from parser_grammar.h:
+ *
+ *     cc -I. -o parser_gen tools/parser_gen.c && ./parser_gen > parser_tables.h
+ *
+ * run from the top of the tree. The symbols get dense ids: the terminals
+ * are numbered in the order of dipsh_symbol_type, end_of_stream being the
+ * last of them, and so are the nonterminals, separately. The states are
+ * built from LR(0) item sets, the lookaheads of the items with the same
+ * core being merged as they are propagated, and any conflict is an error */
+
+#include "parser_grammar.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIPSHP_GEN_MAX_RULES 64
+#define DIPSHP_GEN_MAX_ITEMS 512
+#define DIPSHP_GEN_MAX_STATES 512
+#define DIPSHP_GEN_MAX_SYMBOLS 32
+
+#define DIPSHP_GEN_RULES_NUM \
+    (int)(sizeof(dipshp_grammar_rules) / sizeof(dipshp_grammar_rules[0]))
+
+/* lookahead sets are bit masks of terminal ids */
+typedef unsigned long dipshp_gen_set;
+
+static int dipshp_gen_terminals_num;
+static int dipshp_gen_nonterminals_num;
+
+/* an item is a rule with a dot in it, numbered with the dot positions of
+ * a rule one after another */
+static int dipshp_gen_rule_items[DIPSHP_GEN_MAX_RULES];
+static int dipshp_gen_items_num;
+
+typedef struct dipshp_gen_state_tag
+{
+    /* the lookaheads of every item, 0 for the items not in the state */
+    dipshp_gen_set items[DIPSHP_GEN_MAX_ITEMS];
+    int transitions[DIPSHP_GEN_MAX_SYMBOLS];
+}
+dipshp_gen_state;
+
+static dipshp_gen_state *dipshp_gen_states[DIPSHP_GEN_MAX_STATES];
+static int dipshp_gen_states_num;
+
+static dipshp_gen_set dipshp_gen_first[DIPSHP_GEN_MAX_SYMBOLS];
+static int dipshp_gen_nullable[DIPSHP_GEN_MAX_SYMBOLS];
+
+/* symbol ids: the terminals first, then the nonterminals */
+static int
+dipshp_gen_symbol_id(
+    dipsh_symbol_type type
+)
+{
+    if (dipsh_symbol_end_of_stream == type)
+        return dipshp_gen_terminals_num - 1;
+    if (type & dipsh_symbol_terminal)
+        return type - dipsh_symbol_terminal - 1;
+    return dipshp_gen_terminals_num + type - dipsh_symbol_nonterminal - 1;
+}
+
+static int
+dipshp_gen_is_terminal(
+    int id
+)
+{
+    return id < dipshp_gen_terminals_num;
+}
+
+static void
+dipshp_gen_count_symbols()
+{
+    int max_terminal = 0, max_nonterminal = 0;
+    for (int i = 0; i < DIPSHP_GEN_RULES_NUM; ++i) {
+        const dipshp_grammar_rule *rule = dipshp_grammar_rules[i];
+        int lh = rule->left_hand_symb - dipsh_symbol_nonterminal;
+        if (lh > max_nonterminal)
+            max_nonterminal = lh;
+        for (int j = 0; j < rule->right_hand_size; ++j) {
+            dipsh_symbol_type type = rule->right_hand_symb[j];
+            if (type & dipsh_symbol_terminal) {
+                int offset = type - dipsh_symbol_terminal;
+                if (offset > max_terminal)
+                    max_terminal = offset;
+            } else {
+                int offset = type - dipsh_symbol_nonterminal;
+                if (offset > max_nonterminal)
+                    max_nonterminal = offset;
+            }
+        }
+    }
+    /* and end_of_stream */
+    dipshp_gen_terminals_num = max_terminal + 1;
+    dipshp_gen_nonterminals_num = max_nonterminal;
+}
+
+static int
+dipshp_gen_item_symbol(
+    int rule,
+    int dot
+)
+{
+    if (dot >= dipshp_grammar_rules[rule]->right_hand_size)
+        return -1;
+    return dipshp_gen_symbol_id(
+        dipshp_grammar_rules[rule]->right_hand_symb[dot]
+    );
+}
+
+static void
+dipshp_gen_compute_first()
+{
+    for (int i = 0; i < dipshp_gen_terminals_num; ++i)
+        dipshp_gen_first[i] = 1ul << i;
+    int changed;
+    do {
+        changed = 0;
+        for (int i = 0; i < DIPSHP_GEN_RULES_NUM; ++i) {
+            const dipshp_grammar_rule *rule = dipshp_grammar_rules[i];
+            int lh = dipshp_gen_symbol_id(rule->left_hand_symb);
+            dipshp_gen_set first = dipshp_gen_first[lh];
+            int nullable = 1;
+            for (int j = 0; j < rule->right_hand_size && nullable; ++j) {
+                int id = dipshp_gen_item_symbol(i, j);
+                first |= dipshp_gen_first[id];
+                nullable = dipshp_gen_nullable[id];
+            }
+            if (first != dipshp_gen_first[lh] ||
+                nullable != dipshp_gen_nullable[lh]) {
+                dipshp_gen_first[lh] = first;
+                dipshp_gen_nullable[lh] = nullable;
+                changed = 1;
+            }
+        }
+    } while (changed);
+}
+
+static void
+dipshp_gen_closure(
+    dipshp_gen_state *state
+)
+{
+    int changed;
+    do {
+        changed = 0;
+        for (int r = 0; r < DIPSHP_GEN_RULES_NUM; ++r) {
+            for (int d = 0; d < dipshp_grammar_rules[r]->right_hand_size; ++d) {
+                dipshp_gen_set lookahead =
+                    state->items[dipshp_gen_rule_items[r] + d];
+                int id = dipshp_gen_item_symbol(r, d);
+                if (!lookahead || dipshp_gen_is_terminal(id))
+                    continue;
+                /* what may follow the nonterminal */
+                dipshp_gen_set follow = 0;
+                int nullable = 1;
+                for (int k = d + 1; nullable; ++k) {
+                    int next = dipshp_gen_item_symbol(r, k);
+                    if (-1 == next)
+                        break;
+                    follow |= dipshp_gen_first[next];
+                    nullable = dipshp_gen_nullable[next];
+                }
+                if (nullable)
+                    follow |= lookahead;
+                for (int i = 0; i < DIPSHP_GEN_RULES_NUM; ++i) {
+                    int lh = dipshp_gen_symbol_id(
+                        dipshp_grammar_rules[i]->left_hand_symb
+                    );
+                    dipshp_gen_set *item =
+                        &state->items[dipshp_gen_rule_items[i]];
+                    if (lh != id ||
+                        (*item | follow) == *item) {
+                        continue;
+                    }
+                    *item |= follow;
+                    changed = 1;
+                }
+            }
+        }
+    } while (changed);
+}
+
+static int
+dipshp_gen_same_core(
+    const dipshp_gen_state *a,
+    const dipshp_gen_state *b
+)
+{
+    for (int i = 0; i < dipshp_gen_items_num; ++i) {
+        if (!a->items[i] != !b->items[i])
+            return 0;
+    }
+    return 1;
+}
+
+/* returns the state with the core of new_state, adding it or merging the
+ * lookaheads into it; *changed is set if that has changed anything */
+static int
+dipshp_gen_add_state(
+    dipshp_gen_state *new_state,
+    int *changed
+)
+{
+    for (int i = 0; i < dipshp_gen_states_num; ++i) {
+        dipshp_gen_state *state = dipshp_gen_states[i];
+        if (!dipshp_gen_same_core(state, new_state))
+            continue;
+        for (int j = 0; j < dipshp_gen_items_num; ++j) {
+            if ((state->items[j] | new_state->items[j]) != state->items[j]) {
+                state->items[j] |= new_state->items[j];
+                *changed = 1;
+            }
+        }
+        free(new_state);
+        return i;
+    }
+    if (DIPSHP_GEN_MAX_STATES == dipshp_gen_states_num) {
+        fprintf(stderr, "parser_gen: too many states\n");
+        exit(1);
+    }
+    memset(new_state->transitions, -1, sizeof(new_state->transitions));
+    dipshp_gen_states[dipshp_gen_states_num] = new_state;
+    *changed = 1;
+    return dipshp_gen_states_num++;
+}
+
+static void
+dipshp_gen_build_states()
+{
+    dipshp_gen_state *start = calloc(sizeof(dipshp_gen_state), 1);
+    start->items[0] = 1ul << (dipshp_gen_terminals_num - 1);
+    dipshp_gen_closure(start);
+    int changed;
+    dipshp_gen_add_state(start, &changed);
+    int symbols_num = dipshp_gen_terminals_num + dipshp_gen_nonterminals_num;
+    do {
+        changed = 0;
+        for (int s = 0; s < dipshp_gen_states_num; ++s) {
+            for (int id = 0; id < symbols_num; ++id) {
+                dipshp_gen_state *next = calloc(sizeof(dipshp_gen_state), 1);
+                int has_items = 0;
+                for (int r = 0; r < DIPSHP_GEN_RULES_NUM; ++r) {
+                    int size = dipshp_grammar_rules[r]->right_hand_size;
+                    for (int d = 0; d < size; ++d) {
+                        int item = dipshp_gen_rule_items[r] + d;
+                        if (!dipshp_gen_states[s]->items[item] ||
+                            dipshp_gen_item_symbol(r, d) != id) {
+                            continue;
+                        }
+                        next->items[item + 1] =
+                            dipshp_gen_states[s]->items[item];
+                        has_items = 1;
+                    }
+                }
+                if (!has_items) {
+                    free(next);
+                    continue;
+                }
+                dipshp_gen_closure(next);
+                dipshp_gen_states[s]->transitions[id] =
+                    dipshp_gen_add_state(next, &changed);
+            }
+        }
+    } while (changed);
+}
+
+/* see parser_tables.h for the encoding */
+static int
+dipshp_gen_action(
+    int state_num,
+    int terminal
+)
+{
+    const dipshp_gen_state *state = dipshp_gen_states[state_num];
+    int action = 0;
+    if (-1 != state->transitions[terminal])
+        action = state->transitions[terminal];
+    for (int r = 0; r < DIPSHP_GEN_RULES_NUM; ++r) {
+        int item = dipshp_gen_rule_items[r] +
+            dipshp_grammar_rules[r]->right_hand_size;
+        if (!(state->items[item] & (1ul << terminal)))
+            continue;
+        if (action) {
+            fprintf(
+                stderr, "parser_gen: %s conflict in state %d on terminal %d\n",
+                action > 0 ? "shift/reduce" : "reduce/reduce",
+                state_num, terminal
+            );
+            exit(1);
+        }
+        action = -1 - r;
+    }
+    return action;
+}
+
+static void
+dipshp_gen_print_row(
+    const int *values,
+    int len
+)
+{
+    printf("    {");
+    int column = 5;
+    for (int i = 0; i < len; ++i) {
+        char value[16];
+        int value_len = snprintf(
+            value, sizeof(value), " %d%s", values[i], i + 1 < len ? "," : ""
+        );
+        if (column + value_len > 76) {
+            printf("\n     ");
+            column = 5;
+        }
+        printf("%s", value);
+        column += value_len;
+    }
+    printf(" },\n");
+}
+
+static void
+dipshp_gen_print_tables()
+{
+    printf(
+        "#ifndef _DIPSH_PARSER_TABLES_H_\n"
+        "#define _DIPSH_PARSER_TABLES_H_\n\n"
+        "/* generated by tools/parser_gen.c from parser_grammar.h, "
+        "do not edit.\n"
+        " * The terminals and the nonterminals are numbered densely, "
+        "in the order of\n"
+        " * dipsh_symbol_type, end_of_stream being the last terminal. "
+        "An action is\n"
+        " * 0 for an error, a positive number of the state to shift to, "
+        "or -1 - n\n"
+        " * to reduce by the rule n, the start rule accepting; "
+        "a goto is the state\n"
+        " * to go to after a nonterminal has been reduced */\n\n"
+    );
+    printf("#define DIPSHP_TOTAL_STATES %d\n", dipshp_gen_states_num);
+    printf("#define DIPSHP_TERMINALS_NUM %d\n", dipshp_gen_terminals_num);
+    printf(
+        "#define DIPSHP_NONTERMINALS_NUM %d\n\n", dipshp_gen_nonterminals_num
+    );
+    printf(
+        "static const signed char\n"
+        "dipshp_parse_actions[DIPSHP_TOTAL_STATES][DIPSHP_TERMINALS_NUM] "
+        "= {\n"
+    );
+    for (int s = 0; s < dipshp_gen_states_num; ++s) {
+        int row[DIPSHP_GEN_MAX_SYMBOLS];
+        for (int t = 0; t < dipshp_gen_terminals_num; ++t)
+            row[t] = dipshp_gen_action(s, t);
+        printf("    /* %d */\n", s);
+        dipshp_gen_print_row(row, dipshp_gen_terminals_num);
+    }
+    printf(
+        "};\n\n"
+        "static const unsigned char\n"
+        "dipshp_parse_gotos[DIPSHP_TOTAL_STATES][DIPSHP_NONTERMINALS_NUM] "
+        "= {\n"
+    );
+    for (int s = 0; s < dipshp_gen_states_num; ++s) {
+        int row[DIPSHP_GEN_MAX_SYMBOLS];
+        for (int n = 0; n < dipshp_gen_nonterminals_num; ++n) {
+            int next = dipshp_gen_states[s]->transitions[
+                dipshp_gen_terminals_num + n
+            ];
+            row[n] = -1 == next ? 0 : next;
+        }
+        printf("    /* %d */\n", s);
+        dipshp_gen_print_row(row, dipshp_gen_nonterminals_num);
+    }
+    printf("};\n\n#endif /* _DIPSH_PARSER_TABLES_H_ */\n");
+}
+
+int
+main()
+{
+    if (DIPSHP_GEN_RULES_NUM > DIPSHP_GEN_MAX_RULES) {
+        fprintf(stderr, "parser_gen: too many rules\n");
+        return 1;
+    }
+    dipshp_gen_count_symbols();
+    if (dipshp_gen_terminals_num > 8 * (int)sizeof(dipshp_gen_set) ||
+        dipshp_gen_terminals_num + dipshp_gen_nonterminals_num >
+            DIPSHP_GEN_MAX_SYMBOLS) {
+        fprintf(stderr, "parser_gen: too many symbols\n");
+        return 1;
+    }
+    for (int r = 0; r < DIPSHP_GEN_RULES_NUM; ++r) {
+        dipshp_gen_rule_items[r] = dipshp_gen_items_num;
+        dipshp_gen_items_num += dipshp_grammar_rules[r]->right_hand_size + 1;
+    }
+    if (dipshp_gen_items_num > DIPSHP_GEN_MAX_ITEMS) {
+        fprintf(stderr, "parser_gen: too many items\n");
+        return 1;
+    }
+    dipshp_gen_compute_first();
+    dipshp_gen_build_states();
+    if (dipshp_gen_states_num > 127 || DIPSHP_GEN_RULES_NUM > 128) {
+        fprintf(stderr, "parser_gen: too many states for the tables\n");
+        return 1;
+    }
+    dipshp_gen_print_tables();
+    return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+# checks that the interactive shell runs the commands of a regular file its
+# stdin is redirected from (epoll can't watch one), as well as of a pipe, a
+# line at a time, so that a wrong line doesn't take the others with it:
+#
+#     tools/stdin_file_test.sh ./dipsh
+#
+# prints the commands' output that has gone wrong, and fails then
+
+dipsh=${1:-./dipsh}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+status=0
+check()
+{
+    # the prompts go to stdout too, with no newline after them; the errors
+    # go to stderr
+    sed 's/^\(> \)*//' "$dir/output" | grep -v '^$' > "$dir/got"
+    if ! cmp -s "$dir/expected" "$dir/got"; then
+        echo "$1:"
+        diff "$dir/expected" "$dir/got"
+        status=1
+    fi
+}
+
+check_input()
+{
+    "$dipsh" < "$dir/input" > "$dir/output" 2> /dev/null
+    check "$1, stdin from a regular file"
+    cat "$dir/input" | "$dipsh" > "$dir/output" 2> /dev/null
+    check "$1, stdin from a pipe"
+}
+
+cat > "$dir/input" <<'EOF'
+echo one
+true && echo two
+false || echo three
+EOF
+printf 'one\ntwo\nthree\n' > "$dir/expected"
+check_input "good lines"
+
+cat > "$dir/input" <<'EOF'
+echo one
+| echo bad
+echo three
+EOF
+printf 'one\nthree\n' > "$dir/expected"
+check_input "a syntax error in the middle"
+
+printf 'echo one\necho \001; echo two\necho three\n' > "$dir/input"
+printf 'one\nthree\n' > "$dir/expected"
+check_input "a lexical error in the middle"
+exit $status